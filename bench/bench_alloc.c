@@ -0,0 +1,133 @@
+// Микробенчмарк выделения блоков: побитовый поиск против пословного
+// поиска с курсором и поиска по иерархической сводке на образе из 1M блоков.
+
+#include "bench_util.h"
+#include "src/superblock/superblock.h"
+#include "src/bitmap_index/bitmap_index.h"
+#include "src/blocks_bitmap/blocks_bitmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_BLOCKS (1u << 20)       // Блоков в образе
+#define LEGACY_FILL_LIMIT 20000u      // Выделений для побитового поиска
+#define TAIL_FREE_BLOCKS 1000u        // Свободных блоков в почти полном образе
+
+// Прежний алгоритм: побитовый просмотр от начала области данных
+static int64_t legacy_allocate_block(struct superblock* sb, uint8_t* bitmap) {
+  for (uint64_t block_idx = sb->first_block_data;
+       block_idx < sb->count_blocks;
+       block_idx++) {
+    if (!((bitmap[block_idx / 8] >> (block_idx % 8)) & 1)) {
+      bitmap[block_idx / 8] |= 1 << (block_idx % 8);
+      sb->count_free_blocks--;
+      return block_idx;
+    }
+  }
+  return -1;
+}
+
+// Поиск по сводке, как в группах блоков смонтированной ФС. Сводка
+// строится перед каждым прогоном
+static struct bitmap_index bench_index;
+
+static int64_t indexed_allocate_block(struct superblock* sb, uint8_t* bitmap) {
+  int64_t block_idx = bitmap_index_find_zero(&bench_index, bitmap,
+                                             sb->next_free_block);
+  if (block_idx < 0) {
+    block_idx = bitmap_index_find_zero(&bench_index, bitmap,
+                                       sb->first_block_data);
+  }
+  if (block_idx < 0) return -1;
+
+  bitmap_index_set(&bench_index, bitmap, block_idx);
+  sb->count_free_blocks--;
+  sb->next_free_block = block_idx + 1;
+  return block_idx;
+}
+
+typedef int64_t (*allocator_fn)(struct superblock*, uint8_t*);
+
+// Выполняет count выделений и возвращает среднее время в нс
+static double run(allocator_fn fn, struct superblock* sb, uint8_t* bitmap,
+                  uint32_t count) {
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < count; i++) {
+    if (fn(sb, bitmap) < 0) {
+      count = i;
+      break;
+    }
+  }
+  uint64_t elapsed = now_ns() - start;
+  return count ? (double)elapsed / count : 0.0;
+}
+
+// Создает свежую геометрию и битовую карту
+static uint8_t* setup(struct superblock* sb) {
+  init_superblock(sb, BENCH_BLOCKS * DEFAULT_BLOCK_SIZE, NULL);
+  uint8_t* bitmap = malloc(sb->count_block_bitmap_blocks * sb->block_size);
+  block_bitmap_init(sb, bitmap);
+  return bitmap;
+}
+
+// Занимает все блоки данных, кроме последних free_tail
+static void fill_except_tail(struct superblock* sb, uint8_t* bitmap,
+                             uint32_t free_tail) {
+  uint64_t last = sb->count_blocks - free_tail;
+  for (uint64_t b = sb->first_block_data; b < last; b++) {
+    bitmap[b / 8] |= 1 << (b % 8);
+  }
+  sb->count_free_blocks = free_tail;
+}
+
+int main(void) {
+  struct superblock sb;
+  uint8_t* bitmap;
+
+  printf("Образ: %u блоков по %u байт\n", BENCH_BLOCKS, DEFAULT_BLOCK_SIZE);
+
+  // Заполнение пустого образа
+  bitmap = setup(&sb);
+  double legacy_fill = run(legacy_allocate_block, &sb, bitmap,
+                           LEGACY_FILL_LIMIT);
+  free(bitmap);
+
+  bitmap = setup(&sb);
+  uint32_t data_blocks = (uint32_t)sb.count_free_blocks;
+  double cursor_fill = run(allocate_block, &sb, bitmap, data_blocks);
+  free(bitmap);
+
+  printf("Заполнение (побитовый, первые %u): %10.1f нс/выделение\n",
+         LEGACY_FILL_LIMIT, legacy_fill);
+  printf("Заполнение (пословный, все %u):  %10.1f нс/выделение\n",
+         data_blocks, cursor_fill);
+
+  // Почти полный образ: свободны только последние блоки
+  bitmap = setup(&sb);
+  fill_except_tail(&sb, bitmap, TAIL_FREE_BLOCKS);
+  double legacy_tail = run(legacy_allocate_block, &sb, bitmap,
+                           TAIL_FREE_BLOCKS);
+  free(bitmap);
+
+  bitmap = setup(&sb);
+  fill_except_tail(&sb, bitmap, TAIL_FREE_BLOCKS);
+  double cursor_tail = run(allocate_block, &sb, bitmap, TAIL_FREE_BLOCKS);
+  free(bitmap);
+
+  bitmap = setup(&sb);
+  fill_except_tail(&sb, bitmap, TAIL_FREE_BLOCKS);
+  bitmap_index_build(&bench_index, bitmap, sb.count_blocks);
+  double indexed_tail = run(indexed_allocate_block, &sb, bitmap,
+                            TAIL_FREE_BLOCKS);
+  bitmap_index_destroy(&bench_index);
+  free(bitmap);
+
+  printf("Почти полный образ (побитовый):    %10.1f нс/выделение\n",
+         legacy_tail);
+  printf("Почти полный образ (пословный):    %10.1f нс/выделение\n",
+         cursor_tail);
+  printf("Почти полный образ (сводка):       %10.1f нс/выделение\n",
+         indexed_tail);
+  return 0;
+}
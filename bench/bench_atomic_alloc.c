@@ -0,0 +1,276 @@
+// Нагрузочная проверка и масштабирование распределителя без блокировок:
+// 1-64 потока выделяют и освобождают блоки через CAS по словам карты (окна
+// потоков, счетчики по CPU) и через allocate_block под общей блокировкой.
+// После каждого прогона проверяется, что ни один блок не выдан дважды, а
+// счетчики суперблока сходятся с битовой картой. Смонтированная ФС
+// выделяет блоки через группы (мьютекс группы и сводка по ее карте),
+// поэтому распределитель на CAS живет только здесь, для сравнения.
+
+#define _GNU_SOURCE
+#include "bench_util.h"
+#include "src/superblock/superblock.h"
+#include "src/blocks_bitmap/blocks_bitmap.h"
+#include "src/bitops/bitops.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_BLOCKS (1u << 20)       // Блоков в образе
+#define BENCH_ALLOCS (1u << 18)       // Выделений за прогон (на все потоки)
+#define BENCH_ROUNDS 4                // Циклов "выделить все - освободить все"
+#define MAX_THREADS 64
+#define CAS_WINDOW 512                // Блоков в окне потока (кратно 64)
+#define CAS_SHARDS 64                 // Счетчиков свободного места (по CPU)
+
+// Окно потока: отрезок области данных, который поток просматривает
+// первым. Окна разных потоков не пересекаются, поэтому потоки изменяют
+// разные слова карты. Окно не дает владения: блоки занимаются через CAS
+struct cas_window {
+  uint64_t next;          // Следующий просматриваемый блок
+  uint64_t end;           // Конец окна (next == end - окно исчерпано)
+};
+
+// Изменение числа свободных блоков; каждый счетчик - в своей строке кэша
+struct cas_counter {
+  int64_t delta;
+} __attribute__((aligned(64)));
+
+// Распределитель на CAS поверх карты блоков
+struct cas_alloc {
+  uint64_t* words;                // Битовая карта блоков по словам
+  uint64_t window_base;           // Начало первого окна (выровнено по слову)
+  uint64_t window_count;          // Окон в области данных
+  uint64_t cursor;                // Номер следующего окна (атомарно)
+  struct cas_counter counters[CAS_SHARDS];
+};
+
+static struct superblock sb;
+static uint8_t* bitmap;
+static struct cas_alloc alloc;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t barrier;
+
+// Счетчик текущего CPU
+static void count(int64_t delta) {
+  int cpu = sched_getcpu();
+  if (cpu < 0) cpu = 0;
+  __atomic_fetch_add(&alloc.counters[(uint32_t)cpu % CAS_SHARDS].delta, delta,
+                     __ATOMIC_RELAXED);
+}
+
+// Занимает свободный бит в [start, end). Возвращает номер бита или -1
+static int64_t claim(uint64_t start, uint64_t end) {
+  if (start >= end) return -1;
+
+  uint64_t last_word = BITMAP_WORD(end - 1);
+  for (uint64_t w = BITMAP_WORD(start); w <= last_word; w++) {
+    // Биты вне [start, end) считаются занятыми
+    uint64_t lo = w == BITMAP_WORD(start) ? start % BITMAP_WORD_BITS : 0;
+    uint64_t hi = w == last_word ? (end - 1) % BITMAP_WORD_BITS + 1
+                                 : BITMAP_WORD_BITS;
+    uint64_t range = bitmap_range_mask(lo, hi);
+
+    uint64_t word = __atomic_load_n(&alloc.words[w], __ATOMIC_RELAXED);
+    uint64_t free_bits;
+    while ((free_bits = ~word & range) != 0) {
+      uint64_t bit = free_bits & -free_bits;
+      if (__atomic_compare_exchange_n(&alloc.words[w], &word, word | bit,
+                                      true, __ATOMIC_ACQ_REL,
+                                      __ATOMIC_RELAXED)) {
+        return (int64_t)(w * BITMAP_WORD_BITS + __builtin_ctzll(bit));
+      }
+      // word обновлен текущим значением - повтор с ним
+    }
+  }
+  return -1;
+}
+
+static void cas_init(void) {
+  memset(&alloc, 0, sizeof(alloc));
+  alloc.words = (uint64_t*)bitmap;
+  alloc.window_base = sb.first_block_data -
+                      sb.first_block_data % BITMAP_WORD_BITS;
+  alloc.window_count = (sb.count_blocks - alloc.window_base + CAS_WINDOW - 1) /
+                       CAS_WINDOW;
+}
+
+// Резервирует следующее окно у общего курсора
+static void next_window(struct cas_window* window) {
+  uint64_t pos = __atomic_fetch_add(&alloc.cursor, 1, __ATOMIC_RELAXED);
+  uint64_t start = alloc.window_base + pos % alloc.window_count * CAS_WINDOW;
+  uint64_t end = start + CAS_WINDOW;
+  window->next = start < sb.first_block_data ? sb.first_block_data : start;
+  window->end = end < sb.count_blocks ? end : sb.count_blocks;
+}
+
+static int64_t cas_alloc_block(struct cas_window* window) {
+  // Не более чем полный обход области данных окнами
+  for (uint64_t i = 0; i <= alloc.window_count; i++) {
+    if (window->next >= window->end) next_window(window);
+    int64_t block = claim(window->next, window->end);
+    if (block >= 0) {
+      window->next = block + 1;
+      count(-1);
+      return block;
+    }
+    window->next = window->end;
+  }
+
+  // Окна могли разминуться с последними свободными блоками
+  int64_t block = claim(sb.first_block_data, sb.count_blocks);
+  if (block >= 0) count(-1);
+  return block;
+}
+
+static void cas_free_block(uint64_t block) {
+  uint64_t mask = BITMAP_MASK(block);
+  uint64_t old = __atomic_fetch_and(&alloc.words[BITMAP_WORD(block)], ~mask,
+                                    __ATOMIC_ACQ_REL);
+  if (old & mask) count(1);
+}
+
+// Переносит счетчики потоков в суперблок
+static void cas_fold(void) {
+  for (uint32_t i = 0; i < CAS_SHARDS; i++) {
+    sb.count_free_blocks += alloc.counters[i].delta;
+    alloc.counters[i].delta = 0;
+  }
+}
+
+struct worker {
+  pthread_t tid;
+  bool locked;            // allocate_block под общей блокировкой
+  uint32_t count;         // Выделений за цикл
+  int64_t* blocks;
+  bool failed;
+  uint64_t start_ns;      // Начало и конец работы потока
+  uint64_t end_ns;
+};
+
+static int64_t alloc_one(struct worker* w, struct cas_window* window) {
+  if (!w->locked) return cas_alloc_block(window);
+
+  pthread_mutex_lock(&lock);
+  int64_t block = allocate_block(&sb, bitmap);
+  pthread_mutex_unlock(&lock);
+  return block;
+}
+
+static void free_one(struct worker* w, uint64_t block) {
+  if (!w->locked) {
+    cas_free_block(block);
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  free_block(&sb, bitmap, block);
+  pthread_mutex_unlock(&lock);
+}
+
+static void* worker_main(void* arg) {
+  struct worker* w = arg;
+  struct cas_window window = { 0, 0 };
+
+  pthread_barrier_wait(&barrier);
+  w->start_ns = now_ns();
+  for (uint32_t round = 0; round < BENCH_ROUNDS; round++) {
+    for (uint32_t i = 0; i < w->count; i++) {
+      w->blocks[i] = alloc_one(w, &window);
+      if (w->blocks[i] < 0) w->failed = true;
+    }
+    // Последний цикл оставляет блоки занятыми для проверки
+    if (round + 1 == BENCH_ROUNDS) break;
+    for (uint32_t i = 0; i < w->count; i++) {
+      if (w->blocks[i] >= 0) free_one(w, w->blocks[i]);
+    }
+  }
+  w->end_ns = now_ns();
+  return NULL;
+}
+
+// Проверяет, что выданные блоки различны, заняты в карте и учтены в счетчике
+static bool verify(struct worker* workers, uint32_t threads, uint64_t free_before) {
+  uint8_t* seen = calloc(BENCH_BLOCKS / 8, 1);
+  uint64_t total = 0;
+  bool ok = true;
+
+  for (uint32_t t = 0; t < threads && ok; t++) {
+    if (workers[t].failed) ok = false;
+    for (uint32_t i = 0; i < workers[t].count && ok; i++) {
+      uint64_t b = workers[t].blocks[i];
+      if (seen[b / 8] & (1 << (b % 8)) || !is_block_allocated(&sb, bitmap, b)) {
+        ok = false;
+      }
+      seen[b / 8] |= 1 << (b % 8);
+      total++;
+    }
+  }
+
+  uint64_t used = bitmap_count_ones(bitmap, sb.first_block_data,
+                                    sb.count_blocks - sb.first_block_data);
+  if (used != total || sb.count_free_blocks != free_before - total) ok = false;
+  free(seen);
+  return ok;
+}
+
+// Выполняет прогон и возвращает среднее время операции в нс (-1 при ошибке)
+static double run(uint32_t threads, bool locked) {
+  init_superblock(&sb, (uint64_t)BENCH_BLOCKS * DEFAULT_BLOCK_SIZE, NULL);
+  bitmap = aligned_alloc(sizeof(uint64_t),
+                         sb.count_block_bitmap_blocks * sb.block_size);
+  block_bitmap_init(&sb, bitmap);
+  uint64_t free_before = sb.count_free_blocks;
+  cas_init();
+
+  struct worker workers[MAX_THREADS];
+  pthread_barrier_init(&barrier, NULL, threads + 1);
+  for (uint32_t t = 0; t < threads; t++) {
+    workers[t] = (struct worker){ .locked = locked,
+                                  .count = BENCH_ALLOCS / threads };
+    workers[t].blocks = malloc(workers[t].count * sizeof(int64_t));
+    pthread_create(&workers[t].tid, NULL, worker_main, &workers[t]);
+  }
+
+  // Время прогона - от старта первого потока до финиша последнего
+  pthread_barrier_wait(&barrier);
+  uint64_t start = UINT64_MAX, end = 0;
+  for (uint32_t t = 0; t < threads; t++) {
+    pthread_join(workers[t].tid, NULL);
+    if (workers[t].start_ns < start) start = workers[t].start_ns;
+    if (workers[t].end_ns > end) end = workers[t].end_ns;
+  }
+  uint64_t elapsed = end - start;
+  pthread_barrier_destroy(&barrier);
+
+  if (!locked) cas_fold();
+  bool ok = verify(workers, threads, free_before);
+
+  for (uint32_t t = 0; t < threads; t++) free(workers[t].blocks);
+  free(bitmap);
+
+  // Операций: BENCH_ROUNDS выделений и BENCH_ROUNDS - 1 освобождений блока
+  uint64_t ops = (uint64_t)(BENCH_ALLOCS / threads) * threads *
+                 (2 * BENCH_ROUNDS - 1);
+  return ok ? (double)elapsed / ops : -1.0;
+}
+
+int main(void) {
+  printf("Образ: %u блоков, %u выделений x %u циклов\n",
+         BENCH_BLOCKS, BENCH_ALLOCS, BENCH_ROUNDS);
+  printf("%8s %22s %22s\n", "потоков", "CAS, нс/операция", "мьютекс, нс/операция");
+
+  for (uint32_t threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    double cas = run(threads, false);
+    double locked = run(threads, true);
+    if (cas < 0 || locked < 0) {
+      printf("%8u ОШИБКА: распределитель выдал блок дважды или потерял счет\n",
+             threads);
+      return 1;
+    }
+    printf("%8u %22.1f %22.1f\n", threads, cas, locked);
+  }
+  return 0;
+}
@@ -0,0 +1,155 @@
+// Фрагментация файлов при выделении блоков данных группами блоков.
+// Область данных заполняется отрезками случайной длины (1..FRAG_MAX_RUN),
+// половина отрезков освобождается, затем пишутся файлы по FILE_BLOCKS
+// блоков записями по WRITE_BLOCKS блоков. Считается число отрезков на
+// файл: при выделении по одному блоку (greedy - так размещал данные
+// прежний жадный поиск: первый свободный блок и свободные сразу за ним),
+// с поиском отрезка first-fit и best-fit. Best-fit просматривает все
+// свободные отрезки группы, а без групп - всей ФС.
+//
+//   bench_extent_alloc [образ]   (по умолчанию /tmp/sifs_bench_extent.img)
+
+#include "bench_util.h"
+#include "src/block_group/block_group.h"
+#include "src/image/image.h"
+#include "src/mkfs/mkfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define IMAGE_SIZE (256ull << 20)     // Размер образа
+#define FRAG_MAX_RUN 64u              // Наибольший отрезок при заполнении
+#define FILE_BLOCKS 512u              // Блоков в файле
+#define WRITE_BLOCKS 64u              // Блоков в одной записи
+#define FILES 200u                    // Файлов в замере
+
+// Отрезок, занятый при заполнении
+struct run {
+  uint64_t start;
+  uint32_t len;
+};
+
+// Смонтированные группы с собственными копиями карт
+struct bench_groups {
+  struct image* img;
+  struct superblock sb;
+  uint8_t* block_bitmap;
+  uint8_t* inode_bitmap;
+  struct block_groups* groups;
+};
+
+static uint32_t next_random(uint32_t* state) {
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 16;
+}
+
+static int32_t open_groups(const char* image, struct bench_groups* bg) {
+  if (mkfs(image, IMAGE_SIZE, NULL, MKFS_LAZY_ITABLE) < 0) return -1;
+  bg->img = image_open(image, 0);
+  if (!bg->img ||
+      image_read(bg->img, &bg->sb, sizeof(bg->sb), 0) !=
+          (ssize_t)sizeof(bg->sb)) {
+    return -1;
+  }
+  bg->block_bitmap = calloc(bg->sb.count_block_bitmap_blocks,
+                            bg->sb.block_size);
+  bg->inode_bitmap = calloc(bg->sb.count_inode_bitmap_blocks,
+                            bg->sb.block_size);
+  if (!bg->block_bitmap || !bg->inode_bitmap) return -1;
+  bg->groups = block_groups_open(bg->img, &bg->sb, bg->block_bitmap,
+                                 bg->inode_bitmap);
+  return bg->groups ? 0 : -1;
+}
+
+static void close_groups(struct bench_groups* bg) {
+  if (bg->groups) block_groups_close(bg->groups);
+  if (bg->img) image_close(bg->img);
+  free(bg->block_bitmap);
+  free(bg->inode_bitmap);
+}
+
+// Занимает всю область данных отрезками случайной длины и освобождает
+// случайную половину из них. Последовательность одна для всех прогонов
+static int32_t fragment(struct block_groups* groups) {
+  uint64_t capacity = groups->sb->count_free_blocks;
+  struct run* runs = malloc(capacity * sizeof(*runs));
+  if (!runs) return -1;
+
+  uint32_t state = 1;
+  uint64_t count = 0;
+  for (;;) {
+    uint32_t want = next_random(&state) % FRAG_MAX_RUN + 1;
+    uint32_t len;
+    int64_t start = block_groups_alloc_run(groups, 0, want, &len);
+    if (start < 0) break;
+    runs[count++] = (struct run){ (uint64_t)start, len };
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    if (next_random(&state) & 1) {
+      block_groups_free_run(groups, runs[i].start, runs[i].len);
+    }
+  }
+
+  free(runs);
+  return 0;
+}
+
+// Пишет FILES файлов по записям из want блоков (не больше WRITE_BLOCKS)
+// и возвращает среднее число отрезков на файл, нс на запись - в ns
+static double write_files(struct block_groups* groups, uint32_t want,
+                          double* ns) {
+  uint64_t runs = 0, writes = 0;
+  uint64_t started = now_ns();
+
+  for (uint32_t f = 0; f < FILES; f++) {
+    // Как и в ФС, данные файла размещаются начиная с группы его inode
+    uint32_t goal = f % groups->count;
+    uint64_t next = UINT64_MAX;
+    for (uint32_t done = 0; done < FILE_BLOCKS;) {
+      uint32_t len;
+      uint32_t chunk = want < FILE_BLOCKS - done ? want : FILE_BLOCKS - done;
+      int64_t block = block_groups_alloc_run(groups, goal, chunk, &len);
+      if (block < 0) return -1;
+      if ((uint64_t)block != next) runs++;
+      next = block + len;
+      done += len;
+      writes++;
+    }
+  }
+
+  *ns = (double)(now_ns() - started) / writes;
+  return (double)runs / FILES;
+}
+
+// Выполняет прогон на свежем образе; by_block - выделение по блоку
+static int32_t run(const char* image, const char* name, bool by_block,
+                   enum extent_policy policy) {
+  struct bench_groups bg = { 0 };
+  int32_t result = -1;
+  if (open_groups(image, &bg) == 0 && fragment(bg.groups) == 0) {
+    if (by_block) printf("Групп блоков: %u\n", bg.groups->count);
+    bg.groups->policy = policy;
+    double ns;
+    double runs = write_files(bg.groups, by_block ? 1 : WRITE_BLOCKS, &ns);
+    if (runs >= 0) {
+      printf("%-11s %6.1f отрезков/файл %10.1f нс/выделение\n", name, runs,
+             ns);
+      result = 0;
+    }
+  }
+  close_groups(&bg);
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  const char* image = argc > 1 ? argv[1] : "/tmp/sifs_bench_extent.img";
+  printf("Файлов %u по %u блоков, записи по %u блоков, свободные отрезки "
+         "до %u блоков\n", FILES, FILE_BLOCKS, WRITE_BLOCKS, FRAG_MAX_RUN);
+  if (run(image, "greedy:", true, EXTENT_FIRST_FIT) < 0 ||
+      run(image, "first-fit:", false, EXTENT_FIRST_FIT) < 0 ||
+      run(image, "best-fit:", false, EXTENT_BEST_FIT) < 0) {
+    perror("bench_extent_alloc");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Разрешение путей с кэшем записей каталогов и без него: путь глубины
+// LOOKUP_DEPTH к одному из LOOKUP_FILES файлов в большом каталоге. Без
+// dcache каждый компонент ищется в блоках каталога (индекс и лист), с
+// dcache - одной хэш-таблицей в памяти. Блоки каталога в кэше блоков.
+//
+//   bench_lookup [образ]   (по умолчанию /tmp/sifs_bench_lookup.img)
+
+#include "bench_util.h"
+#include "src/block_cache/block_cache.h"
+#include "src/dcache/dcache.h"
+#include "src/fs/fs.h"
+#include "src/image/image.h"
+#include "src/inode_cache/inode_cache.h"
+#include "src/mkfs/mkfs.h"
+#include "src/namei/namei.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define IMAGE_SIZE (64ull << 20)      // Размер образа
+#define LOOKUP_DEPTH 4                // Каталогов в пути до файла
+#define LOOKUP_FILES 2000u            // Файлов в последнем каталоге
+#define LOOKUP_ROUNDS 50u             // Проходов по всем файлам
+
+static void file_path(char* path, size_t size, uint32_t i) {
+  snprintf(path, size, "/d0/d1/d2/d3/file%05u", i);
+}
+
+// Создает каталоги пути и файлы в последнем из них
+static int32_t populate(const char* image) {
+  struct fs* fs = fs_mount(image, NULL);
+  if (!fs) return -1;
+
+  char path[64] = "";
+  uint32_t ino;
+  int32_t result = 0;
+  for (uint32_t d = 0; d < LOOKUP_DEPTH && result == 0; d++) {
+    size_t len = strlen(path);
+    snprintf(path + len, sizeof(path) - len, "/d%u", d);
+    result = fs_create(fs, path, 040755, 0, 0, &ino);
+  }
+  for (uint32_t i = 0; i < LOOKUP_FILES && result == 0; i++) {
+    file_path(path, sizeof(path), i);
+    result = fs_create(fs, path, 0100644, 0, 0, &ino);
+  }
+
+  if (fs_unmount(fs) < 0) result = -1;
+  return result;
+}
+
+// Разрешает все пути LOOKUP_ROUNDS раз. Возвращает нс на путь или 0
+static double run(struct block_cache* bcache, struct superblock* sb,
+                  struct inode_cache* icache, struct dcache* dcache) {
+  char path[64];
+  uint32_t ino;
+  uint64_t start = now_ns();
+  for (uint32_t r = 0; r < LOOKUP_ROUNDS; r++) {
+    for (uint32_t i = 0; i < LOOKUP_FILES; i++) {
+      file_path(path, sizeof(path), i);
+      if (path_lookup(bcache, sb, icache, dcache, path, &ino) < 0) return 0;
+    }
+  }
+  return (double)(now_ns() - start) / (LOOKUP_ROUNDS * LOOKUP_FILES);
+}
+
+int main(int argc, char* argv[]) {
+  const char* image = argc > 1 ? argv[1] : "/tmp/sifs_bench_lookup.img";
+  if (mkfs(image, IMAGE_SIZE, NULL, MKFS_LAZY_ITABLE) < 0 ||
+      populate(image) < 0) {
+    perror("mkfs");
+    return 1;
+  }
+
+  struct superblock sb;
+  struct image* img = image_open(image, 0);
+  if (!img || image_read(img, &sb, sizeof(sb), 0) != (ssize_t)sizeof(sb)) {
+    perror("image");
+    return 1;
+  }
+  struct block_cache* bcache = block_cache_create(img, sb.block_size, 0);
+  struct inode_cache* icache =
+      bcache ? inode_cache_create(bcache, &sb, 0) : NULL;
+  struct dcache* dcache = dcache_create(0);
+  if (!icache || !dcache) {
+    perror("cache");
+    return 1;
+  }
+
+  // Первый проход прогревает кэш inode и страничный кэш
+  run(bcache, &sb, icache, NULL);
+  double cold = run(bcache, &sb, icache, NULL);
+  run(bcache, &sb, icache, dcache);
+  double warm = run(bcache, &sb, icache, dcache);
+
+  printf("Путь глубины %u, %u файлов в каталоге\n", LOOKUP_DEPTH + 1,
+         LOOKUP_FILES);
+  printf("Без dcache: %10.1f нс/путь\n", cold);
+  printf("С dcache:   %10.1f нс/путь\n", warm);
+
+  dcache_destroy(dcache);
+  inode_cache_destroy(icache);
+  block_cache_destroy(bcache);
+  image_close(img);
+  return 0;
+}
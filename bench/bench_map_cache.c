@@ -0,0 +1,188 @@
+// Разрешение логических блоков файла с кэшем отображения и без него:
+// случайные обращения к MAP_HOT_REGIONS горячим участкам фрагментированного
+// файла (отрезки по MAP_RUN_BLOCKS блоков с разрывами). Без кэша каждый
+// поиск проходит дерево экстентов или блоки указателей (их блоки - в кэше
+// блоков), с кэшем - попадает в один из запомненных отрезков. Отрезок в
+// разметке указателей не выходит за блок указателей, поэтому горячий
+// отрезок на его границе занимает две записи кэша. Затем те же обращения
+// идут через fs_read, а счетчики берутся из fs_file_get_stats.
+//
+//   bench_map_cache [образ]   (по умолчанию /tmp/sifs_bench_map_cache.img)
+
+#include "bench_util.h"
+#include "src/block_cache/block_cache.h"
+#include "src/block_map/extent_tree.h"
+#include "src/block_map/map_cache.h"
+#include "src/fs/fs.h"
+#include "src/image/image.h"
+#include "src/mkfs/mkfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IMAGE_SIZE (256ull << 20)     // Размер образа
+#define MAP_FILE_BLOCKS 32768u        // Логических блоков в файле
+#define MAP_RUN_BLOCKS 16u            // Блоков в отрезке
+#define MAP_HOT_REGIONS 8u            // Горячих участков (по отрезку)
+#define MAP_LOOKUPS 1000000u          // Обращений в замере
+#define FS_FILE_SIZE (64u << 20)      // Файл для замера через fs_read
+
+// Источник блоков для заполнения отображения: блоки выдаются подряд с
+// начала области данных. Образ после замера не монтируется
+struct seq_allocator {
+  struct block_allocator base;
+  uint64_t next;
+};
+
+static int64_t seq_alloc(struct block_allocator* alloc) {
+  return ((struct seq_allocator*)alloc)->next++;
+}
+
+static void seq_free(struct block_allocator* alloc, uint64_t start,
+                     uint64_t len) {
+  (void)alloc;
+  (void)start;
+  (void)len;
+}
+
+// Логический блок i-го обращения: случайный блок одного из горячих
+// отрезков, разнесенных по файлу. Участки сдвинуты на полшага от начала,
+// чтобы ни один не попал на границу прямых блоков inode (она делит
+// отрезок надвое)
+static uint64_t hot_block(uint32_t i) {
+  static const uint64_t stride = MAP_FILE_BLOCKS / MAP_HOT_REGIONS;
+  uint32_t r = (i * 2654435761u) >> 7;
+  return (r % MAP_HOT_REGIONS) * stride + stride / 2 +
+         (r >> 3) % MAP_RUN_BLOCKS;
+}
+
+// Отображает файл отрезками по MAP_RUN_BLOCKS блоков, между отрезками -
+// пропущенный физический блок, чтобы отрезки не сливались
+static int32_t fill_map(struct block_cache* bcache, struct superblock* sb,
+                        struct seq_allocator* alloc, struct inode* node) {
+  for (uint64_t logical = 0; logical < MAP_FILE_BLOCKS;
+       logical += MAP_RUN_BLOCKS) {
+    uint64_t physical = alloc->next;
+    alloc->next += MAP_RUN_BLOCKS + 1;
+    if (block_map_assign_run(bcache, sb, &alloc->base, node, logical,
+                             physical, MAP_RUN_BLOCKS) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Возвращает нс на обращение без кэша отображения (cache == NULL) или с
+// ним, 0 при ошибке
+static double run(struct block_cache* bcache, struct superblock* sb,
+                  const struct inode* node, struct map_cache* cache) {
+  uint64_t physical, sum = 0;
+  uint64_t start = now_ns();
+  for (uint32_t i = 0; i < MAP_LOOKUPS; i++) {
+    int32_t result = cache
+        ? map_cache_resolve(cache, bcache, sb, node, hot_block(i), &physical)
+        : block_map_resolve(bcache, sb, node, hot_block(i), &physical);
+    if (result < 0) return 0;
+    sum += physical;
+  }
+  double ns = (double)(now_ns() - start) / MAP_LOOKUPS;
+  return sum ? ns : 0;
+}
+
+// Замер на уровне block_map: дерево экстентов и косвенные указатели
+static int32_t bench_block_map(const char* image) {
+  if (mkfs(image, IMAGE_SIZE, NULL, MKFS_LAZY_ITABLE) < 0) return -1;
+
+  struct superblock sb;
+  struct image* img = image_open(image, 0);
+  if (!img || image_read(img, &sb, sizeof(sb), 0) != (ssize_t)sizeof(sb)) {
+    return -1;
+  }
+  struct block_cache* bcache = block_cache_create(img, sb.block_size, 0);
+  if (!bcache) return -1;
+
+  struct seq_allocator alloc = {
+    { seq_alloc, seq_free }, sb.first_block_data + MKFS_ROOT_BLOCKS };
+  // Нужна только область адресации inode
+  struct inode extents, pointers;
+  memset(&extents, 0, sizeof(extents));
+  memset(&pointers, 0, sizeof(pointers));
+  extent_tree_init(&extents);
+  if (fill_map(bcache, &sb, &alloc, &extents) < 0 ||
+      fill_map(bcache, &sb, &alloc, &pointers) < 0) {
+    return -1;
+  }
+
+  printf("Файл %u блоков по %u байт, отрезки по %u блоков, %u горячих\n",
+         MAP_FILE_BLOCKS, sb.block_size, MAP_RUN_BLOCKS, MAP_HOT_REGIONS);
+  const char* names[] = { "Экстенты:  ", "Указатели: " };
+  const struct inode* nodes[] = { &extents, &pointers };
+  for (uint32_t k = 0; k < 2; k++) {
+    struct map_cache cache;
+    map_cache_init(&cache);
+    run(bcache, &sb, nodes[k], NULL);  // Прогрев кэша блоков
+    double cold = run(bcache, &sb, nodes[k], NULL);
+    double warm = run(bcache, &sb, nodes[k], &cache);
+
+    struct map_cache_stats stats;
+    map_cache_get_stats(&cache, &stats);
+    printf("%s без кэша %7.1f нс, с кэшем %7.1f нс (промахов %lu)\n",
+           names[k], cold, warm, (unsigned long)stats.misses);
+  }
+
+  // Изменения отображения не сохраняются: образ только для замера
+  block_cache_invalidate(bcache, 0, sb.count_blocks);
+  block_cache_destroy(bcache);
+  image_close(img);
+  return 0;
+}
+
+// Те же обращения через fs_read; попадания - из счетчиков файла
+static int32_t bench_fs(const char* image) {
+  if (mkfs(image, IMAGE_SIZE, NULL, MKFS_LAZY_ITABLE) < 0) return -1;
+  struct fs* fs = fs_mount(image, NULL);
+  if (!fs) return -1;
+
+  uint32_t ino;
+  struct fs_file* file = NULL;
+  uint8_t* buffer = calloc(1, FS_FILE_SIZE);
+  int32_t result = -1;
+  struct fs_stat st;
+  if (buffer && fs_create(fs, "/file", 0100644, 0, 0, &ino) == 0 &&
+      (file = fs_open(fs, ino)) &&
+      fs_write(file, buffer, FS_FILE_SIZE, 0) == FS_FILE_SIZE &&
+      fs_getattr(fs, ino, &st) == 0) {
+    uint64_t blocks = FS_FILE_SIZE / st.block_size;
+
+    struct fs_file_stats before, after;
+    fs_file_get_stats(file, &before);
+    uint64_t start = now_ns();
+    for (uint32_t i = 0; i < MAP_LOOKUPS; i++) {
+      uint64_t logical = hot_block(i) * blocks / MAP_FILE_BLOCKS;
+      if (fs_read(file, buffer, 1, logical * st.block_size) != 1) break;
+    }
+    double ns = (double)(now_ns() - start) / MAP_LOOKUPS;
+    fs_file_get_stats(file, &after);
+
+    printf("fs_read:    %7.1f нс на чтение, попаданий в кэш %lu, "
+           "промахов %lu\n", ns,
+           (unsigned long)(after.map_hits - before.map_hits),
+           (unsigned long)(after.map_misses - before.map_misses));
+    result = 0;
+  }
+
+  free(buffer);
+  if (file) fs_close(file);
+  if (fs_unmount(fs) < 0) result = -1;
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  const char* image = argc > 1 ? argv[1] : "/tmp/sifs_bench_map_cache.img";
+  if (bench_block_map(image) < 0 || bench_fs(image) < 0) {
+    perror("bench_map_cache");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+// Бенчмарк подсчета бит: байтовая lookup-таблица против реализаций
+// popcount (scalar/popcnt/avx2/avx512) на битовых картах от 1 МБ до 256 МБ.
+
+#include "bench_util.h"
+#include "src/bitops/popcount.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MIN_SIZE (1u << 20)      // 1 МБ
+#define MAX_SIZE (256u << 20)    // 256 МБ
+#define TARGET_BYTES (1u << 30)  // Объем данных на одно измерение
+
+// Прежний способ: lookup-таблица на каждый байт
+static uint64_t popcount_lookup(const uint8_t* data, size_t size) {
+  static uint8_t table[256];
+  if (!table[255]) {
+    for (int i = 0; i < 256; i++) table[i] = __builtin_popcount(i);
+  }
+
+  uint64_t count = 0;
+  for (size_t i = 0; i < size; i++) count += table[data[i]];
+  return count;
+}
+
+// Возвращает пропускную способность в ГБ/с, результат подсчета - в *count
+static double measure(int impl, const uint8_t* data, size_t size,
+                      uint64_t* count) {
+  uint32_t rounds = TARGET_BYTES / size;
+  if (rounds == 0) rounds = 1;
+
+  uint64_t start = now_ns();
+  for (uint32_t r = 0; r < rounds; r++) {
+    *count = impl < 0 ? popcount_lookup(data, size) :
+        popcount_bytes_with(impl, data, size);
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  return (double)size * rounds / elapsed;
+}
+
+int main(void) {
+  uint8_t* data = malloc(MAX_SIZE);
+  if (!data) return 1;
+
+  srand(42);
+  for (size_t i = 0; i < MAX_SIZE; i++) data[i] = rand();
+
+  printf("Диспетчер выбрал: %s\n", popcount_impl_name(popcount_best_impl()));
+  printf("%10s %16s %10s\n", "размер", "реализация", "ГБ/с");
+
+  for (size_t size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+    uint64_t expected;
+    double gbps = measure(-1, data, size, &expected);
+    printf("%8zu МБ %16s %10.2f\n", size >> 20, "lookup", gbps);
+
+    for (int impl = 0; impl < POPCOUNT_IMPL_COUNT; impl++) {
+      if (!popcount_impl_supported(impl)) continue;
+
+      uint64_t count;
+      gbps = measure(impl, data, size, &count);
+      printf("%8zu МБ %16s %10.2f%s\n", size >> 20, popcount_impl_name(impl),
+             gbps, count == expected ? "" : "  РАСХОЖДЕНИЕ!");
+    }
+  }
+
+  free(data);
+  return 0;
+}
@@ -0,0 +1,110 @@
+// Потоковое чтение большого файла через src/fs: запросами по блоку,
+// крупными запросами (участки образа читаются одним pread прямо в буфер)
+// и через fs_sendfile в файл в памяти (memfd). Для сравнения тот же
+// объем читается из файла образа напрямую. Данные в страничном кэше, поэтому замеряются
+// накладные расходы ФС, а не скорость диска.
+//
+//   bench_read [образ]   (по умолчанию /tmp/sifs_bench_read.img)
+
+#define _GNU_SOURCE
+#include "bench_util.h"
+#include "src/fs/fs.h"
+#include "src/mkfs/mkfs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define IMAGE_SIZE (1ull << 30)       // Размер образа
+#define FILE_SIZE (256u << 20)        // Размер читаемого файла
+#define LARGE_REQUEST (1u << 20)      // Крупный запрос чтения
+#define BENCH_ROUNDS 3                // Прогонов каждого способа (берется лучший)
+
+// Читает файл целиком запросами по request байт. Возвращает МиБ/с
+static double read_file(struct fs_file* file, uint8_t* buffer,
+                        size_t request) {
+  uint64_t start = now_ns();
+  for (uint64_t off = 0; off < FILE_SIZE; off += request) {
+    if (fs_read(file, buffer, request, off) != (ssize_t)request) return 0;
+  }
+  return FILE_SIZE / 1048576.0 / ((now_ns() - start) / 1e9);
+}
+
+// Передает файл целиком в out_fd запросами по request байт
+static double send_file(struct fs_file* file, int out_fd, size_t request) {
+  if (ftruncate(out_fd, 0) < 0 || lseek(out_fd, 0, SEEK_SET) < 0) return 0;
+  uint64_t start = now_ns();
+  for (uint64_t off = 0; off < FILE_SIZE; off += request) {
+    if (fs_sendfile(file, out_fd, request, off) != (ssize_t)request) return 0;
+  }
+  return FILE_SIZE / 1048576.0 / ((now_ns() - start) / 1e9);
+}
+
+// Читает тот же объем из файла образа напрямую
+static double read_raw(int fd, uint8_t* buffer, size_t request) {
+  uint64_t start = now_ns();
+  for (uint64_t off = 0; off < FILE_SIZE; off += request) {
+    if (pread(fd, buffer, request, off) != (ssize_t)request) return 0;
+  }
+  return FILE_SIZE / 1048576.0 / ((now_ns() - start) / 1e9);
+}
+
+static double best(double a, double b) {
+  return a > b ? a : b;
+}
+
+int main(int argc, char* argv[]) {
+  const char* image = argc > 1 ? argv[1] : "/tmp/sifs_bench_read.img";
+  if (mkfs(image, IMAGE_SIZE, NULL, MKFS_LAZY_ITABLE) < 0) {
+    perror("mkfs");
+    return 1;
+  }
+
+  struct fs* fs = fs_mount(image, NULL);
+  uint32_t ino;
+  if (!fs || fs_create(fs, "/data", 0100644, 0, 0, &ino) < 0) {
+    perror("fs");
+    return 1;
+  }
+
+  struct fs_file* file = fs_open(fs, ino);
+  uint8_t* buffer = malloc(LARGE_REQUEST);
+  for (uint32_t i = 0; i < LARGE_REQUEST; i++) buffer[i] = (uint8_t)i;
+  for (uint64_t off = 0; off < FILE_SIZE; off += LARGE_REQUEST) {
+    if (fs_write(file, buffer, LARGE_REQUEST, off) != LARGE_REQUEST) {
+      perror("fs_write");
+      return 1;
+    }
+  }
+
+  struct fs_statfs st;
+  fs_statfs(fs, &st);
+  int out_fd = memfd_create("bench_read", 0);
+  int raw_fd = open(image, O_RDONLY);
+
+  double by_block = 0, large = 0, sent = 0, raw = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    by_block = best(by_block, read_file(file, buffer, st.block_size));
+    large = best(large, read_file(file, buffer, LARGE_REQUEST));
+    sent = best(sent, send_file(file, out_fd, LARGE_REQUEST));
+    raw = best(raw, read_raw(raw_fd, buffer, LARGE_REQUEST));
+  }
+
+  printf("Файл: %u МиБ, блок %u байт\n", FILE_SIZE >> 20, st.block_size);
+  printf("fs_read по блоку:       %10.1f МиБ/с\n", by_block);
+  printf("fs_read по %4u КиБ:    %10.1f МиБ/с\n", LARGE_REQUEST >> 10,
+         large);
+  printf("fs_sendfile в memfd:    %10.1f МиБ/с\n", sent);
+  printf("pread образа напрямую:  %10.1f МиБ/с\n", raw);
+
+  close(raw_fd);
+  close(out_fd);
+  free(buffer);
+  fs_close(file);
+  fs_unmount(fs);
+  unlink(image);
+  return 0;
+}
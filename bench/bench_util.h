@@ -0,0 +1,13 @@
+#pragma once
+
+// Общие вспомогательные функции бенчмарков
+
+#include <stdint.h>
+#include <time.h>
+
+// Монотонное время в наносекундах
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
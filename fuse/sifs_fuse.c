@@ -0,0 +1,322 @@
+// Монтирование образа sifs через FUSE (libfuse 3, высокоуровневый API).
+// Запросы обслуживаются несколькими потоками (режим fuse_main по
+// умолчанию, -s - однопоточный); синхронизацию обеспечивает src/fs.
+//
+//   sifs-fuse [опции FUSE] [-o icache=N,dcache=N] <образ> <точка монтирования>
+//
+// icache и dcache - число записей кэшей inode и записей каталогов.
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include "src/fs/fs.h"
+
+static struct fs* get_fs(void) {
+  return fuse_get_context()->private_data;
+}
+
+static struct fs_file* get_file(const struct fuse_file_info* fi) {
+  return (struct fs_file*)(uintptr_t)fi->fh;
+}
+
+static struct timespec to_timespec(int64_t ns) {
+  struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+  return ts;
+}
+
+static void fill_stat(const struct fs_stat* st, struct stat* out) {
+  memset(out, 0, sizeof(*out));
+  out->st_ino = st->ino;
+  out->st_mode = st->mode;
+  out->st_nlink = st->links;
+  out->st_uid = st->uid;
+  out->st_gid = st->gid;
+  out->st_size = st->size;
+  out->st_blksize = st->block_size;
+  out->st_blocks = st->blocks * (st->block_size / 512);
+  out->st_atim = to_timespec(st->atime);
+  out->st_mtim = to_timespec(st->mtime);
+  out->st_ctim = to_timespec(st->ctime);
+}
+
+// Образ и параметры монтирования из командной строки
+struct sifs_config {
+  const char* image;
+  struct fs_options options;
+  // fuse_opt присваивает значение опции полю, поэтому флаги монтирования
+  // собираются из отдельных полей
+  int mmap;
+  int best_fit;
+};
+
+// Образ монтируется здесь, а не в main: fuse_main уходит в фон через
+// fork, и потоки ввода-вывода, запущенные до него, в дочернем процессе
+// не существуют
+static void* sifs_init(struct fuse_conn_info* conn, struct fuse_config* cfg) {
+  (void)conn;
+  cfg->use_ino = 1;
+  // Удаление открытого файла обрабатывает src/fs (освобождение при
+  // последнем закрытии), переименование в .fuse_hidden не нужно
+  cfg->hard_remove = 1;
+
+  struct fuse_context* ctx = fuse_get_context();
+  const struct sifs_config* config = ctx->private_data;
+  struct fs* fs = fs_mount(config->image, &config->options);
+  if (!fs) {
+    fprintf(stderr, "Не удалось смонтировать %s: %s\n", config->image,
+            strerror(errno));
+    fuse_exit(ctx->fuse);
+  }
+  return fs;
+}
+
+static void sifs_destroy(void* data) {
+  if (fs_unmount(data) < 0) {
+    fprintf(stderr, "Ошибка при размонтировании: %s\n", strerror(errno));
+  }
+}
+
+static int sifs_getattr(const char* path, struct stat* st,
+                        struct fuse_file_info* fi) {
+  struct fs* fs = get_fs();
+  uint32_t ino;
+  if (fi && fi->fh) {
+    ino = fs_file_ino(get_file(fi));
+  } else if (fs_lookup(fs, path, &ino) < 0) {
+    return -errno;
+  }
+
+  struct fs_stat attr;
+  if (fs_getattr(fs, ino, &attr) < 0) return -errno;
+  fill_stat(&attr, st);
+  return 0;
+}
+
+// Аргумент обхода каталога
+struct readdir_ctx {
+  void* buf;
+  fuse_fill_dir_t filler;
+};
+
+static int32_t readdir_entry(const char* name, uint32_t ino, uint32_t type,
+                             void* arg) {
+  struct readdir_ctx* ctx = arg;
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_ino = ino;
+  st.st_mode = type;
+  return ctx->filler(ctx->buf, name, &st, 0, 0);
+}
+
+static int sifs_readdir(const char* path, void* buf, fuse_fill_dir_t filler,
+                        off_t offset, struct fuse_file_info* fi,
+                        enum fuse_readdir_flags flags) {
+  (void)offset;
+  (void)fi;
+  (void)flags;
+  struct fs* fs = get_fs();
+  uint32_t ino;
+  if (fs_lookup(fs, path, &ino) < 0) return -errno;
+
+  struct readdir_ctx ctx = { buf, filler };
+  return fs_readdir(fs, ino, readdir_entry, &ctx) < 0 ? -errno : 0;
+}
+
+static int sifs_open(const char* path, struct fuse_file_info* fi) {
+  struct fs_file* file = fs_open_path(get_fs(), path);
+  if (!file) return -errno;
+  if ((fi->flags & O_TRUNC) && fs_truncate(file, 0) < 0) {
+    int saved = errno;
+    fs_close(file);
+    return -saved;
+  }
+
+  fi->fh = (uintptr_t)file;
+  return 0;
+}
+
+static int sifs_create(const char* path, mode_t mode,
+                       struct fuse_file_info* fi) {
+  struct fs* fs = get_fs();
+  struct fuse_context* ctx = fuse_get_context();
+  uint32_t ino;
+  if (fs_create(fs, path, S_IFREG | (mode & 07777), ctx->uid, ctx->gid,
+                &ino) < 0) {
+    return -errno;
+  }
+
+  struct fs_file* file = fs_open_path(fs, path);
+  if (!file) return -errno;
+  fi->fh = (uintptr_t)file;
+  return 0;
+}
+
+static int sifs_mkdir(const char* path, mode_t mode) {
+  struct fuse_context* ctx = fuse_get_context();
+  uint32_t ino;
+  return fs_create(get_fs(), path, S_IFDIR | (mode & 07777), ctx->uid,
+                   ctx->gid, &ino) < 0 ? -errno : 0;
+}
+
+static int sifs_symlink(const char* target, const char* path) {
+  struct fuse_context* ctx = fuse_get_context();
+  uint32_t ino;
+  return fs_symlink(get_fs(), target, path, ctx->uid, ctx->gid,
+                    &ino) < 0 ? -errno : 0;
+}
+
+// FUSE ждет цель с завершающим нулем, усеченную до size - 1 байт
+static int sifs_readlink(const char* path, char* buf, size_t size) {
+  struct fs* fs = get_fs();
+  uint32_t ino;
+  if (size == 0) return -EINVAL;
+  if (fs_lookup(fs, path, &ino) < 0) return -errno;
+
+  ssize_t len = fs_readlink(fs, ino, buf, size - 1);
+  if (len < 0) return -errno;
+  buf[len] = '\0';
+  return 0;
+}
+
+static int sifs_unlink(const char* path) {
+  return fs_unlink(get_fs(), path) < 0 ? -errno : 0;
+}
+
+static int sifs_release(const char* path, struct fuse_file_info* fi) {
+  (void)path;
+  return fs_close(get_file(fi)) < 0 ? -errno : 0;
+}
+
+static int sifs_read(const char* path, char* buf, size_t size, off_t offset,
+                     struct fuse_file_info* fi) {
+  (void)path;
+  ssize_t n = fs_read(get_file(fi), buf, size, offset);
+  return n < 0 ? -errno : (int)n;
+}
+
+static int sifs_write(const char* path, const char* buf, size_t size,
+                      off_t offset, struct fuse_file_info* fi) {
+  (void)path;
+  ssize_t n = fs_write(get_file(fi), buf, size, offset);
+  return n < 0 ? -errno : (int)n;
+}
+
+static int sifs_truncate(const char* path, off_t size,
+                         struct fuse_file_info* fi) {
+  if (fi && fi->fh) {
+    return fs_truncate(get_file(fi), size) < 0 ? -errno : 0;
+  }
+
+  struct fs* fs = get_fs();
+  struct fs_file* file = fs_open_path(fs, path);
+  if (!file) return -errno;
+
+  int result = fs_truncate(file, size) < 0 ? -errno : 0;
+  fs_close(file);
+  return result;
+}
+
+static int sifs_fsync(const char* path, int datasync,
+                      struct fuse_file_info* fi) {
+  (void)path;
+  (void)datasync;
+  (void)fi;
+  return fs_sync(get_fs()) < 0 ? -errno : 0;
+}
+
+static int sifs_statfs(const char* path, struct statvfs* st) {
+  (void)path;
+  struct fs_statfs info;
+  fs_statfs(get_fs(), &info);
+
+  memset(st, 0, sizeof(*st));
+  st->f_bsize = info.block_size;
+  st->f_frsize = info.block_size;
+  st->f_blocks = info.blocks;
+  st->f_bfree = info.free_blocks;
+  st->f_bavail = info.free_blocks;
+  st->f_files = info.inodes;
+  st->f_ffree = info.free_inodes;
+  st->f_favail = info.free_inodes;
+  st->f_namemax = info.name_max;
+  return 0;
+}
+
+static const struct fuse_operations sifs_ops = {
+  .init = sifs_init,
+  .destroy = sifs_destroy,
+  .getattr = sifs_getattr,
+  .readdir = sifs_readdir,
+  .open = sifs_open,
+  .create = sifs_create,
+  .mkdir = sifs_mkdir,
+  .symlink = sifs_symlink,
+  .readlink = sifs_readlink,
+  .unlink = sifs_unlink,
+  .release = sifs_release,
+  .read = sifs_read,
+  .write = sifs_write,
+  .truncate = sifs_truncate,
+  .fsync = sifs_fsync,
+  .statfs = sifs_statfs,
+};
+
+static const struct fuse_opt sifs_opts[] = {
+  { "icache=%u", offsetof(struct sifs_config, options.icache_capacity), 0 },
+  { "dcache=%u", offsetof(struct sifs_config, options.dcache_capacity), 0 },
+  { "bcache=%u", offsetof(struct sifs_config, options.bcache_capacity), 0 },
+  { "mmap", offsetof(struct sifs_config, mmap), FS_MOUNT_MMAP },
+  { "bestfit", offsetof(struct sifs_config, best_fit), FS_MOUNT_BEST_FIT },
+  FUSE_OPT_END
+};
+
+// Первый аргумент без опции - образ, остальное разбирает FUSE
+static int parse_arg(void* data, const char* arg, int key,
+                     struct fuse_args* outargs) {
+  (void)outargs;
+  struct sifs_config* config = data;
+  if (key == FUSE_OPT_KEY_NONOPT && !config->image) {
+    config->image = arg;
+    return 0;
+  }
+  return 1;
+}
+
+int main(int argc, char* argv[]) {
+  struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+  struct sifs_config config = { 0 };
+  if (fuse_opt_parse(&args, &config, sifs_opts, parse_arg) < 0) return 1;
+  if (!config.image) {
+    fprintf(stderr, "Запустите: %s [опции FUSE] <образ> <точка монтирования>\n",
+            argv[0]);
+    fuse_opt_free_args(&args);
+    return 1;
+  }
+
+  // Переход в фон меняет рабочий каталог на корень, поэтому путь к образу
+  // разрешается заранее; там же проверяется, что образ содержит ФС
+  char* image = realpath(config.image, NULL);
+  if (!image || fs_check(image) < 0) {
+    fprintf(stderr, "Не удалось смонтировать %s: %s\n", config.image,
+            strerror(errno));
+    free(image);
+    fuse_opt_free_args(&args);
+    return 1;
+  }
+  config.image = image;
+  config.options.flags = config.mmap | config.best_fit;
+
+  int result = fuse_main(args.argc, args.argv, &sifs_ops, &config);
+  fuse_opt_free_args(&args);
+  free(image);
+  return result;
+}
@@ -0,0 +1,184 @@
+#include "bitmap_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include "../bitops/bitops.h"
+#include "../debug/debug.h"
+
+// Число 64-битных слов, вмещающих bits бит
+static uint64_t words_for(uint64_t bits) {
+  return (bits + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+}
+
+// Маска битов за пределами count в последнем слове (считаются занятыми)
+static uint64_t tail_padding(uint64_t count, uint64_t word_idx) {
+  if (word_idx != words_for(count) - 1 || count % BITMAP_WORD_BITS == 0) {
+    return 0;
+  }
+  return ~0ULL << (count % BITMAP_WORD_BITS);
+}
+
+// Слово карты с хвостовыми битами, помеченными как занятые
+static uint64_t load_padded(const struct bitmap_index* index,
+                            const uint8_t* bitmap,
+                            uint64_t word_idx) {
+  return bitmap_load_word(bitmap, word_idx) |
+      tail_padding(index->bits, word_idx);
+}
+
+int32_t bitmap_index_build(struct bitmap_index* index,
+                           const uint8_t* bitmap,
+                           uint64_t bits) {
+  memset(index, 0, sizeof(*index));
+  if (bits == 0) return -1;
+
+  index->bits = bits;
+  index->free = bits - bitmap_count_ones(bitmap, 0, bits);
+
+  // Уровни строятся до тех пор, пока уровень не уложится в одно слово
+  uint64_t level_bits = words_for(bits);
+  do {
+    if (index->levels == BITMAP_INDEX_MAX_LEVELS) {
+      sifs_error("Слишком большая карта для сводки: %lu бит\n",
+                 (unsigned long)bits);
+      bitmap_index_destroy(index);
+      return -1;
+    }
+
+    uint32_t k = index->levels++;
+    uint64_t words = words_for(level_bits);
+    index->level_bits[k] = level_bits;
+    index->level[k] = calloc(words, sizeof(uint64_t));
+    if (!index->level[k]) {
+      bitmap_index_destroy(index);
+      return -1;
+    }
+    index->level[k][words - 1] = tail_padding(level_bits, words - 1);
+
+    // Бит уровня выставляется для каждого полностью занятого слова ниже
+    for (uint64_t i = 0; i < level_bits; i++) {
+      uint64_t below = k == 0 ? load_padded(index, bitmap, i) :
+          index->level[k - 1][i];
+      if (below == ~0ULL) index->level[k][BITMAP_WORD(i)] |= BITMAP_MASK(i);
+    }
+
+    level_bits = words;
+  } while (level_bits > 1);
+
+  sifs_debug("Сводка построена: %lu бит, %u уровней, свободно %lu\n",
+             (unsigned long)bits, index->levels, (unsigned long)index->free);
+  return 0;
+}
+
+void bitmap_index_destroy(struct bitmap_index* index) {
+  for (uint32_t k = 0; k < index->levels; k++) {
+    free(index->level[k]);
+  }
+  memset(index, 0, sizeof(*index));
+}
+
+// Ищет на уровне k первую позицию >= pos с нулевым битом (незаполненное
+// слово уровня ниже). Возвращает позицию или -1.
+static int64_t find_nonfull(const struct bitmap_index* index, uint32_t k,
+                            uint64_t pos) {
+  if (pos >= index->level_bits[k]) return -1;
+
+  uint64_t word_idx = BITMAP_WORD(pos);
+  uint64_t word = index->level[k][word_idx] | (BITMAP_MASK(pos) - 1);
+  if (word != ~0ULL) {
+    return word_idx * BITMAP_WORD_BITS + __builtin_ctzll(~word);
+  }
+
+  // Верхний уровень состоит из одного слова
+  if (k + 1 == index->levels) return -1;
+
+  // Уровнем выше находим следующее незаполненное слово и спускаемся в него
+  int64_t next = find_nonfull(index, k + 1, word_idx + 1);
+  if (next < 0) return -1;
+  return next * BITMAP_WORD_BITS + __builtin_ctzll(~index->level[k][next]);
+}
+
+int64_t bitmap_index_find_zero(const struct bitmap_index* index,
+                               const uint8_t* bitmap,
+                               uint64_t start) {
+  if (start >= index->bits || index->free == 0) return -1;
+
+  // Сначала проверяем остаток слова, содержащего start
+  uint64_t word_idx = BITMAP_WORD(start);
+  uint64_t word = load_padded(index, bitmap, word_idx) |
+      (BITMAP_MASK(start) - 1);
+  if (word != ~0ULL) {
+    return word_idx * BITMAP_WORD_BITS + __builtin_ctzll(~word);
+  }
+
+  int64_t next = find_nonfull(index, 0, word_idx + 1);
+  if (next < 0) return -1;
+  return next * BITMAP_WORD_BITS +
+      __builtin_ctzll(~load_padded(index, bitmap, next));
+}
+
+// Распространяет изменение заполненности слова карты вверх по уровням
+static void propagate(struct bitmap_index* index, const uint8_t* bitmap,
+                      uint64_t word_idx) {
+  bool full = load_padded(index, bitmap, word_idx) == ~0ULL;
+  uint64_t pos = word_idx;
+
+  for (uint32_t k = 0; k < index->levels; k++) {
+    uint64_t* word = &index->level[k][BITMAP_WORD(pos)];
+    uint64_t updated = full ? *word | BITMAP_MASK(pos) :
+        *word & ~BITMAP_MASK(pos);
+    if (updated == *word) break;
+
+    *word = updated;
+    full = updated == ~0ULL;
+    pos = BITMAP_WORD(pos);
+  }
+}
+
+void bitmap_index_set(struct bitmap_index* index, uint8_t* bitmap,
+                      uint64_t bit) {
+  if (bit >= index->bits || (bitmap[bit / 8] >> (bit % 8)) & 1) return;
+
+  bitmap[bit / 8] |= 1 << (bit % 8);
+  index->free--;
+  propagate(index, bitmap, BITMAP_WORD(bit));
+}
+
+void bitmap_index_clear(struct bitmap_index* index, uint8_t* bitmap,
+                        uint64_t bit) {
+  if (bit >= index->bits || !((bitmap[bit / 8] >> (bit % 8)) & 1)) return;
+
+  bitmap[bit / 8] &= ~(1 << (bit % 8));
+  index->free++;
+  propagate(index, bitmap, BITMAP_WORD(bit));
+}
+
+// Применяет операцию к диапазону карты и пересчитывает затронутые слова
+static void apply_range(struct bitmap_index* index, uint8_t* bitmap,
+                        uint64_t start, uint64_t count, bool set) {
+  if (start >= index->bits || count == 0) return;
+  if (count > index->bits - start) count = index->bits - start;
+
+  uint64_t ones = bitmap_count_ones(bitmap, start, count);
+  if (set) {
+    bitmap_set_range(bitmap, start, count);
+    index->free -= count - ones;
+  } else {
+    bitmap_clear_range(bitmap, start, count);
+    index->free += ones;
+  }
+
+  uint64_t last_word = BITMAP_WORD(start + count - 1);
+  for (uint64_t w = BITMAP_WORD(start); w <= last_word; w++) {
+    propagate(index, bitmap, w);
+  }
+}
+
+void bitmap_index_set_range(struct bitmap_index* index, uint8_t* bitmap,
+                            uint64_t start, uint64_t count) {
+  apply_range(index, bitmap, start, count, true);
+}
+
+void bitmap_index_clear_range(struct bitmap_index* index, uint8_t* bitmap,
+                              uint64_t start, uint64_t count) {
+  apply_range(index, bitmap, start, count, false);
+}
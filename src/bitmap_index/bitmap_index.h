@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Максимальное число уровней сводки (6 уровней покрывают карту из 2^42 бит)
+#define BITMAP_INDEX_MAX_LEVELS 6
+
+// Иерархическая сводка над битовой картой (только в памяти).
+// Уровень 0 хранит по биту на каждое 64-битное слово карты (1 = слово занято
+// целиком), уровень k - по биту на каждое слово уровня k-1. Хвостовые биты
+// за пределами карты считаются занятыми, поэтому поиск свободного бита
+// занимает по одному слову на уровень независимо от размера образа.
+struct bitmap_index {
+  uint64_t bits;                                  // Число отслеживаемых бит
+  uint64_t free;                                  // Число нулевых бит
+  uint32_t levels;                                // Число уровней сводки
+  uint64_t level_bits[BITMAP_INDEX_MAX_LEVELS];   // Бит на каждом уровне
+  uint64_t* level[BITMAP_INDEX_MAX_LEVELS];       // Слова уровней
+};
+
+// Строит сводку по битовой карте из bits бит (вызывается при монтировании).
+// Возвращает 0 или -1 при нехватке памяти.
+extern int32_t bitmap_index_build(struct bitmap_index* index,
+                                  const uint8_t* bitmap,
+                                  uint64_t bits);
+
+// Освобождает память сводки
+extern void bitmap_index_destroy(struct bitmap_index* index);
+
+// Ищет первый нулевой бит карты, начиная с start.
+// Возвращает номер бита или -1, если свободных бит после start нет.
+extern int64_t bitmap_index_find_zero(const struct bitmap_index* index,
+                                      const uint8_t* bitmap,
+                                      uint64_t start);
+
+// Устанавливает бит карты и обновляет сводку
+extern void bitmap_index_set(struct bitmap_index* index, uint8_t* bitmap,
+                             uint64_t bit);
+
+// Сбрасывает бит карты и обновляет сводку
+extern void bitmap_index_clear(struct bitmap_index* index, uint8_t* bitmap,
+                               uint64_t bit);
+
+// Устанавливает биты [start, start + count) и обновляет сводку
+extern void bitmap_index_set_range(struct bitmap_index* index,
+                                   uint8_t* bitmap,
+                                   uint64_t start,
+                                   uint64_t count);
+
+// Сбрасывает биты [start, start + count) и обновляет сводку
+extern void bitmap_index_clear_range(struct bitmap_index* index,
+                                     uint8_t* bitmap,
+                                     uint64_t start,
+                                     uint64_t count);
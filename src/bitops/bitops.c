@@ -0,0 +1,100 @@
+#include "bitops.h"
+#include "popcount.h"
+
+int64_t bitmap_find_zero(const uint8_t* bitmap, uint64_t start, uint64_t end) {
+  if (start >= end) return -1;
+
+  uint64_t word_idx = BITMAP_WORD(start);
+  const uint64_t last_word = BITMAP_WORD(end - 1);
+
+  // В первом слове игнорируем биты до start (считаем их занятыми)
+  uint64_t free_bits = ~bitmap_load_word(bitmap, word_idx) &
+      ~(BITMAP_MASK(start) - 1);
+
+  // Полностью занятые слова пропускаются одной проверкой
+  while (free_bits == 0) {
+    if (++word_idx > last_word) return -1;
+    free_bits = ~bitmap_load_word(bitmap, word_idx);
+  }
+
+  uint64_t bit = word_idx * BITMAP_WORD_BITS + __builtin_ctzll(free_bits);
+  return bit < end ? (int64_t)bit : -1;
+}
+
+int64_t bitmap_find_one(const uint8_t* bitmap, uint64_t start, uint64_t end) {
+  if (start >= end) return -1;
+
+  uint64_t word_idx = BITMAP_WORD(start);
+  const uint64_t last_word = BITMAP_WORD(end - 1);
+
+  uint64_t used_bits = bitmap_load_word(bitmap, word_idx) &
+      ~(BITMAP_MASK(start) - 1);
+
+  // Полностью свободные слова пропускаются одной проверкой
+  while (used_bits == 0) {
+    if (++word_idx > last_word) return -1;
+    used_bits = bitmap_load_word(bitmap, word_idx);
+  }
+
+  uint64_t bit = word_idx * BITMAP_WORD_BITS + __builtin_ctzll(used_bits);
+  return bit < end ? (int64_t)bit : -1;
+}
+
+// Применяет операцию к словам, покрывающим диапазон [start, start + count)
+static void bitmap_apply_range(uint8_t* bitmap, uint64_t start,
+                               uint64_t count, int set) {
+  if (count == 0) return;
+
+  const uint64_t end = start + count;
+  uint64_t word_idx = BITMAP_WORD(start);
+  const uint64_t last_word = BITMAP_WORD(end - 1);
+
+  for (; word_idx <= last_word; word_idx++) {
+    uint32_t from = word_idx == BITMAP_WORD(start) ?
+        start % BITMAP_WORD_BITS : 0;
+    uint32_t to = word_idx == last_word ?
+        (end - 1) % BITMAP_WORD_BITS + 1 : BITMAP_WORD_BITS;
+    uint64_t mask = bitmap_range_mask(from, to);
+
+    // Целые слова записываются без чтения
+    uint64_t word = mask == ~0ULL ? 0 : bitmap_load_word(bitmap, word_idx);
+    word = set ? word | mask : word & ~mask;
+    bitmap_store_word(bitmap, word_idx, word);
+  }
+}
+
+void bitmap_set_range(uint8_t* bitmap, uint64_t start, uint64_t count) {
+  bitmap_apply_range(bitmap, start, count, 1);
+}
+
+void bitmap_clear_range(uint8_t* bitmap, uint64_t start, uint64_t count) {
+  bitmap_apply_range(bitmap, start, count, 0);
+}
+
+uint64_t bitmap_count_ones(const uint8_t* bitmap, uint64_t start,
+                           uint64_t count) {
+  if (count == 0) return 0;
+
+  const uint64_t end = start + count;
+  uint64_t first_word = BITMAP_WORD(start);
+  const uint64_t last_word = BITMAP_WORD(end - 1);
+
+  // Неполные крайние слова считаются по маске
+  if (first_word == last_word) {
+    return __builtin_popcountll(bitmap_load_word(bitmap, first_word) &
+        bitmap_range_mask(start % BITMAP_WORD_BITS,
+                          (end - 1) % BITMAP_WORD_BITS + 1));
+  }
+
+  uint64_t ones = __builtin_popcountll(bitmap_load_word(bitmap, first_word) &
+      bitmap_range_mask(start % BITMAP_WORD_BITS, BITMAP_WORD_BITS));
+  ones += __builtin_popcountll(bitmap_load_word(bitmap, last_word) &
+      bitmap_range_mask(0, (end - 1) % BITMAP_WORD_BITS + 1));
+
+  // Целые слова между ними - векторным подсчетом
+  uint64_t inner_words = last_word - first_word - 1;
+  ones += popcount_bytes(bitmap + (first_word + 1) * sizeof(uint64_t),
+                         inner_words * sizeof(uint64_t));
+
+  return ones;
+}
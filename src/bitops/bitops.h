@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+// Количество бит в машинном слове битовой карты
+#define BITMAP_WORD_BITS 64
+
+// Номер 64-битного слова, содержащего бит
+#define BITMAP_WORD(bit) ((bit) / BITMAP_WORD_BITS)
+
+// Маска бита внутри 64-битного слова
+#define BITMAP_MASK(bit) (1ULL << ((bit) % BITMAP_WORD_BITS))
+
+// Читает 64-битное слово битовой карты (бит i слова = бит i % 8 байта i / 8)
+static inline uint64_t bitmap_load_word(const uint8_t* bitmap,
+                                        uint64_t word_idx) {
+  uint64_t word;
+  memcpy(&word, bitmap + word_idx * sizeof(uint64_t), sizeof(word));
+  return le64toh(word);
+}
+
+// Записывает 64-битное слово битовой карты
+static inline void bitmap_store_word(uint8_t* bitmap, uint64_t word_idx,
+                                     uint64_t word) {
+  word = htole64(word);
+  memcpy(bitmap + word_idx * sizeof(uint64_t), &word, sizeof(word));
+}
+
+// Маска бит [from, to) внутри одного слова (0 <= from < to <= 64)
+static inline uint64_t bitmap_range_mask(uint32_t from, uint32_t to) {
+  uint64_t high = to >= BITMAP_WORD_BITS ? ~0ULL : (1ULL << to) - 1;
+  return high & ~((1ULL << from) - 1);
+}
+
+// Ищет первый нулевой бит в диапазоне [start, end).
+// Возвращает номер бита или -1, если все биты диапазона установлены.
+// Буфер должен быть выровнен по размеру до целого числа 64-битных слов.
+extern int64_t bitmap_find_zero(const uint8_t* bitmap,
+                                uint64_t start,
+                                uint64_t end);
+
+// Ищет первый установленный бит в диапазоне [start, end).
+// Возвращает номер бита или -1, если все биты диапазона сброшены.
+extern int64_t bitmap_find_one(const uint8_t* bitmap,
+                               uint64_t start,
+                               uint64_t end);
+
+// Устанавливает биты [start, start + count) пословными масочными записями
+extern void bitmap_set_range(uint8_t* bitmap, uint64_t start, uint64_t count);
+
+// Сбрасывает биты [start, start + count) пословными масочными записями
+extern void bitmap_clear_range(uint8_t* bitmap, uint64_t start,
+                               uint64_t count);
+
+// Подсчитывает установленные биты в диапазоне [start, start + count)
+extern uint64_t bitmap_count_ones(const uint8_t* bitmap, uint64_t start,
+                                  uint64_t count);
@@ -0,0 +1,152 @@
+#include "popcount.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define POPCOUNT_X86
+#endif
+
+typedef uint64_t (*popcount_fn)(const uint8_t* data, size_t size);
+
+// Хвост буфера короче машинного слова
+static uint64_t popcount_tail(const uint8_t* data, size_t size) {
+  uint64_t count = 0;
+  for (size_t i = 0; i < size; i++) {
+    count += __builtin_popcount(data[i]);
+  }
+  return count;
+}
+
+static uint64_t popcount_scalar(const uint8_t* data, size_t size) {
+  uint64_t count = 0;
+  size_t i = 0;
+
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    count += __builtin_popcountll(word);
+  }
+
+  return count + popcount_tail(data + i, size - i);
+}
+
+#ifdef POPCOUNT_X86
+__attribute__((target("popcnt")))
+static uint64_t popcount_popcnt(const uint8_t* data, size_t size) {
+  // Четыре независимых аккумулятора скрывают задержку POPCNT
+  uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+  size_t i = 0;
+
+  for (; i + 4 * sizeof(uint64_t) <= size; i += 4 * sizeof(uint64_t)) {
+    uint64_t w[4];
+    memcpy(w, data + i, sizeof(w));
+    c0 += __builtin_popcountll(w[0]);
+    c1 += __builtin_popcountll(w[1]);
+    c2 += __builtin_popcountll(w[2]);
+    c3 += __builtin_popcountll(w[3]);
+  }
+
+  return c0 + c1 + c2 + c3 + popcount_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t popcount_avx2(const uint8_t* data, size_t size) {
+  // Число бит в каждом полубайте 0..15
+  const __m256i lookup = _mm256_setr_epi8(
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0F);
+  __m256i total = _mm256_setzero_si256();
+  size_t i = 0;
+
+  while (i + 32 <= size) {
+    // Байтовые счетчики сливаются в 64-битные не реже чем через 8 итераций
+    // (8 * 8 бит не переполняют байт)
+    __m256i local = _mm256_setzero_si256();
+    for (int n = 0; n < 8 && i + 32 <= size; n++, i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+      __m256i lo = _mm256_and_si256(v, low_mask);
+      __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+      local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, lo));
+      local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, hi));
+    }
+    total = _mm256_add_epi64(total,
+                             _mm256_sad_epu8(local, _mm256_setzero_si256()));
+  }
+
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i*)lanes, total);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+      popcount_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t popcount_avx512(const uint8_t* data, size_t size) {
+  __m512i total = _mm512_setzero_si512();
+  size_t i = 0;
+
+  for (; i + 64 <= size; i += 64) {
+    __m512i v = _mm512_loadu_si512((const void*)(data + i));
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+  }
+
+  return _mm512_reduce_add_epi64(total) + popcount_scalar(data + i, size - i);
+}
+#endif
+
+bool popcount_impl_supported(enum popcount_impl impl) {
+  switch (impl) {
+    case POPCOUNT_SCALAR: return true;
+#ifdef POPCOUNT_X86
+    case POPCOUNT_POPCNT: return __builtin_cpu_supports("popcnt");
+    case POPCOUNT_AVX2: return __builtin_cpu_supports("avx2");
+    case POPCOUNT_AVX512:
+      return __builtin_cpu_supports("avx512f") &&
+          __builtin_cpu_supports("avx512vpopcntdq");
+#endif
+    default: return false;
+  }
+}
+
+const char* popcount_impl_name(enum popcount_impl impl) {
+  switch (impl) {
+    case POPCOUNT_SCALAR: return "scalar";
+    case POPCOUNT_POPCNT: return "popcnt";
+    case POPCOUNT_AVX2: return "avx2";
+    case POPCOUNT_AVX512: return "avx512-vpopcntq";
+    default: return "unknown";
+  }
+}
+
+static popcount_fn impl_fn(enum popcount_impl impl) {
+  switch (impl) {
+#ifdef POPCOUNT_X86
+    case POPCOUNT_POPCNT: return popcount_popcnt;
+    case POPCOUNT_AVX2: return popcount_avx2;
+    case POPCOUNT_AVX512: return popcount_avx512;
+#endif
+    default: return popcount_scalar;
+  }
+}
+
+enum popcount_impl popcount_best_impl(void) {
+  static int best = -1;
+
+  // Выбор делается один раз; повторная гонка безопасна - результат одинаков
+  if (best < 0) {
+    int impl = POPCOUNT_IMPL_COUNT - 1;
+    while (impl > POPCOUNT_SCALAR && !popcount_impl_supported(impl)) impl--;
+    best = impl;
+  }
+  return (enum popcount_impl)best;
+}
+
+uint64_t popcount_bytes(const uint8_t* data, size_t size) {
+  return impl_fn(popcount_best_impl())(data, size);
+}
+
+uint64_t popcount_bytes_with(enum popcount_impl impl,
+                             const uint8_t* data,
+                             size_t size) {
+  return impl_fn(impl)(data, size);
+}
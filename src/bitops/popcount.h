@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Реализации подсчета установленных бит
+enum popcount_impl {
+  POPCOUNT_SCALAR,    // Переносимая версия (__builtin_popcountll)
+  POPCOUNT_POPCNT,    // Инструкция POPCNT на 64-битных словах
+  POPCOUNT_AVX2,      // AVX2: таблица полубайтов через VPSHUFB
+  POPCOUNT_AVX512,    // AVX-512 VPOPCNTQ
+  POPCOUNT_IMPL_COUNT
+};
+
+// Проверяет, поддерживает ли процессор указанную реализацию
+extern bool popcount_impl_supported(enum popcount_impl impl);
+
+// Возвращает название реализации
+extern const char* popcount_impl_name(enum popcount_impl impl);
+
+// Возвращает реализацию, выбранную диспетчером для текущего процессора
+extern enum popcount_impl popcount_best_impl(void);
+
+// Подсчитывает установленные биты в буфере (лучшая доступная реализация)
+extern uint64_t popcount_bytes(const uint8_t* data, size_t size);
+
+// Подсчитывает установленные биты указанной реализацией (для сравнения).
+// Реализация должна поддерживаться процессором.
+extern uint64_t popcount_bytes_with(enum popcount_impl impl,
+                                    const uint8_t* data,
+                                    size_t size);
@@ -0,0 +1,388 @@
+#include "block_cache.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../debug/debug.h"
+
+// Хэш номера блока (мультипликативный, по Кнуту)
+static uint32_t hash_block(const struct block_cache* cache, uint64_t block) {
+  return (uint32_t)((block * 0x9E3779B97F4A7C15ULL) >> 32) & cache->hash_mask;
+}
+
+// Ищет буфер блока. Возвращает индекс или -1
+static int32_t lookup(const struct block_cache* cache, uint64_t block) {
+  int32_t i = cache->hash[hash_block(cache, block)];
+  while (i >= 0 && cache->buffers[i].block != block) {
+    i = cache->buffers[i].hash_next;
+  }
+  return i;
+}
+
+static void hash_insert(struct block_cache* cache, int32_t i) {
+  uint32_t bucket = hash_block(cache, cache->buffers[i].block);
+  cache->buffers[i].hash_next = cache->hash[bucket];
+  cache->hash[bucket] = i;
+}
+
+static void hash_remove(struct block_cache* cache, int32_t i) {
+  int32_t* link = &cache->hash[hash_block(cache, cache->buffers[i].block)];
+  while (*link != i) link = &cache->buffers[*link].hash_next;
+  *link = cache->buffers[i].hash_next;
+}
+
+// Записывает один грязный буфер в образ
+static int32_t write_back(struct block_cache* cache, struct cache_buffer* buf) {
+  off_t offset = (off_t)buf->block * cache->block_size;
+  if (image_write(cache->img, buf->data, cache->block_size, offset) < 0) {
+    return -1;
+  }
+  buf->dirty = false;
+  cache->stats.writebacks++;
+  return 0;
+}
+
+// Выбирает буфер для нового блока по алгоритму CLOCK. Грязный буфер
+// возвращается как есть: его записывает вызывающий.
+// Возвращает индекс или -1, если все буферы закреплены
+static int32_t evict(struct block_cache* cache) {
+  // За два оборота стрелки бит обращения снимается у всех буферов
+  for (uint32_t step = 0; step < 2 * cache->capacity; step++) {
+    int32_t i = cache->clock_hand;
+    struct cache_buffer* buf = &cache->buffers[i];
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+    if (buf->pins || buf->io) continue;
+    if (!buf->valid) return i;
+    if (buf->referenced) {
+      buf->referenced = false;
+      continue;
+    }
+    return i;
+  }
+
+  return -1;
+}
+
+// Записывает грязный буфер, выбранный для вытеснения, сняв блокировку
+// кэша. Пока идет запись, буфер помечен io: его не вытесняют, а
+// обращения к его блоку ждут. Возвращает 0 или -1 при ошибке записи
+static int32_t evict_write_back(struct block_cache* cache,
+                                struct cache_buffer* buf) {
+  buf->io = true;
+  pthread_mutex_unlock(&cache->lock);
+
+  off_t offset = (off_t)buf->block * cache->block_size;
+  ssize_t n = image_write(cache->img, buf->data, cache->block_size, offset);
+  int saved = errno;
+
+  pthread_mutex_lock(&cache->lock);
+  buf->io = false;
+  pthread_cond_broadcast(&cache->io_done);
+  if (n < 0) {
+    errno = saved;
+    return -1;
+  }
+  buf->dirty = false;
+  cache->stats.writebacks++;
+  return 0;
+}
+
+struct block_cache* block_cache_create(struct image* img,
+                                       uint32_t block_size,
+                                       uint32_t capacity) {
+  if (block_size == 0) return NULL;
+  if (capacity == 0) capacity = BLOCK_CACHE_DEFAULT_CAPACITY;
+
+  struct block_cache* cache = calloc(1, sizeof(*cache));
+  if (!cache) return NULL;
+
+  // Таблица не менее чем вдвое больше числа буферов, размер - степень двойки
+  uint32_t buckets = 1;
+  while (buckets < 2 * capacity) buckets <<= 1;
+
+  cache->img = img;
+  cache->block_size = block_size;
+  cache->capacity = capacity;
+  cache->hash_mask = buckets - 1;
+  cache->hash = malloc(buckets * sizeof(int32_t));
+  cache->buffers = calloc(capacity, sizeof(struct cache_buffer));
+  cache->memory = malloc((size_t)capacity * block_size);
+  if (!cache->hash || !cache->buffers || !cache->memory) {
+    free(cache->hash);
+    free(cache->buffers);
+    free(cache->memory);
+    free(cache);
+    return NULL;
+  }
+
+  memset(cache->hash, 0xFF, buckets * sizeof(int32_t));  // Все цепочки -1
+  for (uint32_t i = 0; i < capacity; i++) {
+    cache->buffers[i].data = cache->memory + (size_t)i * block_size;
+    cache->buffers[i].hash_next = -1;
+  }
+
+  // Без асинхронного движка грязные буферы пишутся по одному
+  cache->aio = image_aio_create(img, BLOCK_CACHE_FLUSH_DEPTH, 0);
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->io_done, NULL);
+
+  sifs_debug("Кэш блоков: %u буферов по %u байт\n", capacity, block_size);
+  return cache;
+}
+
+int32_t block_cache_destroy(struct block_cache* cache) {
+  if (!cache) return 0;
+
+  int32_t result = block_cache_sync(cache);
+
+  image_aio_destroy(cache->aio);
+  pthread_mutex_destroy(&cache->lock);
+  pthread_cond_destroy(&cache->io_done);
+  free(cache->hash);
+  free(cache->buffers);
+  free(cache->memory);
+  free(cache);
+  return result;
+}
+
+struct cache_buffer* block_cache_get(struct block_cache* cache,
+                                     uint64_t block,
+                                     bool read) {
+  pthread_mutex_lock(&cache->lock);
+
+  struct cache_buffer* buf;
+  while (1) {
+    int32_t i = lookup(cache, block);
+    if (i >= 0) {
+      buf = &cache->buffers[i];
+      if (buf->io) {
+        pthread_cond_wait(&cache->io_done, &cache->lock);
+        continue;
+      }
+      buf->pins++;
+      buf->referenced = true;
+      cache->stats.hits++;
+      pthread_mutex_unlock(&cache->lock);
+      return buf;
+    }
+
+    i = evict(cache);
+    if (i < 0) {
+      sifs_warn("Кэш блоков: все %u буферов закреплены\n", cache->capacity);
+      pthread_mutex_unlock(&cache->lock);
+      errno = EBUSY;
+      return NULL;
+    }
+    buf = &cache->buffers[i];
+    if (!buf->dirty) break;
+
+    // Пока блокировка снята, блок могли загрузить другие потоки, поэтому
+    // поиск повторяется
+    if (evict_write_back(cache, buf) < 0) {
+      int saved = errno;
+      sifs_error("Не удалось записать блок %lu\n", (unsigned long)buf->block);
+      pthread_mutex_unlock(&cache->lock);
+      errno = saved;
+      return NULL;
+    }
+  }
+
+  cache->stats.misses++;
+  if (buf->valid) {
+    hash_remove(cache, buf - cache->buffers);
+    cache->stats.evictions++;
+  }
+  buf->block = block;
+  buf->pins = 1;
+  buf->valid = true;
+  buf->dirty = false;
+  buf->referenced = true;
+  hash_insert(cache, buf - cache->buffers);
+  if (!read) {
+    pthread_mutex_unlock(&cache->lock);
+    return buf;
+  }
+
+  buf->io = true;
+  pthread_mutex_unlock(&cache->lock);
+
+  off_t offset = (off_t)block * cache->block_size;
+  ssize_t n = image_read(cache->img, buf->data, cache->block_size, offset);
+  int saved = errno;
+  // Блок за концом образа читается как нули
+  if (n >= 0) memset(buf->data + n, 0, cache->block_size - n);
+
+  pthread_mutex_lock(&cache->lock);
+  buf->io = false;
+  pthread_cond_broadcast(&cache->io_done);
+  if (n < 0) {
+    hash_remove(cache, buf - cache->buffers);
+    buf->valid = false;
+    buf->pins = 0;
+    buf = NULL;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  errno = saved;
+  return buf;
+}
+
+void block_cache_release(struct block_cache* cache, struct cache_buffer* buf) {
+  pthread_mutex_lock(&cache->lock);
+  sifs_assert(buf->pins > 0);
+  buf->pins--;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void block_cache_mark_dirty(struct block_cache* cache,
+                            struct cache_buffer* buf) {
+  pthread_mutex_lock(&cache->lock);
+  buf->dirty = true;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int32_t block_cache_read(struct block_cache* cache, uint64_t block,
+                         uint32_t offset, void* buffer, uint32_t size) {
+  sifs_assert(offset + size <= cache->block_size);
+  struct cache_buffer* buf = block_cache_get(cache, block, true);
+  if (!buf) return -1;
+
+  memcpy(buffer, buf->data + offset, size);
+  block_cache_release(cache, buf);
+  return 0;
+}
+
+int32_t block_cache_write(struct block_cache* cache, uint64_t block,
+                          uint32_t offset, const void* buffer,
+                          uint32_t size) {
+  sifs_assert(offset + size <= cache->block_size);
+  bool whole = offset == 0 && size == cache->block_size;
+  struct cache_buffer* buf = block_cache_get(cache, block, !whole);
+  if (!buf) return -1;
+
+  // Буфер помечается после копирования: sync, начавшийся раньше, снимет
+  // пометку до нее, и блок запишется следующим sync
+  memcpy(buf->data + offset, buffer, size);
+  block_cache_mark_dirty(cache, buf);
+  block_cache_release(cache, buf);
+  return 0;
+}
+
+// Пакетная запись грязных буферов через асинхронный движок. Если движок
+// отказал, он закрывается: image_aio_destroy дожидается отправленных
+// запросов, поэтому их буферы не вытесняются, пока ядро или пул пишут из
+// них, и завершения не достанутся следующему sync. Оставшиеся грязные
+// буферы пишет вызывающий
+static void sync_batched(struct block_cache* cache, int32_t* result) {
+  struct image_aio_completion done[BLOCK_CACHE_FLUSH_DEPTH];
+  uint32_t next = 0;
+
+  while (next < cache->capacity || image_aio_inflight(cache->aio)) {
+    // Заполняем очередь, пока есть место
+    for (; next < cache->capacity; next++) {
+      struct cache_buffer* buf = &cache->buffers[next];
+      if (!buf->valid || !buf->dirty) continue;
+      if (image_aio_prep_write(cache->aio, buf->data, cache->block_size,
+                               (off_t)buf->block * cache->block_size,
+                               next) < 0) {
+        break;
+      }
+    }
+
+    int32_t n = image_aio_submit(cache->aio) < 0 ? -1 :
+        image_aio_reap(cache->aio, done, BLOCK_CACHE_FLUSH_DEPTH, 1);
+    if (n < 0) {
+      sifs_warn("Пакетная запись кэша блоков недоступна, запись по одному\n");
+      image_aio_destroy(cache->aio);
+      cache->aio = NULL;
+      return;
+    }
+    for (int32_t k = 0; k < n; k++) {
+      struct cache_buffer* buf = &cache->buffers[done[k].user_data];
+      if (done[k].result == (ssize_t)cache->block_size) {
+        buf->dirty = false;
+        cache->stats.writebacks++;
+      } else {
+        sifs_error("Не удалось записать блок %lu\n",
+                   (unsigned long)buf->block);
+        *result = -1;
+      }
+    }
+  }
+}
+
+int32_t block_cache_sync(struct block_cache* cache) {
+  int32_t result = 0;
+  pthread_mutex_lock(&cache->lock);
+
+  if (cache->aio) sync_batched(cache, &result);
+  // Без движка (или после его отказа) буферы пишутся по одному
+  if (!cache->aio) {
+    for (uint32_t i = 0; i < cache->capacity; i++) {
+      struct cache_buffer* buf = &cache->buffers[i];
+      if (buf->valid && buf->dirty && write_back(cache, buf) < 0) {
+        result = -1;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+  return result;
+}
+
+// Сбрасывает буфер освобожденного блока
+static void drop(struct block_cache* cache, int32_t i) {
+  struct cache_buffer* buf = &cache->buffers[i];
+  buf->dirty = false;
+  if (buf->pins) return;
+  hash_remove(cache, i);
+  buf->valid = false;
+}
+
+// Сбрасывает буферы отрезка. Возвращает false, если пришлось ждать
+// буфер с незавершенным вводом-выводом: его отложенная запись могла бы
+// лечь поверх блока, уже отданного другому файлу
+static bool drop_range(struct block_cache* cache, uint64_t start,
+                       uint64_t len) {
+  // Длинный отрезок (обычно данные файла) дешевле сверить со всеми
+  // буферами, чем искать каждый его блок
+  if (len > cache->capacity) {
+    for (uint32_t i = 0; i < cache->capacity; i++) {
+      struct cache_buffer* buf = &cache->buffers[i];
+      if (!buf->valid || buf->block < start || buf->block - start >= len) {
+        continue;
+      }
+      if (buf->io) {
+        pthread_cond_wait(&cache->io_done, &cache->lock);
+        return false;
+      }
+      drop(cache, i);
+    }
+  } else {
+    for (uint64_t block = start; block < start + len; block++) {
+      int32_t i = lookup(cache, block);
+      if (i < 0) continue;
+      if (cache->buffers[i].io) {
+        pthread_cond_wait(&cache->io_done, &cache->lock);
+        return false;
+      }
+      drop(cache, i);
+    }
+  }
+  return true;
+}
+
+void block_cache_invalidate(struct block_cache* cache, uint64_t start,
+                            uint64_t len) {
+  pthread_mutex_lock(&cache->lock);
+  // После ожидания отрезок просматривается заново
+  while (!drop_range(cache, start, len)) continue;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void block_cache_get_stats(struct block_cache* cache,
+                           struct block_cache_stats* stats) {
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+}
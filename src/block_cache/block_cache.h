@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "../image/image.h"
+#include "../image/image_aio.h"
+
+// Глубина очереди для пакетной записи грязных буферов
+#define BLOCK_CACHE_FLUSH_DEPTH 64
+
+// Число буферов кэша по умолчанию
+#define BLOCK_CACHE_DEFAULT_CAPACITY 1024
+
+// Буфер кэша с содержимым одного блока образа
+struct cache_buffer {
+  uint64_t block;         // Номер блока образа
+  uint8_t* data;          // Содержимое блока (block_size байт)
+  uint32_t pins;          // Число активных пользователей (не вытесняется)
+  bool valid;             // Буфер содержит блок
+  bool dirty;             // Изменен и не записан в образ
+  bool referenced;        // Бит обращения для алгоритма CLOCK
+  bool io;                // Идет чтение или запись вне блокировки кэша
+  int32_t hash_next;      // Следующий буфер в цепочке хэш-таблицы
+};
+
+// Счетчики кэша
+struct block_cache_stats {
+  uint64_t hits;          // Блок найден в кэше
+  uint64_t misses;        // Блок прочитан из образа
+  uint64_t evictions;     // Буферы, вытесненные CLOCK
+  uint64_t writebacks;    // Грязные буферы, записанные в образ
+};
+
+// Кэш блоков фиксированного размера с вытеснением CLOCK и отложенной
+// записью. Через него идут блоки метаданных: каталоги, блоки указателей,
+// узлы дерева экстентов и таблица inode; данные файлов пишутся в образ
+// напрямую. Все операции защищены одной блокировкой; содержимое
+// закрепленного буфера читается и меняется вне ее. Чтение блока при
+// промахе и запись вытесняемого грязного буфера тоже идут вне блокировки:
+// буфер на это время помечен io, и ждут его только обращения к тому же
+// блоку.
+struct block_cache {
+  struct image* img;
+  struct image_aio* aio;          // Пакетная запись при синхронизации
+  uint32_t block_size;
+  uint32_t capacity;              // Число буферов
+  uint32_t hash_mask;
+  int32_t* hash;                  // Головы цепочек по номеру блока
+  struct cache_buffer* buffers;
+  uint8_t* memory;                // Содержимое всех буферов
+  uint32_t clock_hand;
+  struct block_cache_stats stats;
+  pthread_mutex_t lock;
+  pthread_cond_t io_done;         // Снята пометка io одного из буферов
+};
+
+// Создает кэш на capacity блоков (0 - BLOCK_CACHE_DEFAULT_CAPACITY).
+// Возвращает NULL при ошибке
+extern struct block_cache* block_cache_create(struct image* img,
+                                              uint32_t block_size,
+                                              uint32_t capacity);
+
+// Записывает грязные буферы и освобождает кэш
+extern int32_t block_cache_destroy(struct block_cache* cache);
+
+// Возвращает закрепленный буфер блока. Если read == false, блок будет
+// полностью перезаписан вызывающим и не читается из образа при промахе.
+// Возвращает NULL, если все буферы закреплены (EBUSY), не удалось чтение
+// блока или запись вытесняемого буфера
+extern struct cache_buffer* block_cache_get(struct block_cache* cache,
+                                            uint64_t block,
+                                            bool read);
+
+// Снимает закрепление буфера
+extern void block_cache_release(struct block_cache* cache,
+                                struct cache_buffer* buf);
+
+// Помечает буфер измененным (запись в образ - при вытеснении или sync)
+extern void block_cache_mark_dirty(struct block_cache* cache,
+                                   struct cache_buffer* buf);
+
+// Копирует size байт блока block начиная с offset в buffer.
+// Возвращает 0 или -1 при ошибке
+extern int32_t block_cache_read(struct block_cache* cache, uint64_t block,
+                                uint32_t offset, void* buffer, uint32_t size);
+
+// Копирует size байт из buffer в блок block начиная с offset и помечает
+// буфер измененным. Блок, перезаписываемый целиком, из образа не читается.
+// Возвращает 0 или -1 при ошибке
+extern int32_t block_cache_write(struct block_cache* cache, uint64_t block,
+                                 uint32_t offset, const void* buffer,
+                                 uint32_t size);
+
+// Записывает все грязные буферы в образ одним пакетом. Если асинхронный
+// движок отказал, он закрывается (дождавшись отправленных запросов), а
+// оставшиеся буферы записываются по одному
+extern int32_t block_cache_sync(struct block_cache* cache);
+
+// Забывает изменения блоков [start, start + len), не записывая их, и
+// удаляет незакрепленные буферы. Вызывается при освобождении блоков:
+// иначе отложенная запись затерла бы данные, записанные в них позже
+extern void block_cache_invalidate(struct block_cache* cache, uint64_t start,
+                                   uint64_t len);
+
+// Копирует текущие счетчики кэша
+extern void block_cache_get_stats(struct block_cache* cache,
+                                  struct block_cache_stats* stats);
@@ -0,0 +1,576 @@
+#include "block_group.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../bitops/bitops.h"
+#include "../debug/debug.h"
+
+// Срез битовой карты группы: блок образа, смещение в карте в памяти и
+// размер. Без групп срез - вся карта
+struct bitmap_slice {
+  uint64_t disk_block;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// Строит сводки по картам группы. Карты групп начинаются с границы
+// слова, поэтому сводка строится прямо над частью общей карты или над
+// блоком карты в отображении (бит 0 - первый блок или inode группы)
+static int32_t build_indexes(struct block_group* grp) {
+  const struct group_layout* layout = &grp->layout;
+  if (bitmap_index_build(&grp->block_index, grp->blocks,
+                         layout->end_block - layout->first_block) < 0) {
+    return -1;
+  }
+  if (layout->count_inodes &&
+      bitmap_index_build(&grp->inode_index, grp->inodes,
+                         layout->count_inodes) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// Освобождает память групп
+static void destroy_groups(struct block_groups* groups) {
+  for (uint32_t g = 0; g < groups->count; g++) {
+    bitmap_index_destroy(&groups->groups[g].block_index);
+    bitmap_index_destroy(&groups->groups[g].inode_index);
+    pthread_mutex_destroy(&groups->groups[g].lock);
+  }
+  image_aio_destroy(groups->aio);
+  free(groups->staging);
+  free(groups->writes);
+  free(groups->groups);
+  free(groups);
+}
+
+static void block_bitmap_slice(const struct block_groups* groups,
+                               const struct block_group* grp,
+                               struct bitmap_slice* slice) {
+  const struct superblock* sb = groups->sb;
+  slice->disk_block = grp->layout.block_bitmap;
+  if (!(sb->features & FS_FEATURE_GROUPS)) {
+    slice->offset = 0;
+    slice->size = sb->count_block_bitmap_blocks * sb->block_size;
+    return;
+  }
+  slice->offset = grp->layout.first_block / 8;
+  slice->size = (grp->layout.end_block - grp->layout.first_block + 7) / 8;
+}
+
+static void inode_bitmap_slice(const struct block_groups* groups,
+                               const struct block_group* grp,
+                               struct bitmap_slice* slice) {
+  const struct superblock* sb = groups->sb;
+  slice->disk_block = grp->layout.inode_bitmap;
+  if (!(sb->features & FS_FEATURE_GROUPS)) {
+    slice->offset = 0;
+    slice->size = sb->count_inode_bitmap_blocks * sb->block_size;
+    return;
+  }
+  slice->offset = grp->layout.first_inode / 8;
+  slice->size = grp->layout.count_inodes / 8;
+}
+
+// Карта среза: часть общей карты в памяти или срез в отображении образа
+static uint8_t* slice_map(struct block_groups* groups, uint8_t* bitmap,
+                          const struct bitmap_slice* slice) {
+  if (!groups->mapped) return bitmap + slice->offset;
+  return image_data(groups->img,
+                    (off_t)slice->disk_block * groups->sb->block_size,
+                    slice->size);
+}
+
+static int32_t read_slice(struct block_groups* groups, uint8_t* bitmap,
+                          const struct bitmap_slice* slice) {
+  off_t offset = (off_t)slice->disk_block * groups->sb->block_size;
+  ssize_t n = image_read(groups->img, bitmap + slice->offset, slice->size,
+                         offset);
+  if (n < 0) return -1;
+  if ((uint64_t)n != slice->size) {
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+// Размеры карт в памяти (и в staging, после таблицы дескрипторов)
+static uint64_t block_bitmap_bytes(const struct superblock* sb) {
+  return sb->count_block_bitmap_blocks * sb->block_size;
+}
+
+static uint64_t inode_bitmap_bytes(const struct superblock* sb) {
+  return sb->count_inode_bitmap_blocks * sb->block_size;
+}
+
+// Копирует срез карты в staging (по тому же смещению) и добавляет его в
+// список записи
+static void stage_slice(struct block_groups* groups, uint32_t* count,
+                        uint8_t* staging, const uint8_t* bitmap,
+                        const struct bitmap_slice* slice, uint32_t g) {
+  memcpy(staging + slice->offset, bitmap + slice->offset, slice->size);
+  groups->writes[(*count)++] = (struct group_write){
+      staging + slice->offset, slice->size,
+      (off_t)slice->disk_block * groups->sb->block_size, g, false };
+}
+
+// Читает таблицу дескрипторов и сверяет расположение групп с суперблоком
+static int32_t read_descriptors(struct block_groups* groups) {
+  const struct superblock* sb = groups->sb;
+  size_t size = (size_t)groups->count * sizeof(struct group_desc);
+  struct group_desc* descs = malloc(size);
+  if (!descs) return -1;
+
+  off_t offset = (off_t)sb->first_group_desc_block * sb->block_size;
+  ssize_t n = image_read(groups->img, descs, size, offset);
+  int32_t result = 0;
+  if (n != (ssize_t)size) {
+    if (n >= 0) errno = EIO;
+    result = -1;
+  }
+
+  for (uint32_t g = 0; g < groups->count && result == 0; g++) {
+    struct block_group* grp = &groups->groups[g];
+    if (descs[g].block_bitmap != grp->layout.block_bitmap ||
+        descs[g].inode_bitmap != grp->layout.inode_bitmap ||
+        descs[g].inode_table != grp->layout.inode_table) {
+      sifs_error("Дескриптор группы %u не совпадает с разметкой\n", g);
+      errno = EIO;
+      result = -1;
+      break;
+    }
+    grp->free_blocks = descs[g].free_blocks;
+    grp->free_inodes = descs[g].free_inodes;
+  }
+
+  free(descs);
+  return result;
+}
+
+// Добавляет в список записи срез карты в отображении: его страницы
+// сбрасываются на диск без копирования (data == NULL)
+static void map_slice(struct block_groups* groups, uint32_t* count,
+                      const struct bitmap_slice* slice, uint32_t g) {
+  groups->writes[(*count)++] = (struct group_write){
+      NULL, slice->size, (off_t)slice->disk_block * groups->sb->block_size,
+      g, false };
+}
+
+// Заполняет таблицу дескрипторов в начале staging и добавляет ее в
+// список записи
+static void stage_descriptors(struct block_groups* groups, uint32_t* count) {
+  const struct superblock* sb = groups->sb;
+  struct group_desc* descs = (struct group_desc*)groups->staging;
+  memset(descs, 0, groups->count * sizeof(*descs));
+
+  for (uint32_t g = 0; g < groups->count; g++) {
+    struct block_group* grp = &groups->groups[g];
+    pthread_mutex_lock(&grp->lock);
+    descs[g].block_bitmap = grp->layout.block_bitmap;
+    descs[g].inode_bitmap = grp->layout.inode_bitmap;
+    descs[g].inode_table = grp->layout.inode_table;
+    descs[g].free_blocks = grp->free_blocks;
+    descs[g].free_inodes = grp->free_inodes;
+    pthread_mutex_unlock(&grp->lock);
+  }
+
+  groups->writes[(*count)++] = (struct group_write){
+      (const uint8_t*)descs, groups->count * sizeof(*descs),
+      (off_t)sb->first_group_desc_block * sb->block_size, UINT32_MAX,
+      false };
+}
+
+// Записывает фрагменты пакетами через асинхронный движок. Если движок
+// отказал, он закрывается; незаписанные фрагменты пишутся по одному
+static void write_batch(struct block_groups* groups, uint32_t count) {
+  struct group_write* writes = groups->writes;
+  struct image_aio_completion done[BLOCK_GROUPS_SYNC_DEPTH];
+  uint32_t next = 0;
+
+  while (groups->aio && (next < count || image_aio_inflight(groups->aio))) {
+    for (; next < count; next++) {
+      if (image_aio_prep_write(groups->aio, writes[next].data,
+                               writes[next].size, writes[next].offset,
+                               next) < 0) {
+        break;
+      }
+    }
+
+    int32_t n = image_aio_submit(groups->aio) < 0 ? -1 :
+        image_aio_reap(groups->aio, done, BLOCK_GROUPS_SYNC_DEPTH, 1);
+    if (n < 0) {
+      sifs_warn("Пакетная запись карт недоступна, запись по одной\n");
+      image_aio_destroy(groups->aio);
+      groups->aio = NULL;
+      break;
+    }
+    for (int32_t k = 0; k < n; k++) {
+      struct group_write* w = &writes[done[k].user_data];
+      w->written = done[k].result == (ssize_t)w->size;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (!writes[i].written) {
+      writes[i].written = image_write(groups->img, writes[i].data,
+                                      writes[i].size, writes[i].offset) >= 0;
+    }
+  }
+}
+
+// Копирует фрагменты в отображение (срезы карт уже в нем) и сбрасывает
+// их страницы на диск
+static void flush_mapped(struct block_groups* groups, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    struct group_write* w = &groups->writes[i];
+    w->written = (!w->data ||
+                  image_write(groups->img, w->data, w->size, w->offset) >= 0) &&
+                 image_flush(groups->img, w->offset, w->size) == 0;
+  }
+}
+
+struct block_groups* block_groups_open(struct image* img,
+                                       struct superblock* sb,
+                                       uint8_t* block_bitmap,
+                                       uint8_t* inode_bitmap) {
+  struct block_groups* groups = calloc(1, sizeof(*groups));
+  if (!groups) return NULL;
+
+  groups->img = img;
+  groups->sb = sb;
+  groups->block_bitmap = block_bitmap;
+  groups->inode_bitmap = inode_bitmap;
+  groups->mapped = image_data(img, 0, sizeof(*sb)) != NULL;
+  groups->count = sb->features & FS_FEATURE_GROUPS ? sb->count_groups : 1;
+  groups->groups = aligned_alloc(_Alignof(struct block_group),
+                                 groups->count * sizeof(struct block_group));
+  // Копии дескрипторов и карт (в отображении карты не копируются) и
+  // список записи: по два среза на группу и таблица дескрипторов
+  uint64_t staging_size = groups->count * sizeof(struct group_desc);
+  if (!groups->mapped) {
+    staging_size += block_bitmap_bytes(sb) + inode_bitmap_bytes(sb);
+  }
+  groups->staging = malloc(staging_size);
+  groups->writes = calloc(2 * groups->count + 1, sizeof(struct group_write));
+  if (!groups->groups || !groups->staging || !groups->writes) {
+    free(groups->groups);
+    free(groups->staging);
+    free(groups->writes);
+    free(groups);
+    return NULL;
+  }
+
+  int32_t result = 0;
+  for (uint32_t g = 0; g < groups->count; g++) {
+    struct block_group* grp = &groups->groups[g];
+    memset(grp, 0, sizeof(*grp));
+    superblock_group_layout(sb, g, &grp->layout);
+    grp->cursor = grp->layout.first_data_block;
+    pthread_mutex_init(&grp->lock, NULL);
+
+    struct bitmap_slice slice;
+    block_bitmap_slice(groups, grp, &slice);
+    grp->blocks = slice_map(groups, block_bitmap, &slice);
+    if (!groups->mapped && result == 0 &&
+        read_slice(groups, block_bitmap, &slice) < 0) {
+      result = -1;
+    }
+    inode_bitmap_slice(groups, grp, &slice);
+    grp->inodes = slice_map(groups, inode_bitmap, &slice);
+    if (!groups->mapped && result == 0 &&
+        read_slice(groups, inode_bitmap, &slice) < 0) {
+      result = -1;
+    }
+    if (!grp->blocks || !grp->inodes) {
+      errno = EIO;
+      result = -1;
+    }
+    if (result == 0 && build_indexes(grp) < 0) result = -1;
+  }
+
+  // Без групп счетчики хранит суперблок
+  if (!(sb->features & FS_FEATURE_GROUPS)) {
+    groups->groups[0].free_blocks = sb->count_free_blocks;
+    groups->groups[0].free_inodes = sb->count_free_inodes;
+  } else if (result == 0) {
+    result = read_descriptors(groups);
+  }
+
+  if (result < 0) {
+    sifs_error("Не удалось прочитать группы блоков\n");
+    destroy_groups(groups);
+    return NULL;
+  }
+
+  // Без асинхронного движка карты пишутся по одной. Отображению он не
+  // нужен: карты уже в нем
+  if (!groups->mapped) {
+    groups->aio = image_aio_create(img, BLOCK_GROUPS_SYNC_DEPTH, 0);
+  }
+
+  sifs_debug("Групп блоков: %u\n", groups->count);
+  return groups;
+}
+
+int32_t block_groups_sync(struct block_groups* groups) {
+  uint8_t* block_staging = groups->staging +
+                           groups->count * sizeof(struct group_desc);
+  uint8_t* inode_staging = block_staging + block_bitmap_bytes(groups->sb);
+  uint32_t count = 0;
+
+  // Под блокировкой группы карты только копируются; выделение в группе
+  // продолжается, пока копия пишется
+  for (uint32_t g = 0; g < groups->count; g++) {
+    struct block_group* grp = &groups->groups[g];
+    pthread_mutex_lock(&grp->lock);
+    if (grp->dirty) {
+      struct bitmap_slice blocks, inodes;
+      block_bitmap_slice(groups, grp, &blocks);
+      inode_bitmap_slice(groups, grp, &inodes);
+      if (groups->mapped) {
+        map_slice(groups, &count, &blocks, g);
+        map_slice(groups, &count, &inodes, g);
+      } else {
+        stage_slice(groups, &count, block_staging, groups->block_bitmap,
+                    &blocks, g);
+        stage_slice(groups, &count, inode_staging, groups->inode_bitmap,
+                    &inodes, g);
+      }
+      grp->dirty = false;
+    }
+    pthread_mutex_unlock(&grp->lock);
+  }
+  if (groups->sb->features & FS_FEATURE_GROUPS) {
+    stage_descriptors(groups, &count);
+  }
+
+  if (groups->mapped) {
+    flush_mapped(groups, count);
+  } else {
+    write_batch(groups, count);
+  }
+
+  // Группа, срез которой не записан, запишется при следующем sync
+  int32_t result = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (groups->writes[i].written) continue;
+    result = -1;
+    uint32_t g = groups->writes[i].group;
+    if (g == UINT32_MAX) continue;
+    pthread_mutex_lock(&groups->groups[g].lock);
+    groups->groups[g].dirty = true;
+    pthread_mutex_unlock(&groups->groups[g].lock);
+  }
+  return result;
+}
+
+int32_t block_groups_close(struct block_groups* groups) {
+  if (!groups) return 0;
+
+  int32_t result = block_groups_sync(groups);
+  destroy_groups(groups);
+  return result;
+}
+
+// Выделяет в группе до want подряд идущих блоков. Одиночный блок - первый
+// свободный от курсора до конца группы (затем от начала ее данных до
+// курсора), отрезок ищется по политике groups->policy. Возвращает первый
+// блок (длина - в len) или -1
+static int64_t alloc_in_group(struct block_groups* groups,
+                              struct block_group* grp, uint32_t want,
+                              uint32_t* len) {
+  int64_t block = -1;
+  pthread_mutex_lock(&grp->lock);
+
+  if (grp->free_blocks) {
+    // Поиск идет по сводке в номерах относительно начала группы
+    uint8_t* bitmap = grp->blocks;
+    uint64_t base = grp->layout.first_block;
+    uint64_t start = grp->layout.first_data_block - base;
+    uint64_t end = grp->layout.end_block - base;
+    uint64_t cursor = grp->cursor - base;
+    if (grp->cursor < base || cursor < start || cursor >= end) cursor = start;
+
+    uint64_t first = 0;
+    *len = 0;
+    if (want == 1) {
+      int64_t bit = bitmap_index_find_zero(&grp->block_index, bitmap, cursor);
+      if (bit < 0) {
+        bit = bitmap_index_find_zero(&grp->block_index, bitmap, start);
+      }
+      if (bit >= 0) {
+        first = bit;
+        *len = 1;
+      }
+    } else {
+      *len = find_free_extent(bitmap, &grp->block_index, start, end, cursor,
+                              want, groups->policy, &first);
+    }
+
+    if (*len) {
+      bitmap_index_set_range(&grp->block_index, bitmap, first, *len);
+      block = base + first;
+      grp->free_blocks -= *len;
+      grp->cursor = block + *len;
+      grp->dirty = true;
+    }
+  }
+
+  pthread_mutex_unlock(&grp->lock);
+  return block;
+}
+
+int64_t block_groups_alloc_run(struct block_groups* groups, uint32_t goal,
+                               uint32_t want, uint32_t* len) {
+  if (goal >= groups->count) goal = 0;
+  if (want == 0) want = 1;
+
+  for (uint32_t i = 0; i < groups->count; i++) {
+    uint32_t g = (goal + i) % groups->count;
+    int64_t block = alloc_in_group(groups, &groups->groups[g], want, len);
+    if (block >= 0) {
+      __atomic_fetch_sub(&groups->sb->count_free_blocks, *len,
+                         __ATOMIC_RELAXED);
+      sifs_debug("Выделено %u блоков с %" PRId64 " в группе %u (цель %u)\n",
+                 *len, block, g, goal);
+      return block;
+    }
+  }
+
+  sifs_debug("Свободные блоки отсутствуют!\n");
+  errno = ENOSPC;
+  return -1;
+}
+
+int64_t block_groups_alloc_block(struct block_groups* groups, uint32_t goal) {
+  uint32_t len;
+  return block_groups_alloc_run(groups, goal, 1, &len);
+}
+
+void block_groups_free_run(struct block_groups* groups, uint64_t start,
+                           uint64_t len) {
+  const struct superblock* sb = groups->sb;
+  uint64_t end = start + len;
+
+  while (start < end) {
+    uint32_t g = superblock_block_group(sb, start);
+    if (g >= groups->count) {
+      sifs_debug("Недопустимый блок для освобождения: %" PRIu64 "\n", start);
+      return;
+    }
+
+    struct block_group* grp = &groups->groups[g];
+    uint64_t chunk_end = end < grp->layout.end_block ? end
+                                                      : grp->layout.end_block;
+    if (start < grp->layout.first_data_block) {
+      sifs_debug("Недопустимый блок для освобождения: %" PRIu64 "\n", start);
+      return;
+    }
+
+    // Счетчики уменьшаются только на реально занятые блоки, чтобы
+    // повторное освобождение их не завышало
+    uint64_t count = chunk_end - start;
+    pthread_mutex_lock(&grp->lock);
+    uint64_t bit = start - grp->layout.first_block;
+    uint64_t freed = bitmap_count_ones(grp->blocks, bit, count);
+    if (freed) {
+      bitmap_index_clear_range(&grp->block_index, grp->blocks, bit, count);
+      grp->free_blocks += freed;
+      grp->dirty = true;
+    }
+    pthread_mutex_unlock(&grp->lock);
+
+    __atomic_fetch_add(&groups->sb->count_free_blocks, freed,
+                       __ATOMIC_RELAXED);
+    if (freed != count) {
+      sifs_warn("Повторное освобождение блоков %" PRIu64 "-%" PRIu64 "\n",
+                start, chunk_end - 1);
+    }
+    start = chunk_end;
+  }
+}
+
+void block_groups_free_block(struct block_groups* groups, uint64_t block) {
+  block_groups_free_run(groups, block, 1);
+}
+
+// Выделяет inode в группе. Возвращает номер inode или -1
+static int64_t alloc_inode_in_group(struct block_group* grp) {
+  int64_t ino = -1;
+  pthread_mutex_lock(&grp->lock);
+
+  if (grp->free_inodes) {
+    uint8_t* bitmap = grp->inodes;
+    int64_t bit = bitmap_index_find_zero(&grp->inode_index, bitmap, 0);
+    if (bit >= 0) {
+      bitmap_index_set(&grp->inode_index, bitmap, bit);
+      ino = grp->layout.first_inode + bit;
+      grp->free_inodes--;
+      grp->dirty = true;
+    }
+  }
+
+  pthread_mutex_unlock(&grp->lock);
+  return ino;
+}
+
+int64_t block_groups_alloc_inode(struct block_groups* groups, uint32_t parent,
+                                 bool directory) {
+  uint32_t goal = superblock_inode_group(groups->sb, parent);
+  if (goal >= groups->count) goal = 0;
+
+  // Новый каталог уходит в наименее занятую группу, а его файлы затем
+  // следуют за ним
+  if (directory) {
+    uint32_t best_free = 0;
+    for (uint32_t g = 0; g < groups->count; g++) {
+      uint32_t free_inodes = __atomic_load_n(&groups->groups[g].free_inodes,
+                                             __ATOMIC_RELAXED);
+      if (free_inodes > best_free) {
+        best_free = free_inodes;
+        goal = g;
+      }
+    }
+  }
+
+  for (uint32_t i = 0; i < groups->count; i++) {
+    uint32_t g = (goal + i) % groups->count;
+    int64_t ino = alloc_inode_in_group(&groups->groups[g]);
+    if (ino >= 0) {
+      __atomic_fetch_sub(&groups->sb->count_free_inodes, 1, __ATOMIC_RELAXED);
+      sifs_debug("Выделен inode %" PRId64 " в группе %u\n", ino, g);
+      return ino;
+    }
+  }
+
+  sifs_debug("Свободные inode отсутствуют!\n");
+  errno = ENOSPC;
+  return -1;
+}
+
+void block_groups_free_inode(struct block_groups* groups, uint32_t inode_idx) {
+  const struct superblock* sb = groups->sb;
+  if (inode_idx <= sb->root_inode || inode_idx >= sb->count_inodes) {
+    sifs_debug("Недопустимый inode для освобождения: %u\n", inode_idx);
+    return;
+  }
+
+  struct block_group* grp =
+      &groups->groups[superblock_inode_group(sb, inode_idx)];
+  uint64_t bit = inode_idx - grp->layout.first_inode;
+  pthread_mutex_lock(&grp->lock);
+  bool allocated = bitmap_find_one(grp->inodes, bit, bit + 1) >= 0;
+  if (allocated) {
+    bitmap_index_clear(&grp->inode_index, grp->inodes, bit);
+    grp->free_inodes++;
+    grp->dirty = true;
+  }
+  pthread_mutex_unlock(&grp->lock);
+
+  if (allocated) {
+    __atomic_fetch_add(&groups->sb->count_free_inodes, 1, __ATOMIC_RELAXED);
+  } else {
+    sifs_warn("Повторное освобождение inode %u\n", inode_idx);
+  }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../bitmap_index/bitmap_index.h"
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../image/image.h"
+#include "../image/image_aio.h"
+#include "../superblock/superblock.h"
+
+// Глубина очереди для пакетной записи карт групп
+#define BLOCK_GROUPS_SYNC_DEPTH 64
+
+// Группа блоков в памяти. У каждой группы своя блокировка, поэтому потоки,
+// выделяющие блоки и inode в разных группах, не мешают друг другу
+struct block_group {
+  struct group_layout layout;     // Расположение структур группы
+  uint64_t free_blocks;           // Свободных блоков в группе
+  uint32_t free_inodes;           // Свободных inode в группе
+  uint64_t cursor;                // Курсор поиска свободного блока
+  uint8_t* blocks;                // Карта блоков группы (бит 0 - first_block)
+  uint8_t* inodes;                // Карта inode группы (бит 0 - first_inode)
+  struct bitmap_index block_index;  // Сводка по карте блоков группы
+  struct bitmap_index inode_index;  // Сводка по карте inode группы
+  bool dirty;                     // Битовые карты группы изменены
+  pthread_mutex_t lock;
+} __attribute__((aligned(64)));   // Блокировки разных групп - в разных строках кэша
+
+// Фрагмент метаданных, записываемый при синхронизации
+struct group_write {
+  const uint8_t* data;            // Копия фрагмента
+  uint64_t size;
+  off_t offset;                   // Смещение в образе
+  uint32_t group;                 // Группа (UINT32_MAX - дескрипторы)
+  bool written;
+};
+
+// Группы блоков смонтированной ФС поверх сплошных битовых карт в памяти.
+// Размер группы и число inode в ней кратны 64, поэтому группы не делят
+// слов карт. Без FS_FEATURE_GROUPS вся ФС - одна группа. Для образа,
+// открытого с IMAGE_MMAP, карты не копируются: группы меняют их прямо в
+// отображении, а сплошные карты в памяти не используются.
+struct block_groups {
+  struct image* img;
+  struct superblock* sb;
+  uint8_t* block_bitmap;          // Битовая карта блоков (глобальные номера)
+  uint8_t* inode_bitmap;          // Битовая карта inode (глобальные номера)
+  uint32_t count;                 // Число групп
+  struct block_group* groups;
+  bool mapped;                    // Карты - в отображении образа
+  struct image_aio* aio;          // Пакетная запись при синхронизации
+  uint8_t* staging;               // Копии карт и дескрипторов для записи
+  struct group_write* writes;     // Фрагменты одной синхронизации
+  enum extent_policy policy;      // Поиск отрезков (EXTENT_FIRST_FIT)
+};
+
+// Читает битовые карты всех групп из образа в block_bitmap и inode_bitmap
+// (count_block_bitmap_blocks и count_inode_bitmap_blocks блоков) и
+// счетчики свободного места из дескрипторов, строит сводки по картам
+// групп. Для отображенного образа карты не читаются, а block_bitmap и
+// inode_bitmap могут быть NULL. Возвращает NULL при ошибке
+extern struct block_groups* block_groups_open(struct image* img,
+                                              struct superblock* sb,
+                                              uint8_t* block_bitmap,
+                                              uint8_t* inode_bitmap);
+
+// Записывает изменения и освобождает группы
+extern int32_t block_groups_close(struct block_groups* groups);
+
+// Записывает битовые карты измененных групп и таблицу дескрипторов.
+// Карты копируются под блокировками групп, а записываются после них
+// одним пакетом асинхронного ввода-вывода. В отображенном образе
+// страницы карт измененных групп и дескрипторов сбрасываются на диск
+// (image_flush). Вызовы не должны пересекаться. Суперблок записывает
+// вызывающий. Возвращает 0 или -1 при ошибке
+extern int32_t block_groups_sync(struct block_groups* groups);
+
+// Выделяет блок данных, начиная с группы goal (обычно группы inode
+// файла), затем в следующих группах по кругу. Возвращает номер блока
+// или -1 с ENOSPC
+extern int64_t block_groups_alloc_block(struct block_groups* groups,
+                                        uint32_t goal);
+
+// Выделяет до want подряд идущих блоков данных, начиная с группы goal:
+// в первой группе со свободными блоками ищет отрезок не короче want по
+// политике groups->policy, а если его нет - самый длинный свободный.
+// Возвращает первый блок (длина - в len) или -1 с ENOSPC
+extern int64_t block_groups_alloc_run(struct block_groups* groups,
+                                      uint32_t goal,
+                                      uint32_t want,
+                                      uint32_t* len);
+
+// Освобождает len блоков данных с start (отрезок может пересекать
+// границы групп) и возвращает их в счетчики групп и суперблока
+extern void block_groups_free_run(struct block_groups* groups,
+                                  uint64_t start,
+                                  uint64_t len);
+
+// Освобождает блок данных
+extern void block_groups_free_block(struct block_groups* groups,
+                                    uint64_t block);
+
+// Выделяет inode. Файл размещается в группе родительского каталога,
+// каталог - в группе с наибольшим числом свободных inode, чтобы каталоги
+// распределялись по ФС. Возвращает номер inode или -1 с ENOSPC
+extern int64_t block_groups_alloc_inode(struct block_groups* groups,
+                                        uint32_t parent,
+                                        bool directory);
+
+// Освобождает inode
+extern void block_groups_free_inode(struct block_groups* groups,
+                                    uint32_t inode_idx);
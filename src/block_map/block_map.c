@@ -0,0 +1,407 @@
+#include "block_map.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "extent_tree.h"
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../debug/debug.h"
+
+// Путь к логическому блоку через блоки указателей
+struct map_path {
+  uint32_t depth;                       // 0 - прямой блок, 1..3 - уровень косвенности
+  uint64_t direct;                      // Индекс в inode->direct (для depth == 0)
+  uint64_t offsets[INDIRECT_LEVELS];    // Индексы указателей на каждом уровне
+  uint64_t base;                        // Первый логический блок уровня
+  uint64_t rel;                         // Индекс блока внутри уровня
+};
+
+// log2 числа указателей в блоке (размер блока - степень двойки)
+static uint32_t ptr_shift(uint32_t block_size) {
+  return __builtin_ctz(block_size) - __builtin_ctz(sizeof(uint64_t));
+}
+
+uint64_t block_map_max_blocks(uint32_t block_size) {
+  uint32_t shift = ptr_shift(block_size);
+  uint64_t total = DIRECT_BLOCKS;
+  for (uint32_t depth = 1; depth <= INDIRECT_LEVELS; depth++) {
+    total += 1ULL << (shift * depth);
+  }
+  return total;
+}
+
+// Раскладывает логический индекс на уровень и индексы указателей.
+// Возвращает -1, если индекс за пределами адресации
+static int32_t map_path(uint32_t block_size, uint64_t logical,
+                        struct map_path* path) {
+  if (logical < DIRECT_BLOCKS) {
+    path->depth = 0;
+    path->direct = logical;
+    return 0;
+  }
+
+  uint32_t shift = ptr_shift(block_size);
+  uint64_t mask = (1ULL << shift) - 1;
+  path->base = DIRECT_BLOCKS;
+  logical -= DIRECT_BLOCKS;
+
+  for (uint32_t depth = 1; depth <= INDIRECT_LEVELS; depth++) {
+    uint64_t span = 1ULL << (shift * depth);
+    if (logical < span) {
+      path->depth = depth;
+      path->rel = logical;
+      for (uint32_t i = 0; i < depth; i++) {
+        path->offsets[i] = (logical >> (shift * (depth - 1 - i))) & mask;
+      }
+      return 0;
+    }
+    logical -= span;
+    path->base += span;
+  }
+
+  return -1;
+}
+
+// Читает указатель из блока указателей
+static int32_t read_ptr(struct block_cache* bcache, uint64_t block,
+                        uint64_t index, uint64_t* value) {
+  return block_cache_read(bcache, block, index * sizeof(*value), value,
+                          sizeof(*value));
+}
+
+static int32_t write_ptr(struct block_cache* bcache, uint64_t block,
+                         uint64_t index, uint64_t value) {
+  return block_cache_write(bcache, block, index * sizeof(value), &value,
+                           sizeof(value));
+}
+
+// Расширяет отрезок вокруг ptrs[at], пока физические блоки идут подряд
+// (либо все указатели нулевые). Возвращает индекс начала, длину - в len
+static uint64_t widen(const uint64_t* ptrs, uint64_t count, uint64_t at,
+                      uint64_t* len) {
+  uint64_t step = ptrs[at] ? 1 : 0;
+  uint64_t first = at;
+  uint64_t last = at;
+
+  while (first > 0 && (step == 0 || ptrs[first - 1] != 0) &&
+         ptrs[first - 1] == ptrs[at] - (at - first + 1) * step) {
+    first--;
+  }
+  while (last + 1 < count &&
+         ptrs[last + 1] == ptrs[at] + (last + 1 - at) * step) {
+    last++;
+  }
+
+  *len = last - first + 1;
+  return first;
+}
+
+// Читает блок указателей целиком и находит отрезок вокруг указателя at
+static int32_t read_run(struct block_cache* bcache, const struct superblock* sb,
+                        uint64_t block, uint64_t at, uint64_t logical,
+                        struct map_run* run) {
+  // Блок указателей разбирается прямо в буфере кэша, без копии
+  struct cache_buffer* buf = block_cache_get(bcache, block, true);
+  if (!buf) return -1;
+
+  const uint64_t* ptrs = (const uint64_t*)buf->data;
+  uint64_t count = sb->block_size / sizeof(uint64_t);
+  uint64_t first = widen(ptrs, count, at, &run->len);
+  run->logical = logical - (at - first);
+  run->physical = ptrs[first];
+  block_cache_release(bcache, buf);
+  return 0;
+}
+
+int32_t block_map_resolve(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          const struct inode* node,
+                          uint64_t logical,
+                          uint64_t* physical) {
+  if (node->flags & INODE_INLINE) {
+    errno = EINVAL;  // Данные в самом inode, блоков нет
+    return -1;
+  }
+  if (node->flags & INODE_EXTENTS) {
+    return extent_tree_lookup(bcache, sb, node, logical, physical, NULL);
+  }
+
+  struct map_path path;
+  if (map_path(sb->block_size, logical, &path) < 0) {
+    sifs_debug("Логический блок %" PRIu64 " за пределами адресации\n",
+               logical);
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (path.depth == 0) {
+    *physical = node->direct[path.direct];
+    return 0;
+  }
+
+  uint64_t block = node->indirect[path.depth - 1];
+  for (uint32_t i = 0; i < path.depth && block; i++) {
+    if (read_ptr(bcache, block, path.offsets[i], &block) < 0) return -1;
+    if (block >= sb->count_blocks) {
+      sifs_error("Поврежденный указатель %" PRIu64 " для логического блока %"
+                 PRIu64 "\n", block, logical);
+      errno = EIO;
+      return -1;
+    }
+  }
+
+  *physical = block;
+  return 0;
+}
+
+int32_t block_map_resolve_run(struct block_cache* bcache,
+                              const struct superblock* sb,
+                              const struct inode* node,
+                              uint64_t logical,
+                              struct map_run* run) {
+  if (node->flags & INODE_INLINE) {
+    errno = EINVAL;  // Данные в самом inode, блоков нет
+    return -1;
+  }
+  if (node->flags & INODE_EXTENTS) {
+    uint64_t physical;
+    return extent_tree_lookup(bcache, sb, node, logical, &physical, run);
+  }
+
+  struct map_path path;
+  if (map_path(sb->block_size, logical, &path) < 0) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (path.depth == 0) {
+    uint64_t first = widen(node->direct, DIRECT_BLOCKS, path.direct,
+                           &run->len);
+    run->logical = first;
+    run->physical = node->direct[first];
+    return 0;
+  }
+
+  // Нулевой указатель на уровне i - дыра во все поддерево под ним
+  uint32_t shift = ptr_shift(sb->block_size);
+  uint64_t block = node->indirect[path.depth - 1];
+  for (uint32_t i = 0; i < path.depth; i++) {
+    if (block == 0) {
+      uint64_t span = 1ULL << (shift * (path.depth - i));
+      run->logical = path.base + (path.rel & ~(span - 1));
+      run->physical = 0;
+      run->len = span;
+      return 0;
+    }
+
+    if (i + 1 == path.depth) {
+      if (read_run(bcache, sb, block, path.offsets[i], logical, run) < 0) {
+        return -1;
+      }
+      block = run->physical;
+    } else if (read_ptr(bcache, block, path.offsets[i], &block) < 0) {
+      return -1;
+    }
+
+    if (block >= sb->count_blocks) {
+      sifs_error("Поврежденный указатель %" PRIu64 " для логического блока %"
+                 PRIu64 "\n", block, logical);
+      errno = EIO;
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Выделяет обнуленный блок указателей. Возвращает номер блока или 0
+static uint64_t alloc_ptr_block(struct block_cache* bcache,
+                                const struct superblock* sb,
+                                struct block_allocator* alloc) {
+  int64_t block = block_alloc(alloc);
+  if (block < 0) {
+    errno = ENOSPC;
+    return 0;
+  }
+
+  // Новый блок из образа не читается: буфер кэша обнуляется целиком
+  struct cache_buffer* buf = block_cache_get(bcache, block, false);
+  if (!buf) {
+    block_free(alloc, block, 1);
+    return 0;
+  }
+
+  memset(buf->data, 0, sb->block_size);
+  block_cache_mark_dirty(bcache, buf);
+  block_cache_release(bcache, buf);
+  return block;
+}
+
+int32_t block_map_assign(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         struct block_allocator* alloc,
+                         struct inode* node,
+                         uint64_t logical,
+                         uint64_t physical) {
+  if (node->flags & INODE_INLINE) {
+    errno = EINVAL;  // Данные в самом inode, блоков нет
+    return -1;
+  }
+  if (node->flags & INODE_EXTENTS) {
+    // Дерево экстентов хранит только отображенные отрезки
+    if (physical == 0) {
+      errno = EINVAL;
+      return -1;
+    }
+    return extent_tree_insert(bcache, sb, alloc, node, logical, physical, 1);
+  }
+
+  struct map_path path;
+  if (map_path(sb->block_size, logical, &path) < 0) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (path.depth == 0) {
+    node->direct[path.direct] = physical;
+    return 0;
+  }
+
+  uint64_t* root = &node->indirect[path.depth - 1];
+  if (*root == 0) {
+    if (physical == 0) return 0;  // Дыра уже не отображена
+    *root = alloc_ptr_block(bcache, sb, alloc);
+    if (*root == 0) return -1;
+  }
+
+  // Спуск до блока указателей на данные с созданием промежуточных уровней
+  uint64_t block = *root;
+  for (uint32_t i = 0; i + 1 < path.depth; i++) {
+    uint64_t next;
+    if (read_ptr(bcache, block, path.offsets[i], &next) < 0) return -1;
+    if (next == 0) {
+      if (physical == 0) return 0;
+      next = alloc_ptr_block(bcache, sb, alloc);
+      if (next == 0) return -1;
+      if (write_ptr(bcache, block, path.offsets[i], next) < 0) return -1;
+    }
+    block = next;
+  }
+
+  return write_ptr(bcache, block, path.offsets[path.depth - 1], physical);
+}
+
+int32_t block_map_assign_run(struct block_cache* bcache,
+                             const struct superblock* sb,
+                             struct block_allocator* alloc,
+                             struct inode* node,
+                             uint64_t logical,
+                             uint64_t physical,
+                             uint64_t len) {
+  if ((node->flags & INODE_EXTENTS) && !(node->flags & INODE_INLINE) &&
+      physical != 0 && len <= UINT32_MAX) {
+    return extent_tree_insert(bcache, sb, alloc, node, logical, physical, len);
+  }
+
+  for (uint64_t i = 0; i < len; i++) {
+    if (block_map_assign(bcache, sb, alloc, node, logical + i,
+                         physical ? physical + i : 0) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Освобождает в поддереве блока указателей уровня depth (1 - указатели на
+// данные) логические блоки с from (считая от начала поддерева). Опустевший
+// блок указателей тоже освобождается, тогда *empty = true
+static int32_t truncate_ptrs(struct block_cache* bcache,
+                             const struct superblock* sb,
+                             struct block_allocator* alloc, uint64_t block,
+                             uint32_t depth, uint64_t from, bool* empty) {
+  *empty = false;
+  uint64_t count = sb->block_size / sizeof(uint64_t);
+  uint64_t* ptrs = calloc(count, sizeof(uint64_t));
+  if (!ptrs) return -1;
+  if (block_cache_read(bcache, block, 0, ptrs, sb->block_size) < 0) {
+    free(ptrs);
+    return -1;
+  }
+
+  // Каждый указатель уровня depth покрывает 2^shift логических блоков
+  uint32_t shift = ptr_shift(sb->block_size) * (depth - 1);
+  bool changed = false;
+  int32_t result = 0;
+
+  for (uint64_t i = from >> shift; i < count && result == 0; i++) {
+    if (ptrs[i] == 0) continue;
+    if (depth == 1) {
+      block_free(alloc, ptrs[i], 1);
+      ptrs[i] = 0;
+      changed = true;
+      continue;
+    }
+
+    uint64_t base = i << shift;
+    bool child_empty;
+    result = truncate_ptrs(bcache, sb, alloc, ptrs[i], depth - 1,
+                           from > base ? from - base : 0, &child_empty);
+    if (child_empty) {
+      ptrs[i] = 0;
+      changed = true;
+    }
+  }
+
+  if (result == 0) {
+    *empty = true;
+    for (uint64_t i = 0; i < count && *empty; i++) *empty = ptrs[i] == 0;
+
+    if (*empty) {
+      block_free(alloc, block, 1);
+    } else if (changed &&
+               block_cache_write(bcache, block, 0, ptrs, sb->block_size) < 0) {
+      result = -1;
+    }
+  }
+
+  free(ptrs);
+  return result;
+}
+
+int32_t block_map_truncate(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           struct block_allocator* alloc,
+                           struct inode* node,
+                           uint64_t from) {
+  if (node->flags & INODE_INLINE) {
+    errno = EINVAL;  // Данные в самом inode, блоков нет
+    return -1;
+  }
+  if (node->flags & INODE_EXTENTS) {
+    return extent_tree_truncate(bcache, sb, alloc, node, from);
+  }
+
+  for (uint64_t i = from; i < DIRECT_BLOCKS; i++) {
+    if (node->direct[i]) block_free(alloc, node->direct[i], 1);
+    node->direct[i] = 0;
+  }
+
+  uint32_t shift = ptr_shift(sb->block_size);
+  uint64_t base = DIRECT_BLOCKS;
+  for (uint32_t depth = 1; depth <= INDIRECT_LEVELS; depth++) {
+    uint64_t span = 1ULL << (shift * depth);
+    uint64_t* root = &node->indirect[depth - 1];
+
+    if (*root && from < base + span) {
+      bool empty;
+      if (truncate_ptrs(bcache, sb, alloc, *root, depth,
+                        from > base ? from - base : 0, &empty) < 0) {
+        return -1;
+      }
+      if (empty) *root = 0;
+    }
+    base += span;
+  }
+
+  return 0;
+}
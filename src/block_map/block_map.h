@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../block_cache/block_cache.h"
+#include "../inode_table/inode.h"
+#include "../superblock/superblock.h"
+
+// Отображение логических блоков файла на физические блоки образа.
+// Первые DIRECT_BLOCKS блоков адресуются прямо из inode, следующие - через
+// одинарный, двойной и тройной косвенные блоки. Блок указателей хранит
+// block_size / 8 номеров блоков; 0 означает дыру (блок не выделен).
+// Поиск блока читает не более INDIRECT_LEVELS указателей через кэш блоков.
+// Для inode с флагом INODE_EXTENTS вызовы передаются дереву экстентов;
+// для inode с INODE_INLINE отображения нет, и вызовы завершаются с EINVAL.
+
+// Отрезок логических блоков с подряд идущими физическими блоками
+struct map_run {
+  uint64_t logical;       // Первый логический блок
+  uint64_t physical;      // Первый физический блок (0 - дыра)
+  uint64_t len;           // Длина в блоках
+};
+
+// Максимальное число блоков данных файла с адресацией через указатели
+extern uint64_t block_map_max_blocks(uint32_t block_size);
+
+// Находит физический блок по логическому индексу и записывает его в
+// physical (0 для дыры). Возвращает 0 или -1 при ошибке чтения либо
+// индексе за пределами адресации
+extern int32_t block_map_resolve(struct block_cache* bcache,
+                                 const struct superblock* sb,
+                                 const struct inode* node,
+                                 uint64_t logical,
+                                 uint64_t* physical);
+
+// Находит наибольший отрезок, содержащий logical, в котором физические
+// блоки идут подряд (либо дыру). Отрезок не выходит за блок указателей
+// или экстент. Возвращает 0 или -1 при ошибке
+extern int32_t block_map_resolve_run(struct block_cache* bcache,
+                                     const struct superblock* sb,
+                                     const struct inode* node,
+                                     uint64_t logical,
+                                     struct map_run* run);
+
+// Привязывает логический блок к физическому, выделяя и обнуляя недостающие
+// блоки указателей. Корни косвенной адресации обновляются в node, запись
+// самого inode остается вызывающему. Для дерева экстентов physical должен
+// быть ненулевым. Возвращает 0 или -1 при ошибке
+extern int32_t block_map_assign(struct block_cache* bcache,
+                                const struct superblock* sb,
+                                struct block_allocator* alloc,
+                                struct inode* node,
+                                uint64_t logical,
+                                uint64_t physical);
+
+// Привязывает len логических блоков с logical к подряд идущим физическим
+// блокам с physical. В дереве экстентов отрезок добавляется одной
+// записью. Возвращает 0 или -1 при ошибке
+extern int32_t block_map_assign_run(struct block_cache* bcache,
+                                    const struct superblock* sb,
+                                    struct block_allocator* alloc,
+                                    struct inode* node,
+                                    uint64_t logical,
+                                    uint64_t physical,
+                                    uint64_t len);
+
+// Освобождает блоки данных файла с логического блока from до конца и
+// ставшие ненужными блоки указателей (узлы дерева экстентов). Корни
+// адресации обновляются в node, размер файла и запись inode остаются
+// вызывающему. Возвращает 0 или -1 при ошибке
+extern int32_t block_map_truncate(struct block_cache* bcache,
+                                  const struct superblock* sb,
+                                  struct block_allocator* alloc,
+                                  struct inode* node,
+                                  uint64_t from);
@@ -0,0 +1,431 @@
+#include "extent_tree.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../debug/debug.h"
+
+// Записи листа и индексного узла одного размера, ключ - первое поле
+_Static_assert(sizeof(struct extent) == sizeof(struct extent_index),
+               "extent and extent_index must have the same size");
+
+// Вместимость корня в inode
+#define ROOT_MAX \
+  ((INODE_MAP_SIZE - sizeof(struct extent_header)) / sizeof(struct extent))
+
+static struct extent_header* root_of(const struct inode* node) {
+  return (struct extent_header*)node->extent_root;
+}
+
+static struct extent* leaf_of(struct extent_header* h) {
+  return (struct extent*)(h + 1);
+}
+
+static struct extent_index* index_of(struct extent_header* h) {
+  return (struct extent_index*)(h + 1);
+}
+
+// Вместимость узла в отдельном блоке
+static uint16_t node_max(uint32_t block_size) {
+  return (block_size - sizeof(struct extent_header)) / sizeof(struct extent);
+}
+
+// Двоичный поиск последней записи с ключом <= logical. -1, если таких нет
+static int32_t search(struct extent_header* h, uint64_t logical) {
+  struct extent* e = leaf_of(h);
+  int32_t lo = 0, hi = (int32_t)h->entries - 1, found = -1;
+  while (lo <= hi) {
+    int32_t mid = lo + (hi - lo) / 2;
+    if (e[mid].logical <= logical) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+// Читает узел из блока и проверяет заголовок
+static int32_t read_node(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         uint64_t block, uint8_t* buf, uint16_t depth) {
+  if (block_cache_read(bcache, block, 0, buf, sb->block_size) < 0) return -1;
+
+  struct extent_header* h = (struct extent_header*)buf;
+  if (h->magic != EXTENT_MAGIC || h->depth != depth ||
+      h->max != node_max(sb->block_size) || h->entries > h->max) {
+    sifs_error("Поврежденный узел дерева экстентов в блоке %" PRIu64 "\n",
+               block);
+    errno = EIO;
+    return -1;
+  }
+  return 0;
+}
+
+static int32_t write_node(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          uint64_t block, const uint8_t* buf) {
+  return block_cache_write(bcache, block, 0, buf, sb->block_size);
+}
+
+// Выделяет блок под узел. Возвращает номер блока или 0
+static uint64_t alloc_node(struct block_allocator* alloc) {
+  int64_t block = block_alloc(alloc);
+  if (block < 0) {
+    errno = ENOSPC;
+    return 0;
+  }
+  return block;
+}
+
+void extent_tree_init(struct inode* node) {
+  memset(node->extent_root, 0, sizeof(node->extent_root));
+
+  struct extent_header* root = root_of(node);
+  root->magic = EXTENT_MAGIC;
+  root->max = ROOT_MAX;
+  node->flags |= INODE_EXTENTS;
+}
+
+int32_t extent_tree_lookup(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           const struct inode* node,
+                           uint64_t logical,
+                           uint64_t* physical,
+                           struct map_run* run) {
+  *physical = 0;
+  if (run) {
+    run->logical = logical;
+    run->physical = 0;
+    run->len = 1;
+  }
+  if (logical > UINT32_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  struct extent_header* h = root_of(node);
+  uint8_t* buf = NULL;
+
+  // Ключ следующей записи индекса ограничивает дыру за последним
+  // экстентом листа; у крайнего правого листа дыра тянется до конца
+  uint64_t limit = (uint64_t)UINT32_MAX + 1;
+
+  while (h->depth > 0 && h->entries > 0) {
+    int32_t i = search(h, logical);
+    if (i < 0) i = 0;
+    if (i + 1 < h->entries) limit = index_of(h)[i + 1].logical;
+    uint64_t child = index_of(h)[i].child;
+
+    if (!buf && !(buf = malloc(sb->block_size))) return -1;
+    if (read_node(bcache, sb, child, buf, h->depth - 1) < 0) {
+      free(buf);
+      return -1;
+    }
+    h = (struct extent_header*)buf;
+  }
+
+  if (h->depth == 0) {
+    int32_t i = search(h, logical);
+    struct extent* e = leaf_of(h);
+    uint64_t end = i >= 0 ? (uint64_t)e[i].logical + e[i].len : 0;
+    if (logical < end) {
+      *physical = e[i].start + (logical - e[i].logical);
+      if (run) {
+        run->logical = e[i].logical;
+        run->physical = e[i].start;
+        run->len = e[i].len;
+      }
+    } else if (run) {
+      run->logical = i >= 0 ? end : logical;
+      run->len = (i + 1 < h->entries ? e[i + 1].logical : limit) -
+                 run->logical;
+    }
+  }
+
+  free(buf);
+  return 0;
+}
+
+// Пытается добавить отрезок к соседнему экстенту листа без изменения
+// структуры дерева. Возвращает 1, если слито, 0, если нужна новая запись,
+// или -1 при ошибке
+static int32_t try_merge(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         struct inode* node, uint8_t* buf,
+                         uint64_t logical, uint64_t start, uint32_t len) {
+  struct extent_header* h = root_of(node);
+  uint64_t block = 0;
+
+  while (h->depth > 0) {
+    int32_t i = search(h, logical);
+    uint64_t child = index_of(h)[i < 0 ? 0 : i].child;
+    if (read_node(bcache, sb, child, buf, h->depth - 1) < 0) return -1;
+    h = (struct extent_header*)buf;
+    block = child;
+  }
+
+  struct extent* e = leaf_of(h);
+  int32_t i = search(h, logical);
+  int32_t j = i + 1;
+
+  if ((i >= 0 && logical < (uint64_t)e[i].logical + e[i].len) ||
+      (j < h->entries && logical + len > e[j].logical)) {
+    sifs_debug("Отрезок %" PRIu64 "+%u уже отображен\n", logical, len);
+    errno = EEXIST;
+    return -1;
+  }
+
+  if (i >= 0 && (uint64_t)e[i].logical + e[i].len == logical &&
+      e[i].start + e[i].len == start &&
+      (uint64_t)e[i].len + len <= UINT32_MAX) {
+    e[i].len += len;
+  } else if (j < h->entries && logical + len == e[j].logical &&
+             start + len == e[j].start &&
+             (uint64_t)e[j].len + len <= UINT32_MAX) {
+    e[j].logical = logical;
+    e[j].start = start;
+    e[j].len += len;
+  } else {
+    return 0;
+  }
+
+  if (block && write_node(bcache, sb, block, buf) < 0) return -1;
+  return 1;
+}
+
+// Переносит корень в отдельный блок, увеличивая глубину дерева
+static int32_t grow_root(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         struct block_allocator* alloc, struct inode* node,
+                         uint8_t* buf) {
+  struct extent_header* root = root_of(node);
+  if (root->depth + 1 >= EXTENT_MAX_DEPTH) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  uint64_t block = alloc_node(alloc);
+  if (!block) return -1;
+
+  memset(buf, 0, sb->block_size);
+  struct extent_header* h = (struct extent_header*)buf;
+  *h = *root;
+  h->max = node_max(sb->block_size);
+  memcpy(h + 1, root + 1, root->entries * sizeof(struct extent));
+  if (write_node(bcache, sb, block, buf) < 0) {
+    block_free(alloc, block, 1);
+    return -1;
+  }
+
+  // Ключ крайней левой записи - нижняя граница всех логических блоков,
+  // иначе блоки левее первого экстента попали бы после нее при делении
+  struct extent_index* idx = index_of(root);
+  idx[0].logical = 0;
+  idx[0].reserved = 0;
+  idx[0].child = block;
+  root->entries = 1;
+  root->depth++;
+
+  sifs_debug("Корень дерева экстентов перенесен в блок %" PRIu64
+             ", глубина %u\n", block, root->depth);
+  return 0;
+}
+
+// Делит заполненный узел h (блок block), перенося хвост записей в новый
+// узел sib. При дописывании в конец переносится одна запись, чтобы
+// последовательная запись оставляла узлы заполненными
+static int32_t split_node(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          struct block_allocator* alloc,
+                          struct extent_header* h, uint64_t block,
+                          uint64_t logical, uint8_t* sib,
+                          uint64_t* sib_block, uint32_t* sib_key) {
+  struct extent* e = leaf_of(h);
+  uint16_t n = h->entries;
+  uint16_t at = logical > e[n - 1].logical ? n - 1 : n / 2;
+
+  *sib_block = alloc_node(alloc);
+  if (!*sib_block) return -1;
+
+  memset(sib, 0, sb->block_size);
+  struct extent_header* s = (struct extent_header*)sib;
+  *s = *h;
+  s->entries = n - at;
+  memcpy(s + 1, &e[at], s->entries * sizeof(struct extent));
+  h->entries = at;
+  *sib_key = leaf_of(s)[0].logical;
+
+  if (write_node(bcache, sb, *sib_block, sib) < 0 ||
+      write_node(bcache, sb, block, (uint8_t*)h) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// Добавляет новую запись листа, деля заполненные узлы по пути сверху вниз
+static int32_t insert_entry(struct block_cache* bcache,
+                            const struct superblock* sb,
+                            struct block_allocator* alloc, struct inode* node,
+                            uint8_t* bufs, uint64_t logical,
+                            uint64_t start, uint32_t len) {
+  uint8_t* cur = bufs;
+  uint8_t* next = bufs + sb->block_size;
+  uint8_t* sib = bufs + 2 * (size_t)sb->block_size;
+  uint8_t* tmp;
+
+  struct extent_header* h = root_of(node);
+  if (h->entries == h->max && grow_root(bcache, sb, alloc, node, cur) < 0) {
+    return -1;
+  }
+  uint64_t block = 0;
+
+  // Родитель каждого делимого узла уже имеет свободную запись
+  while (h->depth > 0) {
+    struct extent_index* idx = index_of(h);
+    int32_t i = search(h, logical);
+    if (i < 0) i = 0;
+    uint64_t child = idx[i].child;
+    if (read_node(bcache, sb, child, next, h->depth - 1) < 0) return -1;
+
+    struct extent_header* ch = (struct extent_header*)next;
+    if (ch->entries == ch->max) {
+      uint64_t sib_block;
+      uint32_t sib_key;
+      if (split_node(bcache, sb, alloc, ch, child, logical, sib,
+                     &sib_block, &sib_key) < 0) {
+        return -1;
+      }
+
+      memmove(&idx[i + 2], &idx[i + 1],
+              (h->entries - i - 1) * sizeof(struct extent_index));
+      idx[i + 1].logical = sib_key;
+      idx[i + 1].reserved = 0;
+      idx[i + 1].child = sib_block;
+      h->entries++;
+      if (block && write_node(bcache, sb, block, (uint8_t*)h) < 0) return -1;
+
+      if (logical >= sib_key) {
+        child = sib_block;
+        tmp = next; next = sib; sib = tmp;
+      }
+    }
+
+    tmp = cur; cur = next; next = tmp;
+    h = (struct extent_header*)cur;
+    block = child;
+  }
+
+  struct extent* e = leaf_of(h);
+  int32_t pos = search(h, logical) + 1;
+  memmove(&e[pos + 1], &e[pos], (h->entries - pos) * sizeof(struct extent));
+  e[pos].logical = logical;
+  e[pos].len = len;
+  e[pos].start = start;
+  h->entries++;
+
+  if (block && write_node(bcache, sb, block, cur) < 0) return -1;
+  return 0;
+}
+
+int32_t extent_tree_insert(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           struct block_allocator* alloc,
+                           struct inode* node,
+                           uint64_t logical,
+                           uint64_t start,
+                           uint32_t len) {
+  if (len == 0) return 0;
+  if (logical + len - 1 > UINT32_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  // Буферы родителя, потомка и нового соседа при делении
+  uint8_t* bufs = malloc(3 * (size_t)sb->block_size);
+  if (!bufs) return -1;
+
+  int32_t result = try_merge(bcache, sb, node, bufs, logical, start, len);
+  if (result == 0) {
+    result = insert_entry(bcache, sb, alloc, node, bufs, logical, start, len);
+  }
+
+  free(bufs);
+  return result < 0 ? -1 : 0;
+}
+
+// Освобождает блоки данных с логического from в узле h и его поддереве.
+// Записи, целиком ушедшие за from, удаляются вместе с узлами под ними;
+// оставшиеся записи всегда образуют начало узла
+static int32_t truncate_node(struct block_cache* bcache,
+                             const struct superblock* sb,
+                             struct block_allocator* alloc,
+                             struct extent_header* h, uint64_t from) {
+  uint16_t keep = 0;
+
+  if (h->depth == 0) {
+    struct extent* e = leaf_of(h);
+    for (uint16_t i = 0; i < h->entries; i++) {
+      uint64_t end = (uint64_t)e[i].logical + e[i].len;
+      if (e[i].logical >= from) {
+        block_free(alloc, e[i].start, e[i].len);
+        continue;
+      }
+      if (end > from) {
+        block_free(alloc, e[i].start + (from - e[i].logical),
+                    end - from);
+        e[i].len = from - e[i].logical;
+      }
+      keep = i + 1;
+    }
+    h->entries = keep;
+    return 0;
+  }
+
+  uint8_t* buf = malloc(sb->block_size);
+  if (!buf) return -1;
+
+  struct extent_index* idx = index_of(h);
+  int32_t result = 0;
+  for (uint16_t i = 0; i < h->entries && result == 0; i++) {
+    // Поддерево целиком до from остается как есть
+    if (i + 1 < h->entries && idx[i + 1].logical <= from) {
+      keep = i + 1;
+      continue;
+    }
+
+    uint64_t child = idx[i].child;
+    if ((result = read_node(bcache, sb, child, buf, h->depth - 1)) < 0) break;
+
+    struct extent_header* ch = (struct extent_header*)buf;
+    result = truncate_node(bcache, sb, alloc, ch,
+                           idx[i].logical >= from ? 0 : from);
+    if (result < 0) break;
+
+    if (ch->entries == 0) {
+      block_free(alloc, child, 1);
+    } else {
+      result = write_node(bcache, sb, child, buf);
+      keep = i + 1;
+    }
+  }
+
+  free(buf);
+  h->entries = keep;
+  return result;
+}
+
+int32_t extent_tree_truncate(struct block_cache* bcache,
+                             const struct superblock* sb,
+                             struct block_allocator* alloc,
+                             struct inode* node,
+                             uint64_t from) {
+  struct extent_header* root = root_of(node);
+  if (truncate_node(bcache, sb, alloc, root, from) < 0) return -1;
+
+  // Опустевший индексный корень снова становится листом
+  if (root->entries == 0) root->depth = 0;
+  return 0;
+}
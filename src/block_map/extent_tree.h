@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include "block_map.h"
+#include "../block_cache/block_cache.h"
+#include "../inode_table/inode.h"
+#include "../superblock/superblock.h"
+
+#define EXTENT_MAGIC 0xE7E7           // Магическое число узла дерева экстентов
+#define EXTENT_MAX_DEPTH 6            // Максимальная глубина дерева
+
+// Заголовок узла. Корень лежит в inode (область адресации блоков),
+// остальные узлы занимают по блоку; за заголовком идут записи узла
+struct extent_header {
+  uint16_t magic;         // EXTENT_MAGIC
+  uint16_t entries;       // Число записей
+  uint16_t max;           // Вместимость узла
+  uint16_t depth;         // 0 - лист (экстенты), иначе индексный узел
+};
+
+// Запись листа: отрезок подряд идущих блоков файла
+struct extent {
+  uint32_t logical;       // Первый логический блок
+  uint32_t len;           // Длина в блоках
+  uint64_t start;         // Первый физический блок
+};
+
+// Запись индексного узла
+struct extent_index {
+  uint32_t logical;       // Наименьший логический блок поддерева
+  uint32_t reserved;
+  uint64_t child;         // Блок дочернего узла
+};
+
+// Делает область адресации inode пустым деревом экстентов.
+// Вызывается для inode без выделенных блоков
+extern void extent_tree_init(struct inode* node);
+
+// Находит физический блок по логическому индексу двоичным поиском по
+// узлам дерева и записывает его в physical (0 для дыры). Если run не NULL,
+// в него записывается весь экстент с logical (для дыры - весь промежуток
+// до следующего экстента). Возвращает 0 или -1 при ошибке чтения
+extern int32_t extent_tree_lookup(struct block_cache* bcache,
+                                  const struct superblock* sb,
+                                  const struct inode* node,
+                                  uint64_t logical,
+                                  uint64_t* physical,
+                                  struct map_run* run);
+
+// Отображает len логических блоков с logical на физические с start.
+// Смежный отрезок сливается с соседним экстентом; при переполнении узлы
+// делятся, а корень переносится в отдельный блок. Отрезок не должен
+// пересекаться с уже отображенными. Возвращает 0 или -1 при ошибке
+extern int32_t extent_tree_insert(struct block_cache* bcache,
+                                  const struct superblock* sb,
+                                  struct block_allocator* alloc,
+                                  struct inode* node,
+                                  uint64_t logical,
+                                  uint64_t start,
+                                  uint32_t len);
+
+// Освобождает экстенты (и их части) с логического блока from до конца
+// файла вместе с опустевшими узлами. Возвращает 0 или -1 при ошибке
+extern int32_t extent_tree_truncate(struct block_cache* bcache,
+                                    const struct superblock* sb,
+                                    struct block_allocator* alloc,
+                                    struct inode* node,
+                                    uint64_t from);
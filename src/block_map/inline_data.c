@@ -0,0 +1,107 @@
+#include "inline_data.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block_map.h"
+#include "extent_tree.h"
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../debug/debug.h"
+
+void inline_data_init(struct inode* node) {
+  memset(node->inline_data, 0, sizeof(node->inline_data));
+  node->flags = (node->flags & ~INODE_EXTENTS) | INODE_INLINE;
+  node->size = 0;
+}
+
+ssize_t inline_data_read(const struct inode* node,
+                         void* buffer,
+                         size_t size,
+                         uint64_t offset) {
+  sifs_assert(node->flags & INODE_INLINE);
+  if (offset >= node->size) return 0;
+  if (size > node->size - offset) size = node->size - offset;
+  memcpy(buffer, node->inline_data + offset, size);
+  return size;
+}
+
+ssize_t inline_data_write(struct inode* node,
+                          const void* buffer,
+                          size_t size,
+                          uint64_t offset) {
+  sifs_assert(node->flags & INODE_INLINE);
+  if (offset > INODE_INLINE_SIZE || size > INODE_INLINE_SIZE - offset) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  // Промежуток между концом файла и offset уже нулевой
+  memcpy(node->inline_data + offset, buffer, size);
+  if (offset + size > node->size) node->size = offset + size;
+  return size;
+}
+
+int32_t inline_data_truncate(struct inode* node, uint64_t size) {
+  sifs_assert(node->flags & INODE_INLINE);
+  if (!inline_data_fits(size)) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  // Обрезанный хвост обнуляется, чтобы последующее расширение читало нули
+  if (size < node->size) {
+    memset(node->inline_data + size, 0, node->size - size);
+  }
+  node->size = size;
+  return 0;
+}
+
+int32_t inline_data_migrate(struct block_cache* bcache,
+                            const struct superblock* sb,
+                            struct block_allocator* alloc,
+                            struct inode* node,
+                            bool extents) {
+  sifs_assert(node->flags & INODE_INLINE);
+
+  struct inode saved = *node;
+  uint64_t block = 0;
+
+  if (node->size > 0) {
+    int64_t allocated = block_alloc(alloc);
+    if (allocated < 0) {
+      errno = ENOSPC;
+      return -1;
+    }
+    block = allocated;
+
+    uint8_t* data = calloc(1, sb->block_size);
+    if (!data) {
+      block_free(alloc, block, 1);
+      return -1;
+    }
+    memcpy(data, node->inline_data, node->size);
+    // Это данные файла: они пишутся в образ мимо кэша блоков, откуда их
+    // читает fs_read
+    ssize_t n = image_write(bcache->img, data, sb->block_size,
+                            (off_t)block * sb->block_size);
+    free(data);
+    if (n < 0) {
+      block_free(alloc, block, 1);
+      return -1;
+    }
+  }
+
+  memset(node->inline_data, 0, sizeof(node->inline_data));
+  node->flags &= ~INODE_INLINE;
+  if (extents) extent_tree_init(node);
+
+  if (block && block_map_assign(bcache, sb, alloc, node, 0, block) < 0) {
+    block_free(alloc, block, 1);
+    *node = saved;
+    return -1;
+  }
+
+  sifs_debug("Встроенные данные (%" PRIu64 " байт) перенесены в блок %"
+             PRIu64 "\n", saved.size, block);
+  return 0;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../block_cache/block_cache.h"
+#include "../inode_table/inode.h"
+#include "../superblock/superblock.h"
+
+// Встроенные данные: содержимое файла или цель символической ссылки
+// размером до INODE_INLINE_SIZE байт хранится в inode на месте области
+// адресации блоков (флаг INODE_INLINE). Такой файл не занимает блоков
+// данных, а чтение не требует обращения к образу помимо самого inode.
+// Байты за концом файла всегда нулевые. Запись за пределы вместимости
+// требует предварительного переноса данных в блок (inline_data_migrate).
+
+// Помещаются ли size байт файла в inode
+static inline bool inline_data_fits(uint64_t size) {
+  return size <= INODE_INLINE_SIZE;
+}
+
+// Делает inode пустым файлом со встроенными данными.
+// Вызывается для inode без выделенных блоков
+extern void inline_data_init(struct inode* node);
+
+// Читает до size байт со смещения offset.
+// Возвращает число прочитанных байт (0 за концом файла)
+extern ssize_t inline_data_read(const struct inode* node,
+                                void* buffer,
+                                size_t size,
+                                uint64_t offset);
+
+// Записывает size байт по смещению offset, расширяя файл при
+// необходимости (промежуток заполняется нулями). Возвращает size или -1
+// с EFBIG, если данные не помещаются в inode
+extern ssize_t inline_data_write(struct inode* node,
+                                 const void* buffer,
+                                 size_t size,
+                                 uint64_t offset);
+
+// Изменяет размер файла в пределах вместимости. Возвращает 0 или -1
+extern int32_t inline_data_truncate(struct inode* node, uint64_t size);
+
+// Переносит встроенные данные в блок данных: выделяет и записывает блок,
+// переводит inode на указатели (или дерево экстентов при extents) и
+// отображает в него логический блок 0. Пустой файл блока не получает.
+// При ошибке inode не меняется. Запись inode остается вызывающему.
+// Возвращает 0 или -1 при ошибке
+extern int32_t inline_data_migrate(struct block_cache* bcache,
+                                   const struct superblock* sb,
+                                   struct block_allocator* alloc,
+                                   struct inode* node,
+                                   bool extents);
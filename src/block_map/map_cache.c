@@ -0,0 +1,111 @@
+#include "map_cache.h"
+#include <stdbool.h>
+#include <string.h>
+
+void map_cache_init(struct map_cache* cache) {
+  memset(cache, 0, sizeof(*cache));
+}
+
+static bool run_contains(const struct map_run* run, uint64_t logical) {
+  return logical >= run->logical && logical - run->logical < run->len;
+}
+
+// Ищет отрезок с logical в кэше, начиная с последнего попадания
+static const struct map_run* find(struct map_cache* cache, uint64_t logical) {
+  // Последовательное чтение почти всегда попадает в последний отрезок
+  if (run_contains(&cache->runs[cache->last], logical)) {
+    return &cache->runs[cache->last];
+  }
+  for (uint32_t i = 0; i < MAP_CACHE_RUNS; i++) {
+    if (run_contains(&cache->runs[i], logical)) {
+      cache->last = i;
+      return &cache->runs[i];
+    }
+  }
+  return NULL;
+}
+
+int32_t map_cache_resolve_run(struct map_cache* cache,
+                              struct block_cache* bcache,
+                              const struct superblock* sb,
+                              const struct inode* node,
+                              uint64_t logical,
+                              struct map_run* run) {
+  struct map_run found;
+  const struct map_run* cached = find(cache, logical);
+  if (cached) {
+    cache->stats.hits++;
+    found = *cached;
+  } else {
+    cache->stats.misses++;
+    if (block_map_resolve_run(bcache, sb, node, logical, &found) < 0) return -1;
+    if (found.physical) {
+      uint32_t i = cache->next;
+      cache->next = (cache->next + 1) % MAP_CACHE_RUNS;
+      cache->runs[i] = found;
+      cache->last = i;
+    }
+  }
+
+  // Отрезок отдается начиная с запрошенного блока
+  uint64_t skip = logical - found.logical;
+  run->logical = logical;
+  run->physical = found.physical ? found.physical + skip : 0;
+  run->len = found.len - skip;
+  return 0;
+}
+
+int32_t map_cache_resolve(struct map_cache* cache,
+                          struct block_cache* bcache,
+                          const struct superblock* sb,
+                          const struct inode* node,
+                          uint64_t logical,
+                          uint64_t* physical) {
+  struct map_run run;
+  if (map_cache_resolve_run(cache, bcache, sb, node, logical, &run) < 0) {
+    return -1;
+  }
+  *physical = run.physical;
+  return 0;
+}
+
+void map_cache_invalidate(struct map_cache* cache,
+                          uint64_t logical,
+                          uint64_t count) {
+  uint64_t end = count > UINT64_MAX - logical ? UINT64_MAX : logical + count;
+
+  for (uint32_t i = 0; i < MAP_CACHE_RUNS; i++) {
+    struct map_run* run = &cache->runs[i];
+    if (run->len && run->logical < end && logical < run->logical + run->len) {
+      run->len = 0;
+    }
+  }
+}
+
+int32_t map_cache_assign(struct map_cache* cache,
+                         struct block_cache* bcache,
+                         const struct superblock* sb,
+                         struct block_allocator* alloc,
+                         struct inode* node,
+                         uint64_t logical,
+                         uint64_t physical) {
+  map_cache_invalidate(cache, logical, 1);
+  return block_map_assign(bcache, sb, alloc, node, logical, physical);
+}
+
+int32_t map_cache_assign_run(struct map_cache* cache,
+                             struct block_cache* bcache,
+                             const struct superblock* sb,
+                             struct block_allocator* alloc,
+                             struct inode* node,
+                             uint64_t logical,
+                             uint64_t physical,
+                             uint64_t len) {
+  map_cache_invalidate(cache, logical, len);
+  return block_map_assign_run(bcache, sb, alloc, node, logical, physical, len);
+}
+
+void map_cache_get_stats(const struct map_cache* cache,
+                         struct map_cache_stats* stats) {
+  *stats = cache->stats;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+#include "block_map.h"
+
+// Число отрезков в кэше одного inode
+#define MAP_CACHE_RUNS 8
+
+// Счетчики кэша
+struct map_cache_stats {
+  uint64_t hits;          // Блок найден в кэше
+  uint64_t misses;        // Блок разрешен через block_map
+};
+
+// Кэш недавно разрешенных отрезков одного открытого inode. Повторное
+// обращение к блоку отрезка не читает блоки указателей и узлы экстентов.
+// Запись в файл и усечение должны сбрасывать затронутые отрезки.
+// Кэш не потокобезопасен: он принадлежит владельцу открытого inode.
+struct map_cache {
+  struct map_run runs[MAP_CACHE_RUNS];  // Отрезки (len == 0 - запись пуста)
+  uint32_t last;          // Отрезок последнего попадания (проверяется первым)
+  uint32_t next;          // Следующая заменяемая запись (по кругу)
+  struct map_cache_stats stats;
+};
+
+// Инициализирует пустой кэш
+extern void map_cache_init(struct map_cache* cache);
+
+// Разрешает логический блок через кэш, при промахе - через
+// block_map_resolve_run, запоминая найденный отрезок. Дыры не кэшируются.
+// Возвращает 0 или -1 при ошибке
+extern int32_t map_cache_resolve(struct map_cache* cache,
+                                 struct block_cache* bcache,
+                                 const struct superblock* sb,
+                                 const struct inode* node,
+                                 uint64_t logical,
+                                 uint64_t* physical);
+
+// То же, но возвращает в run весь известный отрезок, начиная с logical:
+// подряд идущие физические блоки или дыру до следующего отображенного
+// блока. Возвращает 0 или -1 при ошибке
+extern int32_t map_cache_resolve_run(struct map_cache* cache,
+                                     struct block_cache* bcache,
+                                     const struct superblock* sb,
+                                     const struct inode* node,
+                                     uint64_t logical,
+                                     struct map_run* run);
+
+// Привязывает логический блок через block_map_assign, сбрасывая
+// отрезок кэша, в который он входил. Возвращает 0 или -1 при ошибке
+extern int32_t map_cache_assign(struct map_cache* cache,
+                                struct block_cache* bcache,
+                                const struct superblock* sb,
+                                struct block_allocator* alloc,
+                                struct inode* node,
+                                uint64_t logical,
+                                uint64_t physical);
+
+// Привязывает len блоков через block_map_assign_run, сбрасывая
+// пересекающиеся отрезки кэша. Возвращает 0 или -1 при ошибке
+extern int32_t map_cache_assign_run(struct map_cache* cache,
+                                    struct block_cache* bcache,
+                                    const struct superblock* sb,
+                                    struct block_allocator* alloc,
+                                    struct inode* node,
+                                    uint64_t logical,
+                                    uint64_t physical,
+                                    uint64_t len);
+
+// Сбрасывает отрезки, пересекающие count блоков с logical
+// (UINT64_MAX - до конца файла, например при усечении)
+extern void map_cache_invalidate(struct map_cache* cache,
+                                 uint64_t logical,
+                                 uint64_t count);
+
+// Копирует текущие счетчики кэша
+extern void map_cache_get_stats(const struct map_cache* cache,
+                                struct map_cache_stats* stats);
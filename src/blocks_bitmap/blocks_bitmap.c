@@ -1,130 +1,144 @@
 #include "blocks_bitmap.h"
+#include <inttypes.h>
 #include <string.h>
+#include "../bitops/bitops.h"
 #include "../debug/debug.h"
 
-void get_block_bitmap_offset(uint32_t block_idx,
-                                          uint32_t* byte_offset,
+void get_block_bitmap_offset(uint64_t block_idx,
+                                          uint64_t* byte_offset,
                                           uint8_t* bit_offset) {
   *byte_offset = block_idx / 8;
   *bit_offset = block_idx % 8;
 
-  sifs_debug("Смещение блока %u: байт=%u, бит=%u\n",
+  sifs_debug("Смещение блока %" PRIu64 ": байт=%" PRIu64 ", бит=%u\n",
              block_idx, *byte_offset, *bit_offset);
 }
 
+// Устанавливает биты [start, end) в порции карты, начинающейся с байта first_byte
+static void set_range(uint8_t* chunk, uint64_t first_byte, size_t size,
+                      uint64_t start, uint64_t end) {
+  uint64_t lo = first_byte * 8;
+  uint64_t hi = (first_byte + size) * 8;
+  if (start < lo) start = lo;
+  if (end > hi) end = hi;
+
+  for (; start < end && start % 8; start++) {
+    chunk[start / 8 - first_byte] |= 1 << (start % 8);
+  }
+  uint64_t full_end = end & ~7ULL;
+  if (start < full_end) {
+    memset(chunk + (start / 8 - first_byte), 0xFF, (full_end - start) / 8);
+    start = full_end;
+  }
+  for (; start < end; start++) {
+    chunk[start / 8 - first_byte] |= 1 << (start % 8);
+  }
+}
+
+void block_bitmap_init_range(const struct superblock* sb, uint8_t* chunk,
+                             uint64_t first_byte, size_t size) {
+  memset(chunk, 0, size);
+
+  // Системные области (суперблок, дескрипторы, битовые карты, таблица
+  // inode) идут подряд с начала каждой группы, поэтому занятые биты
+  // образуют префикс группы
+  uint64_t first_block = first_byte * 8;
+  uint64_t last_block = (first_byte + size) * 8;
+  if (last_block > sb->count_blocks) last_block = sb->count_blocks;
+
+  for (uint64_t block = first_block; block < last_block;) {
+    struct group_layout layout;
+    superblock_group_layout(sb, superblock_block_group(sb, block), &layout);
+    set_range(chunk, first_byte, size, layout.first_block,
+              layout.first_data_block);
+    block = layout.end_block;
+  }
+}
+
 void block_bitmap_init(struct superblock* sb, uint8_t* bitmap) {
   sifs_debug("Инициализация битовой карты блоков\n");
 
   // Расчет размера битмапа
-  uint32_t bitmap_size = sb->count_block_bitmap_blocks * sb->block_size;
-  memset(bitmap, 0, bitmap_size);
-  sifs_debug("Битовая карта обнулена (%u байт)\n", bitmap_size);
-
-  // Пометить системные блоки как занятые
-  uint32_t meta_blocks[] = {
-    0,  // Суперблок
-    sb->first_inode_bitmap_block,
-    sb->first_block_bitmap_block,
-    sb->first_inode_table_block
-  };
-  uint32_t meta_blocks_count[] = {
-    1,  // Суперблок
-    sb->count_inode_bitmap_blocks,
-    sb->count_block_bitmap_blocks,
-    sb->count_inode_table_blocks
-  };
-
-  // Обработка всех системных областей
-  for (uint8_t i = 0; i < 4; i++) {
-    uint32_t start = meta_blocks[i];
-    uint32_t count = meta_blocks_count[i];
-
-    for (uint32_t j = 0; j < count; j++) {
-      uint32_t block_idx = start + j;
-      if (block_idx >= sb->count_blocks) break;
-
-      uint32_t byte_offset;
-      uint8_t bit_offset;
-      get_block_bitmap_offset(block_idx, &byte_offset, &bit_offset);
-      bitmap[byte_offset] |= (1 << bit_offset);
-      sifs_debug("Системный блок %u помечен как занятый\n", block_idx);
-    }
-  }
+  uint64_t bitmap_size = sb->count_block_bitmap_blocks * sb->block_size;
+  block_bitmap_init_range(sb, bitmap, 0, bitmap_size);
 
   // Обновление счетчика свободных блоков
-  uint32_t total_meta_blocks =
-      1 +
-      sb->count_inode_bitmap_blocks +
-      sb->count_block_bitmap_blocks +
-      sb->count_inode_table_blocks;
+  uint64_t total_meta_blocks = sb->count_blocks - sb->count_blocks_data;
 
   sb->count_free_blocks = sb->count_blocks - total_meta_blocks;
-  sifs_debug("Системных блоков: %u, свободных блоков: %u\n",
+  sifs_debug("Системных блоков: %" PRIu64 ", свободных блоков: %" PRIu64 "\n",
              total_meta_blocks, sb->count_free_blocks);
 }
 
 bool is_block_allocated(const struct superblock* sb,
                         const uint8_t* bitmap,
-                        uint32_t block_idx) {
+                        uint64_t block_idx) {
   if (block_idx >= sb->count_blocks) {
-    sifs_debug("Недопустимый блок: %u (всего %u блоков)\n",
+    sifs_debug("Недопустимый блок: %" PRIu64 " (всего %" PRIu64 " блоков)\n",
                block_idx, sb->count_blocks);
     return true;
   }
 
-  uint32_t byte_offset;
+  uint64_t byte_offset;
   uint8_t bit_offset;
   get_block_bitmap_offset(block_idx, &byte_offset, &bit_offset);
 
   bool allocated = (bitmap[byte_offset] >> bit_offset) & 1;
-  sifs_debug("Блок %u: %s\n", block_idx, allocated ? "занят" : "свободен");
+  sifs_debug("Блок %" PRIu64 ": %s\n", block_idx, allocated ? "занят" : "свободен");
   return allocated;
 }
 
 int64_t allocate_block(struct superblock* sb, uint8_t* bitmap) {
   sifs_debug("Поиск свободного блока\n");
 
-  // Начинаем поиск с первого блока данных
-  for (uint32_t block_idx = sb->first_block_data;
-       block_idx < sb->count_blocks;
-       block_idx++) {
-
-    if (!is_block_allocated(sb, bitmap, block_idx)) {
-      // Пометить блок как занятый
-      uint32_t byte_offset;
-      uint8_t bit_offset;
-      get_block_bitmap_offset(block_idx, &byte_offset, &bit_offset);
-      bitmap[byte_offset] |= (1 << bit_offset);
+  // Курсор вне области данных (например, после перемещения) сбрасываем
+  uint64_t cursor = sb->next_free_block;
+  if (cursor < sb->first_block_data || cursor >= sb->count_blocks) {
+    cursor = sb->first_block_data;
+  }
 
-      // Обновить счетчик
-      sb->count_free_blocks--;
+  // Пословный поиск от курсора до конца, затем от начала данных до курсора
+  int64_t block_idx = bitmap_find_zero(bitmap, cursor, sb->count_blocks);
+  if (block_idx < 0) {
+    block_idx = bitmap_find_zero(bitmap, sb->first_block_data, cursor);
+  }
 
-      sifs_debug("Выделен блок %u\n", block_idx);
-      sifs_debug("Осталось свободных блоков: %u\n", sb->count_free_blocks);
-      return block_idx;
-    }
+  if (block_idx < 0) {
+    sifs_debug("Свободные блоки отсутствуют!\n");
+    return -1;
   }
 
-  sifs_debug("Свободные блоки отсутствуют!\n");
-  return -1;
+  // Пометить блок как занятый
+  uint64_t byte_offset;
+  uint8_t bit_offset;
+  get_block_bitmap_offset(block_idx, &byte_offset, &bit_offset);
+  bitmap[byte_offset] |= (1 << bit_offset);
+
+  // Обновить счетчик и сдвинуть курсор за выделенный блок
+  sb->count_free_blocks--;
+  sb->next_free_block = block_idx + 1;
+
+  sifs_debug("Выделен блок %" PRId64 "\n", block_idx);
+  sifs_debug("Осталось свободных блоков: %" PRIu64 "\n", sb->count_free_blocks);
+  return block_idx;
 }
 
 void free_block(struct superblock* sb,
                 uint8_t* bitmap,
-                uint32_t block_idx) {
+                uint64_t block_idx) {
   // Проверка валидности
   if (block_idx < sb->first_block_data || block_idx >= sb->count_blocks) {
-    sifs_debug("Недопустимый блок для освобождения: %u\n", block_idx);
+    sifs_debug("Недопустимый блок для освобождения: %" PRIu64 "\n", block_idx);
     return;
   }
 
   if (!is_block_allocated(sb, bitmap, block_idx)) {
-    sifs_debug("Блок %u уже свободен\n", block_idx);
+    sifs_debug("Блок %" PRIu64 " уже свободен\n", block_idx);
     return;
   }
 
   // Снять отметку
-  uint32_t byte_offset;
+  uint64_t byte_offset;
   uint8_t bit_offset;
   get_block_bitmap_offset(block_idx, &byte_offset, &bit_offset);
   bitmap[byte_offset] &= ~(1 << bit_offset);
@@ -132,54 +146,150 @@ void free_block(struct superblock* sb,
   // Обновить счетчик
   sb->count_free_blocks++;
 
-  sifs_debug("Освобожден блок %u\n", block_idx);
-  sifs_debug("Новое количество свободных: %u\n", sb->count_free_blocks);
+  sifs_debug("Освобожден блок %" PRIu64 "\n", block_idx);
+  sifs_debug("Новое количество свободных: %" PRIu64 "\n", sb->count_free_blocks);
 }
 
-uint32_t count_free_blocks(const struct superblock* sb, const uint8_t* bitmap) {
-  sifs_debug("Подсчет свободных блоков\n");
+// Кандидат на выделение экстента
+struct extent_candidate {
+  uint64_t start;
+  uint64_t len;
+};
+
+// Первый свободный бит в [from, to): по сводке, если она есть
+static int64_t find_zero(const uint8_t* bitmap,
+                         const struct bitmap_index* index,
+                         uint64_t from, uint64_t to) {
+  if (!index) return bitmap_find_zero(bitmap, from, to);
+  if (from >= to) return -1;
+  int64_t bit = bitmap_index_find_zero(index, bitmap, from);
+  return (uint64_t)bit < to ? bit : -1;
+}
+
+// Перебирает свободные отрезки в [from, to), обновляя лучший и самый длинный.
+// Возвращает true, если найден отрезок, завершающий поиск досрочно.
+static bool scan_free_runs(const uint8_t* bitmap,
+                           const struct bitmap_index* index,
+                           uint64_t from, uint64_t to,
+                           uint32_t want, enum extent_policy policy,
+                           struct extent_candidate* best,
+                           struct extent_candidate* longest) {
+  int64_t run_start = find_zero(bitmap, index, from, to);
+
+  while (run_start >= 0) {
+    int64_t run_end = bitmap_find_one(bitmap, run_start, to);
+    if (run_end < 0) run_end = to;
+    uint64_t run_len = run_end - run_start;
+
+    if (run_len > longest->len) {
+      longest->start = run_start;
+      longest->len = run_len;
+    }
 
-  uint32_t count = 0;
-  const uint32_t total_bytes = (sb->count_blocks + 7) / 8;
-
-  // Lookup-таблица для подсчета нулевых битов
-  static const uint8_t lookup_table[256] = {
-    8,7,7,6,7,6,6,5,7,6,6,5,6,5,5,4,7,6,6,5,6,5,5,4,6,5,5,4,5,4,4,3,
-    7,6,6,5,6,5,5,4,6,5,5,4,5,4,4,3,6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,
-    7,6,6,5,6,5,5,4,6,5,5,4,5,4,4,3,6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,
-    6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,5,4,4,3,4,3,3,2,4,3,3,2,3,2,2,1,
-    7,6,6,5,6,5,5,4,6,5,5,4,5,4,4,3,6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,
-    6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,5,4,4,3,4,3,3,2,4,3,3,2,3,2,2,1,
-    6,5,5,4,5,4,4,3,5,4,4,3,4,3,3,2,5,4,4,3,4,3,3,2,4,3,3,2,3,2,2,1,
-    5,4,4,3,4,3,3,2,4,3,3,2,3,2,2,1,4,3,3,2,3,2,2,1,3,2,2,1,2,1,1,0
-  };
-
-  // Подсчет свободных блоков во всей карте
-  for (uint32_t i = 0; i < total_bytes; i++) {
-    count += lookup_table[bitmap[i]];
+    if (run_len >= want && (best->len == 0 || run_len < best->len)) {
+      best->start = run_start;
+      best->len = run_len;
+      // Первый подходящий или точное совпадение завершают поиск
+      if (policy == EXTENT_FIRST_FIT || run_len == want) return true;
+    }
+
+    run_start = find_zero(bitmap, index, run_end, to);
   }
 
-  // Корректировка для последнего байта
-  if (sb->count_blocks % 8 != 0) {
-    uint8_t mask = (1 << (sb->count_blocks % 8)) - 1;
-    count -= lookup_table[bitmap[total_bytes - 1] | ~mask];
+  return false;
+}
+
+uint32_t find_free_extent(const uint8_t* bitmap,
+                          const struct bitmap_index* index,
+                          uint64_t from,
+                          uint64_t to,
+                          uint64_t cursor,
+                          uint32_t want,
+                          enum extent_policy policy,
+                          uint64_t* start) {
+  sifs_debug("Поиск экстента из %u блоков (%s)\n", want,
+             policy == EXTENT_BEST_FIT ? "best-fit" : "first-fit");
+
+  struct extent_candidate best = {0, 0};
+  struct extent_candidate longest = {0, 0};
+  if (want == 0) return 0;
+
+  if (policy == EXTENT_FIRST_FIT) {
+    // Как и allocate_block, начинаем с курсора и переходим в начало
+    if (cursor < from || cursor >= to) cursor = from;
+    if (!scan_free_runs(bitmap, index, cursor, to, want, policy, &best,
+                        &longest)) {
+      scan_free_runs(bitmap, index, from, cursor, want, policy, &best,
+                     &longest);
+    }
+  } else {
+    scan_free_runs(bitmap, index, from, to, want, policy, &best, &longest);
   }
 
-  // Вычитаем системные блоки (они не входят в область данных)
-  uint32_t meta_blocks =
-      1 +
-      sb->count_inode_bitmap_blocks +
-      sb->count_block_bitmap_blocks +
-      sb->count_inode_table_blocks;
+  // Нет отрезка нужной длины - отдаем самый длинный
+  struct extent_candidate chosen = best.len ? best : longest;
+  if (chosen.len > want) chosen.len = want;
+  *start = chosen.start;
+
+  sifs_debug("Найден экстент [%" PRIu64 ", %" PRIu64 ")\n", chosen.start,
+             chosen.start + chosen.len);
+  return chosen.len;
+}
+
+void free_extent(struct superblock* sb,
+                 uint8_t* bitmap,
+                 uint64_t start,
+                 uint64_t len) {
+  // Проверка валидности
+  if (start < sb->first_block_data || start >= sb->count_blocks ||
+      len > sb->count_blocks - start) {
+    sifs_debug("Недопустимый экстент для освобождения: [%" PRIu64 ", +%" PRIu64 ")\n",
+               start, len);
+    return;
+  }
+
+  // Уже свободные блоки счетчик не увеличивают
+  uint64_t allocated = bitmap_count_ones(bitmap, start, len);
+  bitmap_clear_range(bitmap, start, len);
+  sb->count_free_blocks += allocated;
+
+  sifs_debug("Освобожден экстент [%" PRIu64 ", %" PRIu64 "), занятых было %" PRIu64 "\n",
+             start, start + len, allocated);
+}
+
+static int64_t bitmap_alloc(struct block_allocator* base) {
+  struct bitmap_allocator* alloc = (struct bitmap_allocator*)base;
+  return allocate_block(alloc->sb, alloc->bitmap);
+}
+
+static void bitmap_free(struct block_allocator* base, uint64_t start,
+                        uint64_t len) {
+  struct bitmap_allocator* alloc = (struct bitmap_allocator*)base;
+  free_extent(alloc->sb, alloc->bitmap, start, len);
+}
+
+void bitmap_allocator_init(struct bitmap_allocator* alloc,
+                           struct superblock* sb,
+                           uint8_t* bitmap) {
+  alloc->base.alloc = bitmap_alloc;
+  alloc->base.free = bitmap_free;
+  alloc->sb = sb;
+  alloc->bitmap = bitmap;
+}
+
+uint64_t count_free_blocks(const struct superblock* sb, const uint8_t* bitmap) {
+  sifs_debug("Подсчет свободных блоков\n");
 
-  count -= meta_blocks;
+  // Системные блоки помечены в карте, поэтому свободные - это нулевые биты
+  uint64_t count = sb->count_blocks -
+      bitmap_count_ones(bitmap, 0, sb->count_blocks);
 
   // Проверка согласованности
   if (count != sb->count_free_blocks) {
-    sifs_debug("Расхождение! Подсчет: %u, суперблок: %u\n",
+    sifs_warn("Расхождение! Подсчет: %" PRIu64 ", суперблок: %" PRIu64 "\n",
                count, sb->count_free_blocks);
   } else {
-    sifs_debug("Свободных блоков: %u (совпадает с суперблоком)\n", count);
+    sifs_debug("Свободных блоков: %" PRIu64 " (совпадает с суперблоком)\n", count);
   }
 
   return count;
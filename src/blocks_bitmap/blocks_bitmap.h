@@ -1,26 +1,97 @@
 #pragma once
 
+#include "../bitmap_index/bitmap_index.h"
 #include "../superblock/superblock.h"
 #include <stdbool.h>
+#include <stddef.h>
+
+// Стратегия поиска непрерывного экстента
+enum extent_policy {
+  EXTENT_FIRST_FIT,   // Первый подходящий отрезок от курсора
+  EXTENT_BEST_FIT     // Наименьший подходящий отрезок во всей области
+};
 
 // Рассчитывает смещение в битовой карте блоков
-extern void get_block_bitmap_offset(uint32_t block_idx,
-                                          uint32_t* byte_offset,
+extern void get_block_bitmap_offset(uint64_t block_idx,
+                                          uint64_t* byte_offset,
                                           uint8_t* bit_offset);
 
+// Заполняет chunk начальным содержимым байтов [first_byte, first_byte + size)
+// битовой карты блоков. Позволяет записывать карту порциями, не держа ее
+// в памяти целиком
+extern void block_bitmap_init_range(const struct superblock* sb,
+                                    uint8_t* chunk,
+                                    uint64_t first_byte,
+                                    size_t size);
+
 // Инициализирует битовую карту блоков (помечает системные блоки)
 extern void block_bitmap_init(struct superblock* sb, uint8_t* bitmap);
 
 // Проверяет, занят ли указанный блок данных
 extern bool is_block_allocated(const struct superblock* sb,
                         const uint8_t* bitmap,
-                        uint32_t block_idx);
+                        uint64_t block_idx);
 
-// Выделяет свободный блок и возвращает его индекс
+// Выделяет свободный блок и возвращает его индекс.
+// Поиск идет пословно от курсора sb->next_free_block с переходом в начало
 extern int64_t allocate_block(struct superblock* sb, uint8_t* bitmap);
 
 // Освобождает указанный блок
-extern void free_block(struct superblock* sb, uint8_t* bitmap, uint32_t block_idx);
+extern void free_block(struct superblock* sb, uint8_t* bitmap, uint64_t block_idx);
+
+// Ищет непрерывный отрезок до want свободных бит карты в [from, to):
+// first-fit - первый отрезок не короче want от cursor до to, затем от from
+// до cursor; best-fit - самый короткий такой отрезок во всей области.
+// Если отрезка нужной длины нет, берет самый длинный из свободных.
+// Сводка index (может быть NULL) ускоряет пропуск занятых слов. Карту не
+// меняет. Возвращает длину отрезка (не больше want, 0 - свободных бит
+// нет), начало - в start
+extern uint32_t find_free_extent(const uint8_t* bitmap,
+                                 const struct bitmap_index* index,
+                                 uint64_t from,
+                                 uint64_t to,
+                                 uint64_t cursor,
+                                 uint32_t want,
+                                 enum extent_policy policy,
+                                 uint64_t* start);
+
+// Освобождает непрерывный отрезок блоков
+extern void free_extent(struct superblock* sb,
+                        uint8_t* bitmap,
+                        uint64_t start,
+                        uint64_t len);
+
+// Источник блоков для структур файла: блоков указателей, узлов дерева
+// экстентов, блоков каталогов и перенесенных встроенных данных.
+// Смонтированная ФС выделяет их через группы блоков (с учетом счетчиков
+// групп), mkfs - прямо по битовой карте (bitmap_allocator)
+struct block_allocator {
+  // Выделяет блок. Возвращает его номер или -1, если места нет
+  int64_t (*alloc)(struct block_allocator* alloc);
+  // Освобождает len блоков с start
+  void (*free)(struct block_allocator* alloc, uint64_t start, uint64_t len);
+};
+
+static inline int64_t block_alloc(struct block_allocator* alloc) {
+  return alloc->alloc(alloc);
+}
+
+static inline void block_free(struct block_allocator* alloc, uint64_t start,
+                              uint64_t len) {
+  alloc->free(alloc, start, len);
+}
+
+// Источник блоков поверх битовой карты в памяти: allocate_block и
+// free_extent без блокировок
+struct bitmap_allocator {
+  struct block_allocator base;
+  struct superblock* sb;
+  uint8_t* bitmap;
+};
+
+extern void bitmap_allocator_init(struct bitmap_allocator* alloc,
+                                  struct superblock* sb,
+                                  uint8_t* bitmap);
 
 // Подсчитывает количество свободных блоков данных
-extern uint32_t count_free_blocks(const struct superblock* sb, const uint8_t* bitmap);
+extern uint64_t count_free_blocks(const struct superblock* sb, const uint8_t* bitmap);
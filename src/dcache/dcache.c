@@ -0,0 +1,155 @@
+#include "dcache.h"
+#include <stdlib.h>
+#include <string.h>
+#include "../debug/debug.h"
+#include "../directory/directory.h"
+
+static uint32_t bucket_of(const struct dcache* cache, uint32_t parent,
+                          uint32_t hash) {
+  uint64_t key = ((uint64_t)parent << 32) | hash;
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & cache->hash_mask;
+}
+
+// Ищет запись. Возвращает индекс или -1
+static int32_t find(const struct dcache* cache, uint32_t parent,
+                    uint32_t hash, const char* name, size_t len) {
+  int32_t i = cache->hash[bucket_of(cache, parent, hash)];
+  while (i >= 0) {
+    const struct dentry* d = &cache->entries[i];
+    if (d->parent == parent && d->hash == hash && d->name_len == len &&
+        memcmp(d->name, name, len) == 0) {
+      return i;
+    }
+    i = d->hash_next;
+  }
+  return -1;
+}
+
+static void hash_insert(struct dcache* cache, int32_t i) {
+  struct dentry* d = &cache->entries[i];
+  uint32_t bucket = bucket_of(cache, d->parent, d->hash);
+  d->hash_next = cache->hash[bucket];
+  cache->hash[bucket] = i;
+}
+
+static void hash_remove(struct dcache* cache, int32_t i) {
+  struct dentry* d = &cache->entries[i];
+  int32_t* link = &cache->hash[bucket_of(cache, d->parent, d->hash)];
+  while (*link != i) link = &cache->entries[*link].hash_next;
+  *link = d->hash_next;
+  d->valid = false;
+}
+
+// Выбирает запись для замены по алгоритму CLOCK
+static int32_t evict(struct dcache* cache) {
+  for (;;) {
+    int32_t i = cache->clock_hand;
+    struct dentry* d = &cache->entries[i];
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+    if (!d->valid) return i;
+    if (d->referenced) {
+      d->referenced = false;
+      continue;
+    }
+    hash_remove(cache, i);
+    cache->stats.evictions++;
+    return i;
+  }
+}
+
+struct dcache* dcache_create(uint32_t capacity) {
+  if (capacity == 0) capacity = DCACHE_DEFAULT_CAPACITY;
+
+  struct dcache* cache = calloc(1, sizeof(*cache));
+  if (!cache) return NULL;
+
+  uint32_t buckets = 1;
+  while (buckets < 2 * capacity) buckets <<= 1;
+
+  cache->capacity = capacity;
+  cache->hash_mask = buckets - 1;
+  cache->hash = malloc(buckets * sizeof(int32_t));
+  cache->entries = calloc(capacity, sizeof(struct dentry));
+  if (!cache->hash || !cache->entries) {
+    free(cache->hash);
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+
+  memset(cache->hash, 0xFF, buckets * sizeof(int32_t));  // Все цепочки -1
+  pthread_mutex_init(&cache->lock, NULL);
+
+  sifs_debug("Кэш записей каталогов: %u записей\n", capacity);
+  return cache;
+}
+
+void dcache_destroy(struct dcache* cache) {
+  if (!cache) return;
+  pthread_mutex_destroy(&cache->lock);
+  free(cache->hash);
+  free(cache->entries);
+  free(cache);
+}
+
+bool dcache_lookup(struct dcache* cache,
+                   uint32_t parent,
+                   const char* name,
+                   size_t len,
+                   uint32_t* ino) {
+  if (len > DCACHE_NAME_LEN) return false;
+
+  uint32_t hash = dir_hash(name, len);
+  pthread_mutex_lock(&cache->lock);
+
+  int32_t i = find(cache, parent, hash, name, len);
+  if (i < 0) {
+    cache->stats.misses++;
+  } else {
+    struct dentry* d = &cache->entries[i];
+    d->referenced = true;
+    *ino = d->inode;
+    if (d->inode) {
+      cache->stats.hits++;
+    } else {
+      cache->stats.negative_hits++;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+  return i >= 0;
+}
+
+void dcache_insert(struct dcache* cache,
+                   uint32_t parent,
+                   const char* name,
+                   size_t len,
+                   uint32_t ino) {
+  if (len > DCACHE_NAME_LEN) return;
+
+  uint32_t hash = dir_hash(name, len);
+  pthread_mutex_lock(&cache->lock);
+
+  int32_t i = find(cache, parent, hash, name, len);
+  if (i < 0) {
+    i = evict(cache);
+    struct dentry* d = &cache->entries[i];
+    d->parent = parent;
+    d->hash = hash;
+    d->name_len = len;
+    memcpy(d->name, name, len);
+    d->valid = true;
+    hash_insert(cache, i);
+  }
+  cache->entries[i].inode = ino;
+  cache->entries[i].referenced = true;
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void dcache_get_stats(struct dcache* cache, struct dcache_stats* stats) {
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// Число записей кэша по умолчанию
+#define DCACHE_DEFAULT_CAPACITY 4096
+
+// Имена длиннее хранятся в каталоге, но не кэшируются
+#define DCACHE_NAME_LEN 40
+
+// Запись кэша: (каталог, имя) -> inode. inode == 0 - отрицательная
+// запись (имени в каталоге нет)
+struct dentry {
+  uint32_t parent;                // Inode каталога
+  uint32_t inode;                 // Inode записи или 0
+  uint32_t hash;                  // Хэш имени (dir_hash)
+  uint8_t name_len;
+  bool valid;                     // Запись занята
+  bool referenced;                // Бит обращения для алгоритма CLOCK
+  int32_t hash_next;              // Следующая запись в цепочке хэш-таблицы
+  char name[DCACHE_NAME_LEN];
+};
+
+// Счетчики кэша
+struct dcache_stats {
+  uint64_t hits;                  // Найдена положительная запись
+  uint64_t negative_hits;         // Найдена отрицательная запись
+  uint64_t misses;                // Записи нет в кэше
+  uint64_t evictions;             // Записи, вытесненные CLOCK
+};
+
+// Кэш записей каталогов с вытеснением CLOCK. Все операции защищены
+// одной блокировкой.
+struct dcache {
+  uint32_t capacity;
+  uint32_t hash_mask;
+  int32_t* hash;                  // Головы цепочек по (каталог, хэш имени)
+  struct dentry* entries;
+  uint32_t clock_hand;
+  struct dcache_stats stats;
+  pthread_mutex_t lock;
+};
+
+// Создает кэш на capacity записей (0 - DCACHE_DEFAULT_CAPACITY).
+// Возвращает NULL при ошибке
+extern struct dcache* dcache_create(uint32_t capacity);
+
+// Освобождает кэш
+extern void dcache_destroy(struct dcache* cache);
+
+// Ищет имя в каталоге parent. Возвращает true, если запись найдена:
+// ino - номер inode или 0 для отрицательной записи
+extern bool dcache_lookup(struct dcache* cache,
+                          uint32_t parent,
+                          const char* name,
+                          size_t len,
+                          uint32_t* ino);
+
+// Запоминает результат поиска (ino == 0 - имени нет). Создание и
+// удаление записи каталога заменяют ею прежний результат
+extern void dcache_insert(struct dcache* cache,
+                          uint32_t parent,
+                          const char* name,
+                          size_t len,
+                          uint32_t ino);
+
+// Копирует текущие счетчики кэша
+extern void dcache_get_stats(struct dcache* cache, struct dcache_stats* stats);
@@ -0,0 +1,21 @@
+#include "debug.h"
+#include <stdlib.h>
+
+// В отладочной сборке трассировка видна сразу, в релизной - только
+// предупреждения и ошибки
+#ifdef SIFS_DEBUG
+int32_t sifs_log_level = SIFS_LOG_DEBUG;
+#else
+int32_t sifs_log_level = SIFS_LOG_WARN;
+#endif
+
+void sifs_set_log_level(int32_t level) {
+  if (level < SIFS_LOG_ERROR) level = SIFS_LOG_ERROR;
+  if (level > SIFS_LOG_DEBUG) level = SIFS_LOG_DEBUG;
+  sifs_log_level = level;
+}
+
+void sifs_log_level_from_env(void) {
+  const char* value = getenv("SIFS_LOG_LEVEL");
+  if (value && *value) sifs_set_log_level(atoi(value));
+}
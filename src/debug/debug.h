@@ -1,7 +1,9 @@
 #pragma once
 
-// Глобальная отладка
-#define SIFS_DEBUG
+// Отладочная трассировка (sifs_debug) включается при сборке флагом
+// -DSIFS_DEBUG (make / make debug) и полностью удаляется из релизной
+// сборки (make release). Сообщения вне горячих путей выводятся через
+// sifs_error/sifs_warn/sifs_info и фильтруются уровнем во время работы.
 
 // Определяем, компилируем ли для ядра Linux
 #ifdef __KERNEL__
@@ -11,6 +13,39 @@
 #else
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#endif
+
+// Уровни журналирования
+#define SIFS_LOG_ERROR 0    // Ошибки
+#define SIFS_LOG_WARN  1    // Предупреждения (по умолчанию)
+#define SIFS_LOG_INFO  2    // Информационные сообщения
+#define SIFS_LOG_DEBUG 3    // Подробные сообщения
+
+#ifdef __KERNEL__
+// Реализация для ядра Linux: фильтрацию выполняет printk
+#define sifs_error(fmt, ...) printk(KERN_ERR "SIFS: " fmt, ##__VA_ARGS__)
+#define sifs_warn(fmt, ...) printk(KERN_WARNING "SIFS: " fmt, ##__VA_ARGS__)
+#define sifs_info(fmt, ...) printk(KERN_INFO "SIFS: " fmt, ##__VA_ARGS__)
+#else
+// Текущий уровень журналирования (меняется во время работы)
+extern int32_t sifs_log_level;
+
+// Устанавливает уровень журналирования
+extern void sifs_set_log_level(int32_t level);
+
+// Читает уровень из переменной окружения SIFS_LOG_LEVEL (0-3)
+extern void sifs_log_level_from_env(void);
+
+#define sifs_log(level, tag, fmt, ...) \
+do { \
+  if ((level) <= sifs_log_level) { \
+    fprintf(stderr, "SIFS " tag ": " fmt, ##__VA_ARGS__); \
+  } \
+} while (0)
+#define sifs_error(fmt, ...) sifs_log(SIFS_LOG_ERROR, "ERROR", fmt, ##__VA_ARGS__)
+#define sifs_warn(fmt, ...) sifs_log(SIFS_LOG_WARN, "WARN", fmt, ##__VA_ARGS__)
+#define sifs_info(fmt, ...) sifs_log(SIFS_LOG_INFO, "INFO", fmt, ##__VA_ARGS__)
 #endif
 
 #ifdef SIFS_DEBUG
@@ -21,6 +56,23 @@ do { \
   printk(KERN_DEBUG "SIFS DEBUG (%s:%d %s): " fmt, __FILE__, __LINE__, \
     __func__, ##__VA_ARGS__); \
 } while (0)
+#else
+// Реализация для пользовательского пространства
+#define sifs_debug(fmt, ...) \
+do { \
+  if (sifs_log_level >= SIFS_LOG_DEBUG) { \
+    fprintf(stderr, "SIFS DEBUG (%s:%d %s): " fmt, __FILE__, __LINE__, \
+      __func__, ##__VA_ARGS__); \
+  } \
+} while (0)
+#endif
+#else
+// Пустой макрос: трассировка горячих путей не компилируется
+#define sifs_debug(fmt, ...)  ((void)0)
+#endif
+
+#ifndef NDEBUG
+#ifdef __KERNEL__
 #define sifs_assert(expr) \
 do { \
   if (!(expr)) { \
@@ -30,12 +82,6 @@ do { \
   } \
 } while (0)
 #else
-// Реализация для пользовательского пространства
-#define sifs_debug(fmt, ...) \
-do { \
-  fprintf(stderr, "SIFS DEBUG (%s:%d %s): " fmt, __FILE__, __LINE__, __func__, \
-    ##__VA_ARGS__); \
-} while (0)
 #define sifs_assert(expr) \
 do { \
   if (!(expr)) { \
@@ -46,7 +92,6 @@ do { \
 } while (0)
 #endif
 #else
-// Пустые макросы, если отладка отключена
-#define sifs_debug(fmt, ...)  ((void)0)
+// Проверки отключаются в релизной сборке
 #define sifs_assert(expr)     ((void)0)
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,610 @@
+#include "directory.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../block_map/block_map.h"
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../debug/debug.h"
+
+// Каждая попытка вставки делит не больше одного листа; длинному имени в
+// маленьком блоке может понадобиться несколько делений
+#define DIR_INSERT_RETRIES 8
+
+// Длина записи с именем из len байт
+static uint16_t rec_len_for(size_t len) {
+  return (sizeof(struct dir_entry) + len + 7) & ~7u;
+}
+
+uint32_t dir_hash(const char* name, size_t len) {
+  // FNV-1a (64 бита) со сверткой старшей половины в младшую
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)name[i];
+    h *= 0x100000001B3ULL;
+  }
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+static struct dir_index_entry* index_entries(uint8_t* buf) {
+  return (struct dir_index_entry*)(buf + sizeof(struct dir_index_header));
+}
+
+static uint16_t index_max(const struct superblock* sb) {
+  return (sb->block_size - sizeof(struct dir_index_header)) /
+         sizeof(struct dir_index_entry);
+}
+
+// Двоичный поиск последней записи индекса с хэшем <= hash
+static int32_t index_search(uint8_t* buf, uint32_t hash) {
+  struct dir_index_header* h = (struct dir_index_header*)buf;
+  struct dir_index_entry* e = index_entries(buf);
+  int32_t lo = 1, hi = (int32_t)h->count - 1, found = 0;
+  while (lo <= hi) {
+    int32_t mid = lo + (hi - lo) / 2;
+    if (e[mid].hash <= hash) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+// Проверяет индексный блок. depth < 0 - глубина не проверяется (корень)
+static bool index_valid(const struct superblock* sb, uint8_t* buf,
+                        int32_t depth) {
+  struct dir_index_header* h = (struct dir_index_header*)buf;
+  return h->magic == DIR_INDEX_MAGIC && h->count >= 1 &&
+         h->count <= index_max(sb) && h->depth <= DIR_MAX_DEPTH &&
+         (depth < 0 || h->depth == depth);
+}
+
+// Байт листа, доступных под заголовок и записи. dir_leaf_header::used
+// 16-битный, поэтому в блоке 64 КиБ последние 8 байт не используются
+static uint32_t leaf_capacity(const struct superblock* sb) {
+  uint32_t max = UINT16_MAX & ~7u;
+  return sb->block_size < max ? sb->block_size : max;
+}
+
+static bool leaf_valid(const struct superblock* sb, uint8_t* buf) {
+  struct dir_leaf_header* h = (struct dir_leaf_header*)buf;
+  return h->magic == DIR_LEAF_MAGIC &&
+         h->used >= sizeof(struct dir_leaf_header) &&
+         h->used <= leaf_capacity(sb);
+}
+
+// Проверяет запись листа по смещению off
+static bool entry_valid(uint8_t* leaf, uint32_t off) {
+  struct dir_leaf_header* h = (struct dir_leaf_header*)leaf;
+  if (off + sizeof(struct dir_entry) > h->used) return false;
+  struct dir_entry* e = (struct dir_entry*)(leaf + off);
+  return e->rec_len >= rec_len_for(e->name_len) && (e->rec_len & 7) == 0 &&
+         off + e->rec_len <= h->used;
+}
+
+static int32_t corrupted(uint32_t logical) {
+  sifs_error("Поврежденный блок %u каталога\n", logical);
+  errno = EIO;
+  return -1;
+}
+
+// Читает логический блок каталога, физический номер - в phys
+static int32_t read_block(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          const struct inode* dir, uint32_t logical,
+                          uint8_t* buf, uint64_t* phys) {
+  if ((uint64_t)logical >= dir->size / sb->block_size) {
+    return corrupted(logical);
+  }
+  if (block_map_resolve(bcache, sb, dir, logical, phys) < 0) return -1;
+  if (*phys == 0) return corrupted(logical);
+
+  return block_cache_read(bcache, *phys, 0, buf, sb->block_size);
+}
+
+static int32_t write_block(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           uint64_t phys, const uint8_t* buf) {
+  return block_cache_write(bcache, phys, 0, buf, sb->block_size);
+}
+
+// Дописывает блок в конец каталога. Возвращает логический номер блока
+// (физический - в phys) или -1
+static int64_t append_block(struct block_cache* bcache,
+                            const struct superblock* sb,
+                            struct block_allocator* alloc, struct inode* dir,
+                            uint64_t* phys) {
+  uint64_t logical = dir->size / sb->block_size;
+  if (logical > UINT32_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  int64_t block = block_alloc(alloc);
+  if (block < 0) {
+    errno = ENOSPC;
+    return -1;
+  }
+  if (block_map_assign(bcache, sb, alloc, dir, logical, block) < 0) {
+    block_free(alloc, block, 1);
+    return -1;
+  }
+
+  dir->size += sb->block_size;
+  *phys = block;
+  return logical;
+}
+
+// Спускается по индексу к листу, в котором должен лежать hash
+static int32_t find_leaf(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         const struct inode* dir, uint32_t hash,
+                         uint8_t* buf, uint64_t* phys) {
+  if (read_block(bcache, sb, dir, 0, buf, phys) < 0) return -1;
+  if (!index_valid(sb, buf, -1)) return corrupted(0);
+
+  int32_t depth = ((struct dir_index_header*)buf)->depth;
+  for (;;) {
+    uint32_t child = index_entries(buf)[index_search(buf, hash)].block;
+    if (read_block(bcache, sb, dir, child, buf, phys) < 0) return -1;
+
+    if (depth == 0) {
+      return leaf_valid(sb, buf) ? 0 : corrupted(child);
+    }
+    if (!index_valid(sb, buf, --depth)) return corrupted(child);
+  }
+}
+
+// Ищет имя в листе. Возвращает смещение записи, 0, если имени нет,
+// или -1 для поврежденного листа
+static int32_t leaf_find(uint8_t* leaf, const char* name, size_t len) {
+  struct dir_leaf_header* h = (struct dir_leaf_header*)leaf;
+  for (uint32_t off = sizeof(*h); off < h->used;) {
+    if (!entry_valid(leaf, off)) {
+      errno = EIO;
+      return -1;
+    }
+    struct dir_entry* e = (struct dir_entry*)(leaf + off);
+    if (e->name_len == len && memcmp(e->name, name, len) == 0) return off;
+    off += e->rec_len;
+  }
+  return 0;
+}
+
+// Имя записи: от 1 до MAX_FILENAME байт без '/'
+static bool name_valid(const char* name, size_t len) {
+  if (len == 0 || len > MAX_FILENAME) {
+    errno = len ? ENAMETOOLONG : ENOENT;
+    return false;
+  }
+  if (memchr(name, '/', len)) {
+    errno = EINVAL;
+    return false;
+  }
+  return true;
+}
+
+int32_t dir_lookup(struct block_cache* bcache,
+                   const struct superblock* sb,
+                   const struct inode* dir,
+                   const char* name,
+                   size_t len,
+                   uint32_t* ino) {
+  if (!name_valid(name, len)) return -1;
+
+  uint8_t* buf = malloc(sb->block_size);
+  if (!buf) return -1;
+
+  uint64_t phys;
+  int32_t off = -1;
+  if (find_leaf(bcache, sb, dir, dir_hash(name, len), buf, &phys) == 0) {
+    off = leaf_find(buf, name, len);
+    if (off == 0) {
+      errno = ENOENT;
+      off = -1;
+    }
+  }
+  if (off > 0) *ino = ((struct dir_entry*)(buf + off))->inode;
+
+  free(buf);
+  return off > 0 ? 0 : -1;
+}
+
+// Переносит корень в новый блок, увеличивая глубину индекса.
+// root - буфер корня (обновляется), tmp - рабочий буфер
+static int32_t grow_root(struct block_cache* bcache,
+                         const struct superblock* sb,
+                         struct block_allocator* alloc, struct inode* dir,
+                         uint8_t* root, uint64_t root_phys, uint8_t* tmp) {
+  struct dir_index_header* h = (struct dir_index_header*)root;
+  if (h->depth >= DIR_MAX_DEPTH) {
+    errno = ENOSPC;
+    return -1;
+  }
+
+  uint64_t phys;
+  int64_t logical = append_block(bcache, sb, alloc, dir, &phys);
+  if (logical < 0) return -1;
+
+  memcpy(tmp, root, sb->block_size);
+  if (write_block(bcache, sb, phys, tmp) < 0) return -1;
+
+  memset(root + sizeof(*h), 0, sb->block_size - sizeof(*h));
+  h->count = 1;
+  h->depth++;
+  index_entries(root)[0].hash = 0;
+  index_entries(root)[0].block = logical;
+  return write_block(bcache, sb, root_phys, root);
+}
+
+// Вставляет запись индекса в parent после позиции pos
+static int32_t index_insert(struct block_cache* bcache,
+                            const struct superblock* sb,
+                            uint8_t* parent, uint64_t parent_phys,
+                            int32_t pos, uint32_t hash, uint32_t block) {
+  struct dir_index_header* h = (struct dir_index_header*)parent;
+  struct dir_index_entry* e = index_entries(parent);
+  memmove(&e[pos + 2], &e[pos + 1],
+          (h->count - pos - 1) * sizeof(struct dir_index_entry));
+  e[pos + 1].hash = hash;
+  e[pos + 1].block = block;
+  h->count++;
+  return write_block(bcache, sb, parent_phys, parent);
+}
+
+// Делит заполненный индексный блок child пополам, верхняя половина
+// переходит в sib. Хэш и физический номер нового блока - в sib_hash/sib_phys
+static int32_t split_index(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           struct block_allocator* alloc, struct inode* dir,
+                           uint8_t* parent, uint64_t parent_phys, int32_t pos,
+                           uint8_t* child, uint64_t child_phys, uint8_t* sib,
+                           uint32_t* sib_hash, uint64_t* sib_phys) {
+  struct dir_index_header* ch = (struct dir_index_header*)child;
+  uint16_t at = ch->count / 2;
+
+  int64_t logical = append_block(bcache, sb, alloc, dir, sib_phys);
+  if (logical < 0) return -1;
+
+  memset(sib, 0, sb->block_size);
+  struct dir_index_header* sh = (struct dir_index_header*)sib;
+  sh->magic = DIR_INDEX_MAGIC;
+  sh->count = ch->count - at;
+  sh->depth = ch->depth;
+  memcpy(index_entries(sib), &index_entries(child)[at],
+         sh->count * sizeof(struct dir_index_entry));
+  ch->count = at;
+  *sib_hash = index_entries(sib)[0].hash;
+
+  if (write_block(bcache, sb, child_phys, child) < 0 ||
+      write_block(bcache, sb, *sib_phys, sib) < 0) {
+    return -1;
+  }
+  return index_insert(bcache, sb, parent, parent_phys, pos, *sib_hash, logical);
+}
+
+static int cmp_hash(const void* a, const void* b) {
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Делит лист по границе хэшей так, чтобы байты делились примерно поровну.
+// Записи с хэшем >= границы переносятся в новый лист
+static int32_t split_leaf(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          struct block_allocator* alloc, struct inode* dir,
+                          uint8_t* parent, uint64_t parent_phys, int32_t pos,
+                          uint8_t* leaf, uint64_t leaf_phys, uint8_t* sib) {
+  struct dir_leaf_header* lh = (struct dir_leaf_header*)leaf;
+  uint32_t n = lh->count;
+  uint32_t* hashes = malloc(2 * n * sizeof(uint32_t) + sizeof(uint32_t));
+  if (!hashes) return -1;
+  uint32_t* sorted = hashes + n;
+
+  // Хэши записей по порядку и отсортированная копия для выбора границы
+  uint32_t k = 0;
+  for (uint32_t off = sizeof(*lh); off < lh->used && k < n; k++) {
+    struct dir_entry* e = (struct dir_entry*)(leaf + off);
+    hashes[k] = dir_hash(e->name, e->name_len);
+    off += e->rec_len;
+  }
+  memcpy(sorted, hashes, n * sizeof(uint32_t));
+  qsort(sorted, n, sizeof(uint32_t), cmp_hash);
+
+  // Граница ближе всего к середине, не разрывающая одинаковые хэши
+  uint32_t split = 0;
+  for (uint32_t d = 0; d < n && !split; d++) {
+    if (n / 2 + d < n && n / 2 + d > 0 &&
+        sorted[n / 2 + d - 1] != sorted[n / 2 + d]) {
+      split = n / 2 + d;
+    } else if (d <= n / 2 && n / 2 - d > 0 &&
+               sorted[n / 2 - d - 1] != sorted[n / 2 - d]) {
+      split = n / 2 - d;
+    }
+  }
+  if (!split) {
+    // Все записи листа имеют один хэш - делить нечего
+    free(hashes);
+    errno = ENOSPC;
+    return -1;
+  }
+  uint32_t split_hash = sorted[split];
+
+  uint64_t sib_phys;
+  int64_t logical = append_block(bcache, sb, alloc, dir, &sib_phys);
+  if (logical < 0) {
+    free(hashes);
+    return -1;
+  }
+
+  memset(sib, 0, sb->block_size);
+  struct dir_leaf_header* sh = (struct dir_leaf_header*)sib;
+  sh->magic = DIR_LEAF_MAGIC;
+  sh->used = sizeof(*sh);
+
+  // Записи переносятся в новый лист, оставшиеся уплотняются на месте
+  uint32_t keep = sizeof(*lh);
+  uint32_t off = sizeof(*lh);
+  for (uint32_t i = 0; i < n; i++) {
+    struct dir_entry* e = (struct dir_entry*)(leaf + off);
+    uint16_t rec = e->rec_len;
+    if (hashes[i] >= split_hash) {
+      memcpy(sib + sh->used, e, rec);
+      sh->used += rec;
+      sh->count++;
+    } else {
+      memmove(leaf + keep, e, rec);
+      keep += rec;
+    }
+    off += rec;
+  }
+  memset(leaf + keep, 0, lh->used - keep);
+  lh->used = keep;
+  lh->count = n - sh->count;
+  free(hashes);
+
+  if (write_block(bcache, sb, leaf_phys, leaf) < 0 ||
+      write_block(bcache, sb, sib_phys, sib) < 0) {
+    return -1;
+  }
+  return index_insert(bcache, sb, parent, parent_phys, pos, split_hash,
+                      logical);
+}
+
+// Одна попытка вставки: спуск с делением заполненных индексных блоков.
+// Возвращает 0, 1, если пришлось делить лист (нужна новая попытка), или -1
+static int32_t insert_once(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           struct block_allocator* alloc, struct inode* dir,
+                           uint8_t* bufs, uint32_t hash,
+                           const struct dir_entry* rec) {
+  uint8_t* cur = bufs;
+  uint8_t* next = bufs + sb->block_size;
+  uint8_t* sib = bufs + 2 * (size_t)sb->block_size;
+  uint8_t* tmp;
+
+  uint64_t cur_phys;
+  if (read_block(bcache, sb, dir, 0, cur, &cur_phys) < 0) return -1;
+  if (!index_valid(sb, cur, -1)) return corrupted(0);
+
+  struct dir_index_header* h = (struct dir_index_header*)cur;
+  if (h->count == index_max(sb) &&
+      grow_root(bcache, sb, alloc, dir, cur, cur_phys, next) < 0) {
+    return -1;
+  }
+
+  // У родителя каждого делимого блока уже есть свободная запись
+  for (;;) {
+    int32_t pos = index_search(cur, hash);
+    uint32_t child = index_entries(cur)[pos].block;
+    uint64_t child_phys;
+    if (read_block(bcache, sb, dir, child, next, &child_phys) < 0) return -1;
+
+    if (h->depth == 0) {
+      if (!leaf_valid(sb, next)) return corrupted(child);
+
+      struct dir_leaf_header* leaf = (struct dir_leaf_header*)next;
+      if (leaf->used + rec->rec_len <= leaf_capacity(sb)) {
+        memcpy(next + leaf->used, rec, rec->rec_len);
+        leaf->used += rec->rec_len;
+        leaf->count++;
+        return write_block(bcache, sb, child_phys, next);
+      }
+
+      if (split_leaf(bcache, sb, alloc, dir, cur, cur_phys, pos,
+                     next, child_phys, sib) < 0) {
+        return -1;
+      }
+      return 1;
+    }
+
+    if (!index_valid(sb, next, h->depth - 1)) return corrupted(child);
+    if (((struct dir_index_header*)next)->count == index_max(sb)) {
+      uint32_t sib_hash;
+      uint64_t sib_phys;
+      if (split_index(bcache, sb, alloc, dir, cur, cur_phys, pos, next,
+                      child_phys, sib, &sib_hash, &sib_phys) < 0) {
+        return -1;
+      }
+      if (hash >= sib_hash) {
+        tmp = next; next = sib; sib = tmp;
+        child_phys = sib_phys;
+      }
+    }
+
+    tmp = cur; cur = next; next = tmp;
+    cur_phys = child_phys;
+    h = (struct dir_index_header*)cur;
+  }
+}
+
+int32_t dir_add(struct block_cache* bcache,
+                const struct superblock* sb,
+                struct block_allocator* alloc,
+                struct inode* dir,
+                const char* name,
+                size_t len,
+                uint32_t ino,
+                uint32_t mode) {
+  if (!name_valid(name, len)) return -1;
+
+  uint8_t* bufs = malloc(3 * (size_t)sb->block_size + rec_len_for(len));
+  if (!bufs) return -1;
+
+  // Запись собирается заранее, вставка копирует ее в лист целиком
+  struct dir_entry* rec = (struct dir_entry*)(bufs + 3 * (size_t)sb->block_size);
+  memset(rec, 0, rec_len_for(len));
+  rec->inode = ino;
+  rec->rec_len = rec_len_for(len);
+  rec->name_len = len;
+  rec->type = (mode & S_IFMT) >> 12;
+  memcpy(rec->name, name, len);
+
+  uint32_t hash = dir_hash(name, len);
+  uint64_t phys;
+  int32_t result = find_leaf(bcache, sb, dir, hash, bufs, &phys);
+  if (result == 0) {
+    int32_t off = leaf_find(bufs, name, len);
+    if (off != 0) {
+      if (off > 0) errno = EEXIST;
+      result = -1;
+    }
+  }
+
+  for (uint32_t i = 0; result == 0; i++) {
+    if (i == DIR_INSERT_RETRIES) {
+      errno = ENOSPC;
+      result = -1;
+      break;
+    }
+    result = insert_once(bcache, sb, alloc, dir, bufs, hash, rec);
+    if (result == 0) break;
+    if (result > 0) result = 0;
+  }
+
+  free(bufs);
+  return result;
+}
+
+int32_t dir_remove(struct block_cache* bcache,
+                   const struct superblock* sb,
+                   const struct inode* dir,
+                   const char* name,
+                   size_t len) {
+  if (!name_valid(name, len)) return -1;
+
+  uint8_t* buf = malloc(sb->block_size);
+  if (!buf) return -1;
+
+  uint64_t phys;
+  int32_t result = find_leaf(bcache, sb, dir, dir_hash(name, len), buf, &phys);
+  if (result == 0) {
+    int32_t off = leaf_find(buf, name, len);
+    if (off <= 0) {
+      if (off == 0) errno = ENOENT;
+      result = -1;
+    } else {
+      // Записи листа лежат подряд - сдвигаем хвост на место удаленной
+      struct dir_leaf_header* h = (struct dir_leaf_header*)buf;
+      uint16_t rec = ((struct dir_entry*)(buf + off))->rec_len;
+      memmove(buf + off, buf + off + rec, h->used - off - rec);
+      memset(buf + h->used - rec, 0, rec);
+      h->used -= rec;
+      h->count--;
+      result = write_block(bcache, sb, phys, buf);
+    }
+  }
+
+  free(buf);
+  return result;
+}
+
+int32_t dir_iterate(struct block_cache* bcache,
+                    const struct superblock* sb,
+                    const struct inode* dir,
+                    dir_iterate_fn fn,
+                    void* arg) {
+  uint8_t* buf = malloc(sb->block_size);
+  if (!buf) return -1;
+
+  struct dir_entry_info info;
+  uint64_t blocks = dir->size / sb->block_size;
+  int32_t result = 0;
+
+  // Листья распознаются по магическому числу, индексные блоки пропускаются
+  for (uint64_t logical = 1; logical < blocks && result == 0; logical++) {
+    uint64_t phys;
+    if (read_block(bcache, sb, dir, logical, buf, &phys) < 0) {
+      result = -1;
+      break;
+    }
+    if (((struct dir_leaf_header*)buf)->magic != DIR_LEAF_MAGIC) continue;
+    if (!leaf_valid(sb, buf)) {
+      result = corrupted(logical);
+      break;
+    }
+
+    struct dir_leaf_header* h = (struct dir_leaf_header*)buf;
+    for (uint32_t off = sizeof(*h); off < h->used && result == 0;) {
+      if (!entry_valid(buf, off)) {
+        result = corrupted(logical);
+        break;
+      }
+      struct dir_entry* e = (struct dir_entry*)(buf + off);
+      info.inode = e->inode;
+      info.type = e->type;
+      info.name_len = e->name_len;
+      memcpy(info.name, e->name, e->name_len);
+      info.name[e->name_len] = '\0';
+      result = fn(&info, arg);
+      off += e->rec_len;
+    }
+  }
+
+  free(buf);
+  return result;
+}
+
+int32_t dir_init(struct block_cache* bcache,
+                 const struct superblock* sb,
+                 struct block_allocator* alloc,
+                 struct inode* dir,
+                 uint32_t self,
+                 uint32_t parent) {
+  if (dir->size != 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  uint8_t* buf = calloc(1, sb->block_size);
+  if (!buf) return -1;
+
+  uint64_t root_phys, leaf_phys;
+  int32_t result = -1;
+  if (append_block(bcache, sb, alloc, dir, &root_phys) == 0 &&
+      append_block(bcache, sb, alloc, dir, &leaf_phys) == 1) {
+    struct dir_index_header* root = (struct dir_index_header*)buf;
+    root->magic = DIR_INDEX_MAGIC;
+    root->count = 1;
+    index_entries(buf)[0].block = 1;
+    result = write_block(bcache, sb, root_phys, buf);
+
+    memset(buf, 0, sb->block_size);
+    struct dir_leaf_header* leaf = (struct dir_leaf_header*)buf;
+    leaf->magic = DIR_LEAF_MAGIC;
+    leaf->used = sizeof(*leaf);
+    if (result == 0) result = write_block(bcache, sb, leaf_phys, buf);
+  }
+  free(buf);
+
+  if (result == 0) {
+    result = dir_add(bcache, sb, alloc, dir, ".", 1, self, S_IFDIR);
+  }
+  if (result == 0) {
+    result = dir_add(bcache, sb, alloc, dir, "..", 2, parent, S_IFDIR);
+  }
+  return result;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../block_cache/block_cache.h"
+#include "../inode_table/inode.h"
+#include "../superblock/superblock.h"
+
+#define DIR_INDEX_MAGIC 0x44494458    // Магическое число индексного блока "DIDX"
+#define DIR_LEAF_MAGIC 0x4449524C     // Магическое число листа "DIRL"
+#define DIR_MAX_DEPTH 4               // Максимальное число уровней индекса под корнем
+
+// Каталог хранится в блоках своего inode (через block_map).
+// Логический блок 0 - корень индекса; индекс - B+-дерево по 32-битному
+// хэшу имени, листья содержат записи переменной длины. Все записи с
+// одинаковым хэшем лежат в одном листе, поэтому поиск читает один блок
+// на уровень индекса и просматривает один лист.
+
+// Заголовок индексного блока, за ним - записи dir_index_entry,
+// упорядоченные по хэшу
+struct dir_index_header {
+  uint32_t magic;       // DIR_INDEX_MAGIC
+  uint16_t count;       // Число записей
+  uint16_t depth;       // Уровней индекса ниже (0 - потомки являются листьями)
+};
+
+// Запись индекса: хэши от hash до хэша следующей записи лежат в block
+struct dir_index_entry {
+  uint32_t hash;        // Наименьший хэш поддерева (у первой записи - 0)
+  uint32_t block;       // Логический блок потомка
+};
+
+// Заголовок листа, за ним подряд лежат записи dir_entry
+struct dir_leaf_header {
+  uint32_t magic;       // DIR_LEAF_MAGIC
+  uint16_t count;       // Число записей
+  uint16_t used;        // Занято байт, включая заголовок (не больше 65528)
+};
+
+// Запись каталога. Длина записи выровнена на 8 байт
+struct dir_entry {
+  uint32_t inode;       // Номер inode
+  uint16_t rec_len;     // Длина записи в байтах
+  uint8_t name_len;     // Длина имени (без завершающего нуля)
+  uint8_t type;         // Тип файла (mode & S_IFMT) >> 12
+  char name[];          // Имя без завершающего нуля
+};
+
+// Запись, передаваемая при обходе каталога
+struct dir_entry_info {
+  uint32_t inode;
+  uint8_t type;
+  uint8_t name_len;
+  char name[MAX_FILENAME + 1];  // Имя с завершающим нулем
+};
+
+// Функция обхода. Ненулевой результат прекращает обход и возвращается
+// из dir_iterate
+typedef int32_t (*dir_iterate_fn)(const struct dir_entry_info* entry,
+                                  void* arg);
+
+// Хэш имени для индекса каталога
+extern uint32_t dir_hash(const char* name, size_t len);
+
+// Создает пустой каталог в inode без блоков: корень индекса, лист и
+// записи "." и "..". Размер и адресация обновляются в dir, запись inode
+// остается вызывающему. Возвращает 0 или -1 при ошибке
+extern int32_t dir_init(struct block_cache* bcache,
+                        const struct superblock* sb,
+                        struct block_allocator* alloc,
+                        struct inode* dir,
+                        uint32_t self,
+                        uint32_t parent);
+
+// Ищет имя в каталоге и записывает номер inode в ino.
+// Возвращает 0 или -1 (errno = ENOENT, если имени нет)
+extern int32_t dir_lookup(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          const struct inode* dir,
+                          const char* name,
+                          size_t len,
+                          uint32_t* ino);
+
+// Добавляет запись. Заполненные листья и индексные блоки делятся, новые
+// блоки дописываются в конец каталога (dir нужно записать после вызова).
+// Возвращает 0 или -1 (errno = EEXIST, ENAMETOOLONG, ENOSPC, EIO)
+extern int32_t dir_add(struct block_cache* bcache,
+                       const struct superblock* sb,
+                       struct block_allocator* alloc,
+                       struct inode* dir,
+                       const char* name,
+                       size_t len,
+                       uint32_t ino,
+                       uint32_t mode);
+
+// Удаляет запись. Возвращает 0 или -1 (errno = ENOENT, если имени нет)
+extern int32_t dir_remove(struct block_cache* bcache,
+                          const struct superblock* sb,
+                          const struct inode* dir,
+                          const char* name,
+                          size_t len);
+
+// Обходит все записи каталога в порядке листьев.
+// Возвращает 0, результат fn, прервавший обход, или -1 при ошибке
+extern int32_t dir_iterate(struct block_cache* bcache,
+                           const struct superblock* sb,
+                           const struct inode* dir,
+                           dir_iterate_fn fn,
+                           void* arg);
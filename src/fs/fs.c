@@ -0,0 +1,1030 @@
+#include "fs.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../block_group/block_group.h"
+#include "../block_map/block_map.h"
+#include "../block_map/inline_data.h"
+#include "../block_map/map_cache.h"
+#include "../block_cache/block_cache.h"
+#include "../blocks_bitmap/blocks_bitmap.h"
+#include "../dcache/dcache.h"
+#include "../debug/debug.h"
+#include "../directory/directory.h"
+#include "../image/image.h"
+#include "../inode_cache/inode_cache.h"
+#include "../namei/namei.h"
+
+struct fs {
+  struct image* img;
+  struct superblock sb;
+  uint8_t* block_bitmap;                    // Копии карт (NULL при IMAGE_MMAP)
+  uint8_t* inode_bitmap;
+  // Все блоки и inode выделяются и освобождаются через группы (рядом с
+  // каталогом и inode файла), поэтому счетчики групп всегда совпадают
+  // с картами
+  struct block_groups* groups;
+  struct block_cache* bcache;               // Блоки метаданных
+  struct inode_cache* icache;
+  struct dcache* dcache;
+  uint8_t* zero_block;                      // Дополнение записи до блока
+  struct fs_file* files;                    // Открытые файлы
+  pthread_rwlock_t ns_lock;                 // Пространство имен
+  pthread_rwlock_t inode_locks[FS_INODE_LOCKS];
+  pthread_mutex_t sb_lock;                  // Запись суперблока
+  pthread_mutex_t files_lock;               // Список открытых файлов
+};
+
+struct fs_file {
+  struct fs* fs;
+  struct cached_inode* ci;
+  struct map_cache map;
+  pthread_mutex_t map_lock;       // Кэш отображения общий для потоков
+  struct fs_file* next;
+};
+
+static pthread_rwlock_t* inode_lock(struct fs* fs, uint32_t ino) {
+  return &fs->inode_locks[ino % FS_INODE_LOCKS];
+}
+
+// Источник блоков для структур файла: блоки берутся в группе его inode,
+// освобождение возвращает их в счетчики групп и сбрасывает их буферы в
+// кэше блоков
+struct group_allocator {
+  struct block_allocator base;
+  struct block_groups* groups;
+  struct block_cache* bcache;
+  uint32_t goal;
+};
+
+static int64_t group_alloc(struct block_allocator* alloc) {
+  struct group_allocator* ga = (struct group_allocator*)alloc;
+  return block_groups_alloc_block(ga->groups, ga->goal);
+}
+
+static void group_free(struct block_allocator* alloc, uint64_t start,
+                       uint64_t len) {
+  struct group_allocator* ga = (struct group_allocator*)alloc;
+  block_cache_invalidate(ga->bcache, start, len);
+  block_groups_free_run(ga->groups, start, len);
+}
+
+static void group_allocator_init(struct group_allocator* ga, struct fs* fs,
+                                 uint32_t ino) {
+  ga->base.alloc = group_alloc;
+  ga->base.free = group_free;
+  ga->groups = fs->groups;
+  ga->bcache = fs->bcache;
+  ga->goal = superblock_inode_group(&fs->sb, ino);
+}
+
+// Копирует поля суперблока [from, to)
+static void copy_sb_range(struct superblock* dst, const struct superblock* src,
+                          size_t from, size_t to) {
+  memcpy((uint8_t*)dst + from, (const uint8_t*)src + from, to - from);
+}
+
+// Записывает снимок суперблока (вызывается под sb_lock). Счетчики
+// свободного места группы меняют атомарно и без sb_lock, поэтому они
+// читаются отдельно от остальных полей
+static int32_t write_superblock(struct fs* fs) {
+  struct superblock sb;
+  size_t inodes = offsetof(struct superblock, count_free_inodes);
+  size_t blocks = offsetof(struct superblock, count_free_blocks);
+  copy_sb_range(&sb, &fs->sb, 0, inodes);
+  sb.count_free_inodes = __atomic_load_n(&fs->sb.count_free_inodes,
+                                         __ATOMIC_RELAXED);
+  copy_sb_range(&sb, &fs->sb, inodes + sizeof(sb.count_free_inodes), blocks);
+  sb.count_free_blocks = __atomic_load_n(&fs->sb.count_free_blocks,
+                                         __ATOMIC_RELAXED);
+  copy_sb_range(&sb, &fs->sb, blocks + sizeof(sb.count_free_blocks),
+                sizeof(sb));
+  return image_write(fs->img, &sb, sizeof(sb), 0) == (ssize_t)sizeof(sb)
+             ? 0 : -1;
+}
+
+// Освобождает ресурсы частично смонтированной ФС
+static void release(struct fs* fs) {
+  dcache_destroy(fs->dcache);
+  inode_cache_destroy(fs->icache);
+  block_cache_destroy(fs->bcache);
+  block_groups_close(fs->groups);
+  image_close(fs->img);
+  free(fs->block_bitmap);
+  free(fs->inode_bitmap);
+  free(fs->zero_block);
+  free(fs);
+}
+
+struct fs* fs_mount(const char* filename, const struct fs_options* options) {
+  static const struct fs_options defaults = { 0 };
+  if (!options) options = &defaults;
+
+  struct fs* fs = calloc(1, sizeof(*fs));
+  if (!fs) return NULL;
+
+  // Отображенный образ не растет: ФС пишет только внутри count_blocks
+  int32_t image_flags = options->flags & FS_MOUNT_MMAP ? IMAGE_MMAP : 0;
+  fs->img = image_open(filename, image_flags);
+  if (!fs->img) {
+    free(fs);
+    return NULL;
+  }
+
+  struct superblock* sb = &fs->sb;
+  if (image_read(fs->img, sb, sizeof(*sb), 0) != (ssize_t)sizeof(*sb) ||
+      !superblock_valid(sb)) {
+    sifs_error("%s не содержит ФС sifs ревизии %u\n", filename, FS_REVISION);
+    release(fs);
+    errno = EINVAL;
+    return NULL;
+  }
+  image_advise_layout(fs->img, sb);
+
+  // Карты отображенного образа группы меняют прямо в отображении
+  if (!image_data(fs->img, 0, sizeof(*sb))) {
+    fs->block_bitmap = calloc(sb->count_block_bitmap_blocks, sb->block_size);
+    fs->inode_bitmap = calloc(sb->count_inode_bitmap_blocks, sb->block_size);
+    if (!fs->block_bitmap || !fs->inode_bitmap) {
+      release(fs);
+      return NULL;
+    }
+  }
+  fs->zero_block = calloc(1, sb->block_size);
+  if (!fs->zero_block) {
+    release(fs);
+    return NULL;
+  }
+
+  fs->groups = block_groups_open(fs->img, sb, fs->block_bitmap,
+                                 fs->inode_bitmap);
+  if (fs->groups) {
+    if (options->flags & FS_MOUNT_BEST_FIT) {
+      fs->groups->policy = EXTENT_BEST_FIT;
+    }
+    fs->bcache = block_cache_create(fs->img, sb->block_size,
+                                    options->bcache_capacity);
+  }
+  if (fs->bcache) {
+    fs->icache = inode_cache_create(fs->bcache, sb, options->icache_capacity);
+  }
+  if (fs->icache) fs->dcache = dcache_create(options->dcache_capacity);
+  if (!fs->dcache) {
+    release(fs);
+    return NULL;
+  }
+
+  pthread_rwlock_init(&fs->ns_lock, NULL);
+  for (uint32_t i = 0; i < FS_INODE_LOCKS; i++) {
+    pthread_rwlock_init(&fs->inode_locks[i], NULL);
+  }
+  pthread_mutex_init(&fs->sb_lock, NULL);
+  pthread_mutex_init(&fs->files_lock, NULL);
+
+  // Флаг снимается до первых изменений и ставится при размонтировании
+  if (!sb->clean_shutdown) {
+    sifs_warn("ФС не была корректно размонтирована\n");
+  }
+  sb->clean_shutdown = 0;
+  if (write_superblock(fs) < 0) {
+    fs_unmount(fs);
+    return NULL;
+  }
+
+  sifs_info("Смонтирован %s: %" PRIu64 " блоков по %u байт, свободно %"
+            PRIu64 "\n", filename, sb->count_blocks, sb->block_size,
+            sb->count_free_blocks);
+  return fs;
+}
+
+int32_t fs_check(const char* filename) {
+  struct image* img = image_open(filename, 0);
+  if (!img) return -1;
+
+  struct superblock sb;
+  int32_t result = 0;
+  if (image_read(img, &sb, sizeof(sb), 0) != (ssize_t)sizeof(sb) ||
+      !superblock_valid(&sb)) {
+    sifs_error("%s не содержит ФС sifs ревизии %u\n", filename, FS_REVISION);
+    result = -1;
+  }
+  image_close(img);
+  if (result < 0) errno = EINVAL;
+  return result;
+}
+
+// Записывает битовые карты, дескрипторы и суперблок
+static int32_t sync_maps(struct fs* fs) {
+  pthread_mutex_lock(&fs->sb_lock);
+  int32_t result = block_groups_sync(fs->groups);
+  if (write_superblock(fs) < 0) {
+    result = -1;
+  } else if (fs->groups->mapped &&
+             image_flush(fs->img, 0, sizeof(fs->sb)) < 0) {
+    // Суперблок скопирован в отображение - сбрасываем его страницу
+    result = -1;
+  }
+  pthread_mutex_unlock(&fs->sb_lock);
+  return result;
+}
+
+// Переносит inode в кэш блоков и записывает его грязные буферы
+static int32_t sync_metadata(struct fs* fs) {
+  int32_t result = inode_cache_sync(fs->icache);
+  if (block_cache_sync(fs->bcache) < 0) result = -1;
+  return result;
+}
+
+int32_t fs_sync(struct fs* fs) {
+  int32_t result = sync_metadata(fs);
+  if (sync_maps(fs) < 0) result = -1;
+  if (image_sync(fs->img) < 0) result = -1;
+  return result;
+}
+
+int32_t fs_unmount(struct fs* fs) {
+  if (!fs) return 0;
+  sifs_assert(!fs->files);
+
+  int32_t result = sync_metadata(fs);
+  fs->sb.clean_shutdown = result == 0;
+  if (sync_maps(fs) < 0) result = -1;
+  if (image_sync(fs->img) < 0) result = -1;
+
+  pthread_rwlock_destroy(&fs->ns_lock);
+  for (uint32_t i = 0; i < FS_INODE_LOCKS; i++) {
+    pthread_rwlock_destroy(&fs->inode_locks[i]);
+  }
+  pthread_mutex_destroy(&fs->sb_lock);
+  pthread_mutex_destroy(&fs->files_lock);
+
+  release(fs);
+  return result;
+}
+
+void fs_statfs(struct fs* fs, struct fs_statfs* st) {
+  st->block_size = fs->sb.block_size;
+  st->blocks = fs->sb.count_blocks_data;
+  st->free_blocks = __atomic_load_n(&fs->sb.count_free_blocks,
+                                    __ATOMIC_RELAXED);
+  st->inodes = fs->sb.count_inodes;
+  st->free_inodes = __atomic_load_n(&fs->sb.count_free_inodes,
+                                    __ATOMIC_RELAXED);
+  st->name_max = MAX_FILENAME;
+}
+
+int32_t fs_lookup(struct fs* fs, const char* path, uint32_t* ino) {
+  pthread_rwlock_rdlock(&fs->ns_lock);
+  int32_t result = path_lookup(fs->bcache, &fs->sb, fs->icache, fs->dcache,
+                               path, ino);
+  pthread_rwlock_unlock(&fs->ns_lock);
+  return result;
+}
+
+int32_t fs_getattr(struct fs* fs, uint32_t ino, struct fs_stat* st) {
+  struct cached_inode* ci = inode_cache_get(fs->icache, ino, true);
+  if (!ci) return -1;
+
+  pthread_rwlock_t* lock = inode_lock(fs, ino);
+  pthread_rwlock_rdlock(lock);
+  const struct inode* node = &ci->node;
+  st->ino = ino;
+  st->mode = node->mode;
+  st->links = node->links;
+  st->uid = node->uid;
+  st->gid = node->gid;
+  st->block_size = fs->sb.block_size;
+  st->size = node->size;
+  st->blocks = inode_block_count(node, fs->sb.block_size);
+  st->atime = node->atime;
+  st->mtime = node->mtime;
+  st->ctime = node->ctime;
+  pthread_rwlock_unlock(lock);
+
+  inode_cache_put(fs->icache, ci);
+  return 0;
+}
+
+// Аргумент обхода каталога
+struct readdir_ctx {
+  fs_readdir_fn fn;
+  void* arg;
+};
+
+static int32_t readdir_entry(const struct dir_entry_info* entry, void* arg) {
+  struct readdir_ctx* ctx = arg;
+  return ctx->fn(entry->name, entry->inode, (uint32_t)entry->type << 12,
+                 ctx->arg);
+}
+
+int32_t fs_readdir(struct fs* fs, uint32_t ino, fs_readdir_fn fn,
+                   void* arg) {
+  pthread_rwlock_rdlock(&fs->ns_lock);
+  struct cached_inode* ci = inode_cache_get(fs->icache, ino, true);
+  int32_t result = -1;
+  if (ci && !S_ISDIR(ci->node.mode)) {
+    errno = ENOTDIR;
+  } else if (ci) {
+    struct readdir_ctx ctx = { fn, arg };
+    result = dir_iterate(fs->bcache, &fs->sb, &ci->node, readdir_entry, &ctx);
+  }
+
+  if (ci) inode_cache_put(fs->icache, ci);
+  pthread_rwlock_unlock(&fs->ns_lock);
+  return result;
+}
+
+// Заводит inode и запись о нем в каталоге parent; цель ссылки target
+// (для S_IFLNK) записывается во встроенные данные. Вызывается под
+// монопольной блокировкой пространства имен
+static int32_t create_entry(struct fs* fs, struct cached_inode* parent,
+                            const char* name, size_t len, uint32_t mode,
+                            uint32_t uid, uint32_t gid, const char* target,
+                            uint32_t* ino) {
+  bool directory = S_ISDIR(mode);
+  int64_t allocated = block_groups_alloc_inode(fs->groups, parent->ino,
+                                               directory);
+  if (allocated < 0) return -1;
+
+  struct cached_inode* ci = inode_cache_get(fs->icache, allocated, false);
+  if (!ci) {
+    block_groups_free_inode(fs->groups, allocated);
+    return -1;
+  }
+
+  init_inode(&ci->node, mode, uid, gid);
+  if (target) inline_data_write(&ci->node, target, strlen(target), 0);
+  struct group_allocator dir_alloc, parent_alloc;
+  group_allocator_init(&dir_alloc, fs, allocated);
+  group_allocator_init(&parent_alloc, fs, parent->ino);
+
+  int32_t result = 0;
+  if (directory) {
+    result = dir_init(fs->bcache, &fs->sb, &dir_alloc.base, &ci->node,
+                      allocated, parent->ino);
+  }
+  if (result == 0) {
+    // Размер, ссылки и время родителя читает fs_getattr под блокировкой
+    // его inode
+    pthread_rwlock_t* parent_lock = inode_lock(fs, parent->ino);
+    pthread_rwlock_wrlock(parent_lock);
+    result = dir_add(fs->bcache, &fs->sb, &parent_alloc.base, &parent->node,
+                     name, len, allocated, mode);
+    if (result == 0) {
+      // ".." нового каталога - ссылка на родителя
+      if (directory) parent->node.links++;
+      inode_update_mtime(&parent->node);
+      inode_cache_mark_dirty(fs->icache, parent);
+    }
+    pthread_rwlock_unlock(parent_lock);
+  }
+
+  if (result < 0) {
+    int saved = errno;
+    if (directory && !(ci->node.flags & INODE_INLINE)) {
+      block_map_truncate(fs->bcache, &fs->sb, &dir_alloc.base, &ci->node, 0);
+    }
+    block_groups_free_inode(fs->groups, allocated);
+    inode_cache_put(fs->icache, ci);
+    errno = saved;
+    return -1;
+  }
+
+  inode_cache_mark_dirty(fs->icache, ci);
+  inode_cache_put(fs->icache, ci);
+
+  *ino = allocated;
+  return 0;
+}
+
+// Создает inode типа mode по пути path
+static int32_t create_node(struct fs* fs, const char* path, uint32_t mode,
+                           uint32_t uid, uint32_t gid, const char* target,
+                           uint32_t* ino) {
+  pthread_rwlock_wrlock(&fs->ns_lock);
+
+  uint32_t parent_ino, existing;
+  const char* name;
+  size_t len;
+  struct cached_inode* parent = NULL;
+  int32_t result = path_lookup_parent(fs->bcache, &fs->sb, fs->icache,
+                                      fs->dcache, path, &parent_ino,
+                                      &name, &len);
+  if (result == 0) {
+    parent = inode_cache_get(fs->icache, parent_ino, true);
+    result = parent ? 0 : -1;
+  }
+  if (result == 0 && !S_ISDIR(parent->node.mode)) {
+    errno = ENOTDIR;
+    result = -1;
+  }
+  if (result == 0 && dir_lookup(fs->bcache, &fs->sb, &parent->node, name, len,
+                                &existing) == 0) {
+    errno = EEXIST;
+    result = -1;
+  }
+
+  if (result == 0) {
+    result = create_entry(fs, parent, name, len, mode, uid, gid, target,
+                          ino);
+  }
+  if (result == 0) {
+    dcache_insert(fs->dcache, parent_ino, name, len, *ino);
+    sifs_debug("Создан %s (inode %u)\n", path, *ino);
+  }
+
+  int saved = errno;
+  if (parent) inode_cache_put(fs->icache, parent);
+  pthread_rwlock_unlock(&fs->ns_lock);
+  errno = saved;
+  return result;
+}
+
+int32_t fs_create(struct fs* fs, const char* path, uint32_t mode,
+                  uint32_t uid, uint32_t gid, uint32_t* ino) {
+  if (!S_ISREG(mode) && !S_ISDIR(mode)) {
+    errno = EINVAL;
+    return -1;
+  }
+  return create_node(fs, path, mode, uid, gid, NULL, ino);
+}
+
+int32_t fs_symlink(struct fs* fs, const char* target, const char* path,
+                   uint32_t uid, uint32_t gid, uint32_t* ino) {
+  size_t size = strlen(target);
+  if (size == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+  if (!inline_data_fits(size)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return create_node(fs, path, S_IFLNK | 0777, uid, gid, target, ino);
+}
+
+ssize_t fs_readlink(struct fs* fs, uint32_t ino, char* buffer, size_t size) {
+  struct cached_inode* ci = inode_cache_get(fs->icache, ino, true);
+  if (!ci) return -1;
+
+  pthread_rwlock_t* lock = inode_lock(fs, ino);
+  pthread_rwlock_rdlock(lock);
+  ssize_t result = -1;
+  if (!S_ISLNK(ci->node.mode) || !(ci->node.flags & INODE_INLINE)) {
+    errno = EINVAL;
+  } else {
+    result = inline_data_read(&ci->node, buffer, size, 0);
+  }
+  pthread_rwlock_unlock(lock);
+
+  inode_cache_put(fs->icache, ci);
+  return result;
+}
+
+// Освобождает блоки и inode файла без ссылок. Вызывается, когда файл
+// не открыт; блокировка inode взята монопольно
+static void release_inode(struct fs* fs, struct cached_inode* ci) {
+  struct inode* node = &ci->node;
+  struct group_allocator alloc;
+  group_allocator_init(&alloc, fs, ci->ino);
+
+  if (!(node->flags & INODE_INLINE) &&
+      block_map_truncate(fs->bcache, &fs->sb, &alloc.base, node, 0) < 0) {
+    sifs_error("Не удалось освободить блоки inode %u\n", ci->ino);
+  }
+  block_groups_free_inode(fs->groups, ci->ino);
+
+  node->mode = 0;
+  node->size = 0;
+  inode_cache_mark_dirty(fs->icache, ci);
+  sifs_debug("Освобожден inode %u\n", ci->ino);
+}
+
+// Проверяет, открыт ли inode. Вызывается под files_lock
+static bool is_open(struct fs* fs, uint32_t ino) {
+  for (struct fs_file* f = fs->files; f; f = f->next) {
+    if (f->ci->ino == ino) return true;
+  }
+  return false;
+}
+
+int32_t fs_unlink(struct fs* fs, const char* path) {
+  pthread_rwlock_wrlock(&fs->ns_lock);
+
+  uint32_t parent_ino, ino;
+  const char* name;
+  size_t len;
+  struct cached_inode* parent = NULL;
+  struct cached_inode* ci = NULL;
+  int32_t result = path_lookup_parent(fs->bcache, &fs->sb, fs->icache,
+                                      fs->dcache, path, &parent_ino,
+                                      &name, &len);
+  if (result == 0) {
+    parent = inode_cache_get(fs->icache, parent_ino, true);
+    result = parent ? 0 : -1;
+  }
+  if (result == 0 && !S_ISDIR(parent->node.mode)) {
+    errno = ENOTDIR;
+    result = -1;
+  }
+  if (result == 0) {
+    result = dir_lookup(fs->bcache, &fs->sb, &parent->node, name, len, &ino);
+  }
+  if (result == 0) {
+    ci = inode_cache_get(fs->icache, ino, true);
+    result = ci ? 0 : -1;
+  }
+  if (result == 0 && S_ISDIR(ci->node.mode)) {
+    errno = EISDIR;
+    result = -1;
+  }
+  if (result == 0) {
+    // Блокировка родителя снимается до блокировки файла: обе могут
+    // оказаться одной и той же
+    pthread_rwlock_t* parent_lock = inode_lock(fs, parent_ino);
+    pthread_rwlock_wrlock(parent_lock);
+    result = dir_remove(fs->bcache, &fs->sb, &parent->node, name, len);
+    if (result == 0) {
+      inode_update_mtime(&parent->node);
+      inode_cache_mark_dirty(fs->icache, parent);
+    }
+    pthread_rwlock_unlock(parent_lock);
+  }
+
+  if (result == 0) {
+    dcache_insert(fs->dcache, parent_ino, name, len, 0);
+
+    pthread_rwlock_t* lock = inode_lock(fs, ino);
+    pthread_rwlock_wrlock(lock);
+    ci->node.links--;
+    inode_cache_mark_dirty(fs->icache, ci);
+
+    pthread_mutex_lock(&fs->files_lock);
+    if (ci->node.links == 0 && !is_open(fs, ino)) release_inode(fs, ci);
+    pthread_mutex_unlock(&fs->files_lock);
+    pthread_rwlock_unlock(lock);
+    sifs_debug("Удален %s (inode %u)\n", path, ino);
+  }
+
+  int saved = errno;
+  if (ci) inode_cache_put(fs->icache, ci);
+  if (parent) inode_cache_put(fs->icache, parent);
+  pthread_rwlock_unlock(&fs->ns_lock);
+  errno = saved;
+  return result;
+}
+
+// Открывает inode и регистрирует файл в списке открытых
+static struct fs_file* open_inode(struct fs* fs, uint32_t ino) {
+  struct cached_inode* ci = inode_cache_get(fs->icache, ino, true);
+  if (!ci) return NULL;
+  if (ci->node.links == 0) {
+    inode_cache_put(fs->icache, ci);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  struct fs_file* file = calloc(1, sizeof(*file));
+  if (!file) {
+    inode_cache_put(fs->icache, ci);
+    return NULL;
+  }
+
+  file->fs = fs;
+  file->ci = ci;
+  map_cache_init(&file->map);
+  pthread_mutex_init(&file->map_lock, NULL);
+
+  pthread_mutex_lock(&fs->files_lock);
+  file->next = fs->files;
+  fs->files = file;
+  pthread_mutex_unlock(&fs->files_lock);
+  return file;
+}
+
+struct fs_file* fs_open(struct fs* fs, uint32_t ino) {
+  return open_inode(fs, ino);
+}
+
+struct fs_file* fs_open_path(struct fs* fs, const char* path) {
+  // Удаление ждет блокировку имен, поэтому найденный inode не может быть
+  // освобожден и занят другим файлом до регистрации открытия
+  pthread_rwlock_rdlock(&fs->ns_lock);
+  uint32_t ino;
+  struct fs_file* file = NULL;
+  if (path_lookup(fs->bcache, &fs->sb, fs->icache, fs->dcache, path,
+                  &ino) == 0) {
+    file = open_inode(fs, ino);
+  }
+  int saved = errno;
+  pthread_rwlock_unlock(&fs->ns_lock);
+  errno = saved;
+  return file;
+}
+
+int32_t fs_close(struct fs_file* file) {
+  if (!file) return 0;
+  struct fs* fs = file->fs;
+  struct cached_inode* ci = file->ci;
+
+  pthread_rwlock_t* lock = inode_lock(fs, ci->ino);
+  pthread_rwlock_wrlock(lock);
+  pthread_mutex_lock(&fs->files_lock);
+
+  struct fs_file** link = &fs->files;
+  while (*link != file) link = &(*link)->next;
+  *link = file->next;
+
+  if (ci->node.links == 0 && ci->node.mode && !is_open(fs, ci->ino)) {
+    release_inode(fs, ci);
+  }
+
+  pthread_mutex_unlock(&fs->files_lock);
+  pthread_rwlock_unlock(lock);
+
+  inode_cache_put(fs->icache, ci);
+  pthread_mutex_destroy(&file->map_lock);
+  free(file);
+  return 0;
+}
+
+uint32_t fs_file_ino(const struct fs_file* file) {
+  return file->ci->ino;
+}
+
+void fs_file_get_stats(struct fs_file* file, struct fs_file_stats* stats) {
+  struct map_cache_stats map;
+  pthread_mutex_lock(&file->map_lock);
+  map_cache_get_stats(&file->map, &map);
+  pthread_mutex_unlock(&file->map_lock);
+
+  stats->map_hits = map.hits;
+  stats->map_misses = map.misses;
+}
+
+// Разрешает логический блок через кэш отображения файла
+static int32_t resolve(struct fs_file* file, uint64_t logical,
+                       uint64_t* physical) {
+  pthread_mutex_lock(&file->map_lock);
+  int32_t result = map_cache_resolve(&file->map, file->fs->bcache,
+                                     &file->fs->sb, &file->ci->node,
+                                     logical, physical);
+  pthread_mutex_unlock(&file->map_lock);
+  return result;
+}
+
+// Сбрасывает отображение с logical во всех открытиях inode
+static void invalidate_maps(struct fs* fs, uint32_t ino, uint64_t logical) {
+  pthread_mutex_lock(&fs->files_lock);
+  for (struct fs_file* f = fs->files; f; f = f->next) {
+    if (f->ci->ino != ino) continue;
+    pthread_mutex_lock(&f->map_lock);
+    map_cache_invalidate(&f->map, logical, UINT64_MAX);
+    pthread_mutex_unlock(&f->map_lock);
+  }
+  pthread_mutex_unlock(&fs->files_lock);
+}
+
+// Находит непрерывный участок файла длиной до limit байт с позиции pos:
+// идущие подряд отрезки отображения склеиваются, если продолжают друг
+// друга и в образе (или оба - дыры). Записывает смещение участка в образе
+// (0 - дыра) и его длину. Возвращает 0 или -1
+static int32_t next_span(struct fs_file* file, uint64_t pos, size_t limit,
+                         off_t* where, size_t* len) {
+  struct fs* fs = file->fs;
+  uint32_t bs = fs->sb.block_size;
+  uint64_t logical = pos / bs;
+  uint32_t in_block = pos % bs;
+  uint64_t blocks = (in_block + (uint64_t)limit + bs - 1) / bs;
+  uint64_t first = 0;     // Первый физический блок участка
+  uint64_t count = 0;     // Блоков в участке
+
+  pthread_mutex_lock(&file->map_lock);
+  while (count < blocks) {
+    struct map_run run;
+    if (map_cache_resolve_run(&file->map, fs->bcache, &fs->sb, &file->ci->node,
+                              logical + count, &run) < 0) {
+      if (count == 0) {
+        pthread_mutex_unlock(&file->map_lock);
+        return -1;
+      }
+      break;  // Ошибка вернется при следующем обращении
+    }
+    if (count == 0) {
+      first = run.physical;
+    } else if (first ? run.physical != first + count : run.physical != 0) {
+      break;
+    }
+    count += run.len;
+  }
+  pthread_mutex_unlock(&file->map_lock);
+
+  if (count > blocks) count = blocks;
+  uint64_t n = count * bs - in_block;
+  *len = n < limit ? n : limit;
+  *where = first ? (off_t)first * bs + in_block : 0;
+  return 0;
+}
+
+// Читает данные по непрерывным участкам: каждый участок образа - одним
+// чтением прямо в буфер вызывающего, дыры и блоки за концом образа - нули
+static ssize_t read_blocks(struct fs_file* file, uint8_t* buffer,
+                           size_t size, uint64_t offset) {
+  struct fs* fs = file->fs;
+  size_t done = 0;
+
+  while (done < size) {
+    off_t where;
+    size_t n;
+    if (next_span(file, offset + done, size - done, &where, &n) < 0) break;
+
+    ssize_t got = 0;
+    if (where) {
+      got = image_read(fs->img, buffer + done, n, where);
+      if (got < 0) break;
+    }
+    memset(buffer + done + got, 0, n - got);
+    done += n;
+  }
+
+  return done || size == 0 ? (ssize_t)done : -1;
+}
+
+ssize_t fs_read(struct fs_file* file, void* buffer, size_t size,
+                uint64_t offset) {
+  struct inode* node = &file->ci->node;
+  pthread_rwlock_t* lock = inode_lock(file->fs, file->ci->ino);
+  pthread_rwlock_rdlock(lock);
+
+  ssize_t result = 0;
+  if (offset < node->size) {
+    if (size > node->size - offset) size = node->size - offset;
+    if (node->flags & INODE_INLINE) {
+      result = inline_data_read(node, buffer, size, offset);
+    } else {
+      result = read_blocks(file, buffer, size, offset);
+    }
+  }
+
+  pthread_rwlock_unlock(lock);
+  return result;
+}
+
+// Пишет в out_fd size байт из data, дописывая остаток после частичной
+// записи. Возвращает число записанных байт или -1, если не записано ничего
+static ssize_t send_buffer(int32_t out_fd, const uint8_t* data, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = write(out_fd, data + done, size - done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return done ? (ssize_t)done : -1;
+    }
+    done += n;
+  }
+
+  return done;
+}
+
+// Пишет в out_fd size нулевых байт (дыра файла) порциями по блоку
+static ssize_t send_zeros(struct fs* fs, int32_t out_fd, size_t size) {
+  size_t done = 0;
+
+  while (done < size) {
+    size_t n = size - done;
+    if (n > fs->sb.block_size) n = fs->sb.block_size;
+    ssize_t sent = send_buffer(out_fd, fs->zero_block, n);
+    if (sent < 0) return done ? (ssize_t)done : -1;
+    done += sent;
+    if ((size_t)sent < n) break;
+  }
+
+  return done;
+}
+
+// Передает участки файла в out_fd: данные - через image_sendfile,
+// дыры - нулями
+static ssize_t send_blocks(struct fs_file* file, int32_t out_fd,
+                           size_t size, uint64_t offset) {
+  struct fs* fs = file->fs;
+  size_t done = 0;
+
+  while (done < size) {
+    off_t where;
+    size_t n;
+    if (next_span(file, offset + done, size - done, &where, &n) < 0) break;
+
+    ssize_t sent = 0;
+    if (where) {
+      sent = image_sendfile(fs->img, out_fd, where, n);
+      if (sent < 0) break;
+    }
+    if ((size_t)sent < n) {
+      ssize_t zeros = send_zeros(fs, out_fd, n - sent);
+      if (zeros > 0) sent += zeros;
+    }
+    done += sent;
+    if ((size_t)sent < n) break;
+  }
+
+  return done || size == 0 ? (ssize_t)done : -1;
+}
+
+ssize_t fs_sendfile(struct fs_file* file, int32_t out_fd, size_t size,
+                    uint64_t offset) {
+  struct inode* node = &file->ci->node;
+  pthread_rwlock_t* lock = inode_lock(file->fs, file->ci->ino);
+  pthread_rwlock_rdlock(lock);
+
+  ssize_t result = 0;
+  if (offset < node->size) {
+    if (size > node->size - offset) size = node->size - offset;
+    if (node->flags & INODE_INLINE) {
+      uint8_t data[INODE_INLINE_SIZE];
+      result = inline_data_read(node, data, size, offset);
+      if (result > 0) result = send_buffer(out_fd, data, result);
+    } else {
+      result = send_blocks(file, out_fd, size, offset);
+    }
+  }
+
+  pthread_rwlock_unlock(lock);
+  return result;
+}
+
+// Выделяет до want подряд идущих блоков под дыру с logical в группе inode
+// файла и отображает их. Возвращает первый блок (длина - в len) или -1
+static int64_t alloc_data_run(struct fs_file* file, uint64_t logical,
+                              uint64_t want, uint32_t* len) {
+  struct fs* fs = file->fs;
+  if (want > FS_MAX_RUN) want = FS_MAX_RUN;
+  struct group_allocator alloc;
+  group_allocator_init(&alloc, fs, file->ci->ino);
+
+  int64_t block = block_groups_alloc_run(fs->groups, alloc.goal, want, len);
+  if (block >= 0) {
+    pthread_mutex_lock(&file->map_lock);
+    int32_t result = map_cache_assign_run(&file->map, fs->bcache, &fs->sb,
+                                          &alloc.base, &file->ci->node,
+                                          logical, block, *len);
+    pthread_mutex_unlock(&file->map_lock);
+    if (result < 0) {
+      int saved = errno;
+      block_groups_free_run(fs->groups, block, *len);
+      errno = saved;
+      block = -1;
+    }
+  }
+
+  return block;
+}
+
+// Записывает данные по отрезкам отображения. В отображенный отрезок
+// данные пишутся одной записью. Под дыру выделяются подряд идущие блоки,
+// и данные вместе с нулевым дополнением до границ блоков уходят одной
+// векторной записью целых блоков, без промежуточного буфера
+static ssize_t write_blocks(struct fs_file* file, const uint8_t* buffer,
+                            size_t size, uint64_t offset) {
+  struct fs* fs = file->fs;
+  uint32_t bs = fs->sb.block_size;
+  size_t done = 0;
+
+  while (done < size) {
+    uint64_t pos = offset + done;
+    uint64_t logical = pos / bs;
+    uint32_t in_block = pos % bs;
+    uint64_t blocks = (in_block + (size - done) + bs - 1) / bs;
+
+    struct map_run run;
+    pthread_mutex_lock(&file->map_lock);
+    int32_t result = map_cache_resolve_run(&file->map, fs->bcache, &fs->sb,
+                                           &file->ci->node, logical, &run);
+    pthread_mutex_unlock(&file->map_lock);
+    if (result < 0) break;
+    if (run.len > blocks) run.len = blocks;
+
+    if (run.physical) {
+      size_t n = run.len * bs - in_block;
+      if (n > size - done) n = size - done;
+      if (image_write(fs->img, buffer + done, n,
+                      (off_t)run.physical * bs + in_block) < 0) {
+        break;
+      }
+      done += n;
+      continue;
+    }
+
+    uint32_t len;
+    int64_t block = alloc_data_run(file, logical, run.len, &len);
+    if (block < 0) break;
+
+    size_t n = (size_t)len * bs - in_block;
+    if (n > size - done) n = size - done;
+    size_t tail = (size_t)len * bs - in_block - n;
+
+    struct iovec iov[3];
+    int count = 0;
+    if (in_block) {
+      iov[count++] = (struct iovec){ fs->zero_block, in_block };
+    }
+    iov[count++] = (struct iovec){ (void*)(buffer + done), n };
+    if (tail) {
+      iov[count++] = (struct iovec){ fs->zero_block, tail };
+    }
+    if (image_writev(fs->img, iov, count, (off_t)block * bs) < 0) break;
+    done += n;
+  }
+
+  return done || size == 0 ? (ssize_t)done : -1;
+}
+
+ssize_t fs_write(struct fs_file* file, const void* buffer, size_t size,
+                 uint64_t offset) {
+  struct fs* fs = file->fs;
+  struct inode* node = &file->ci->node;
+  if (offset + size < offset) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  pthread_rwlock_t* lock = inode_lock(fs, file->ci->ino);
+  pthread_rwlock_wrlock(lock);
+
+  ssize_t result = 0;
+  if ((node->flags & INODE_INLINE) && inline_data_fits(offset + size)) {
+    result = inline_data_write(node, buffer, size, offset);
+  } else {
+    // Данные, не помещающиеся в inode, переезжают в дерево экстентов
+    if (node->flags & INODE_INLINE) {
+      struct group_allocator alloc;
+      group_allocator_init(&alloc, fs, file->ci->ino);
+      result = inline_data_migrate(fs->bcache, &fs->sb, &alloc.base, node,
+                                   true);
+    }
+    if (result == 0) result = write_blocks(file, buffer, size, offset);
+    if (result > 0 && offset + result > node->size) {
+      node->size = offset + result;
+    }
+  }
+
+  // Ошибка после переноса или выделения блоков тоже меняет inode
+  if (result > 0) inode_update_mtime(node);
+  if (result != 0) inode_cache_mark_dirty(fs->icache, file->ci);
+
+  pthread_rwlock_unlock(lock);
+  return result;
+}
+
+// Обнуляет хвост последнего блока за новым концом файла, чтобы
+// последующее расширение читало нули
+static int32_t zero_tail(struct fs_file* file, uint64_t size) {
+  struct fs* fs = file->fs;
+  uint32_t bs = fs->sb.block_size;
+  if (size % bs == 0) return 0;
+
+  uint64_t physical;
+  if (resolve(file, size / bs, &physical) < 0) return -1;
+  if (!physical) return 0;
+  return image_zero(fs->img, (off_t)physical * bs + size % bs,
+                    bs - size % bs);
+}
+
+int32_t fs_truncate(struct fs_file* file, uint64_t size) {
+  struct fs* fs = file->fs;
+  struct inode* node = &file->ci->node;
+  uint32_t bs = fs->sb.block_size;
+
+  pthread_rwlock_t* lock = inode_lock(fs, file->ci->ino);
+  pthread_rwlock_wrlock(lock);
+
+  int32_t result = 0;
+  if ((node->flags & INODE_INLINE) && inline_data_fits(size)) {
+    result = inline_data_truncate(node, size);
+  } else {
+    struct group_allocator alloc;
+    group_allocator_init(&alloc, fs, file->ci->ino);
+    if (node->flags & INODE_INLINE) {
+      result = inline_data_migrate(fs->bcache, &fs->sb, &alloc.base, node,
+                                   true);
+    } else if (size < node->size) {
+      result = block_map_truncate(fs->bcache, &fs->sb, &alloc.base, node,
+                                  (size + bs - 1) / bs);
+    }
+
+    if (size < node->size) {
+      invalidate_maps(fs, file->ci->ino, size / bs);
+      if (result == 0) result = zero_tail(file, size);
+    }
+    if (result == 0) node->size = size;
+  }
+
+  if (result == 0) inode_update_mtime(node);
+  inode_cache_mark_dirty(fs->icache, file->ci);
+
+  pthread_rwlock_unlock(lock);
+  return result;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Смонтированная ФС: суперблок, битовые карты и группы в памяти, кэши
+// inode и записей каталогов. Операции потокобезопасны:
+//  - пространство имен защищено блокировкой чтения-записи (поиск и
+//    чтение каталогов - параллельно, создание и удаление - монопольно);
+//  - содержимое файла и его inode - одной из FS_INODE_LOCKS блокировок
+//    по номеру inode (чтения одного файла идут параллельно); изменения
+//    каталога и его inode - еще и под ней, поверх блокировки имен;
+//  - битовые карты и счетчики группы - мьютексом группы, счетчики
+//    суперблока меняются атомарно, поэтому выделение в разных группах
+//    идет параллельно.
+// Блокировки берутся в этом порядке.
+// Заголовок не зависит от структур формата, поэтому подключается вместе
+// с системными заголовками (sys/stat.h и т.п.).
+struct fs;
+
+// Открытый файл: ссылка на inode в кэше и кэш отображения блоков
+struct fs_file;
+
+// Число блокировок inode (номер inode берется по модулю)
+#define FS_INODE_LOCKS 64
+
+// Наибольший отрезок блоков, выделяемый под дыру за один раз
+#define FS_MAX_RUN 1024
+
+// Атрибуты inode
+struct fs_stat {
+  uint32_t ino;
+  uint32_t mode;          // Тип (S_IFMT) и права, значения совпадают с POSIX
+  uint32_t links;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t block_size;
+  uint64_t size;          // Размер в байтах
+  uint64_t blocks;        // Занято блоков ФС
+  int64_t atime;          // Наносекунды с начала эпохи Unix
+  int64_t mtime;
+  int64_t ctime;
+};
+
+// Заполненность ФС
+struct fs_statfs {
+  uint32_t block_size;
+  uint64_t blocks;
+  uint64_t free_blocks;
+  uint32_t inodes;
+  uint32_t free_inodes;
+  uint32_t name_max;
+};
+
+// Функция обхода каталога: имя с завершающим нулем, номер inode и тип
+// (mode & S_IFMT). Ненулевой результат прекращает обход
+typedef int32_t (*fs_readdir_fn)(const char* name, uint32_t ino,
+                                 uint32_t type, void* arg);
+
+// Флаги монтирования
+#define FS_MOUNT_MMAP 0x1   // Работать с образом через отображение в память
+#define FS_MOUNT_BEST_FIT 0x2  // Отрезки файлов - best-fit, а не first-fit
+
+// Параметры монтирования. Нулевые поля - значения по умолчанию
+struct fs_options {
+  uint32_t icache_capacity;   // Inode в кэше (INODE_CACHE_DEFAULT_CAPACITY)
+  uint32_t dcache_capacity;   // Записей кэша имен (DCACHE_DEFAULT_CAPACITY)
+  uint32_t bcache_capacity;   // Блоков в кэше (BLOCK_CACHE_DEFAULT_CAPACITY)
+  uint32_t flags;             // FS_MOUNT_*
+};
+
+// Монтирует образ: читает суперблок и битовые карты, снимает флаг
+// корректного завершения. options == NULL - параметры по умолчанию.
+// Возвращает NULL при ошибке (errno = EINVAL, если образ не содержит ФС
+// текущей ревизии)
+extern struct fs* fs_mount(const char* filename,
+                           const struct fs_options* options);
+
+// Проверяет, что образ содержит ФС текущей ревизии, не монтируя его и не
+// запуская потоков. Возвращает 0 или -1 (errno = EINVAL или ошибка
+// открытия)
+extern int32_t fs_check(const char* filename);
+
+// Записывает изменения, ставит флаг корректного завершения и освобождает
+// ФС. Все файлы должны быть закрыты. Возвращает 0 или -1 при ошибке
+extern int32_t fs_unmount(struct fs* fs);
+
+// Записывает грязные inode, битовые карты, дескрипторы групп и суперблок
+extern int32_t fs_sync(struct fs* fs);
+
+// Копирует счетчики свободного места
+extern void fs_statfs(struct fs* fs, struct fs_statfs* st);
+
+// Находит inode по абсолютному пути (см. namei.h).
+// Возвращает 0 или -1 (errno = ENOENT, ENOTDIR, ...)
+extern int32_t fs_lookup(struct fs* fs, const char* path, uint32_t* ino);
+
+// Читает атрибуты inode. Возвращает 0 или -1
+extern int32_t fs_getattr(struct fs* fs, uint32_t ino, struct fs_stat* st);
+
+// Обходит записи каталога ino, включая "." и "..".
+// Возвращает 0, результат fn, прервавший обход, или -1 (errno = ENOTDIR)
+extern int32_t fs_readdir(struct fs* fs, uint32_t ino, fs_readdir_fn fn,
+                          void* arg);
+
+// Создает обычный файл (S_IFREG) или каталог (S_IFDIR) по пути и
+// записывает номер нового inode в ino. Возвращает 0 или -1 (errno =
+// EEXIST, ENOENT, ENOTDIR, ENAMETOOLONG, ENOSPC, EINVAL)
+extern int32_t fs_create(struct fs* fs, const char* path, uint32_t mode,
+                         uint32_t uid, uint32_t gid, uint32_t* ino);
+
+// Создает символическую ссылку path на target. Цель хранится во
+// встроенных данных inode, поэтому ее длина ограничена INODE_INLINE_SIZE
+// (192 байта). Возвращает 0 или -1 (errno = ENAMETOOLONG, EEXIST,
+// ENOENT, ...)
+extern int32_t fs_symlink(struct fs* fs, const char* target, const char* path,
+                          uint32_t uid, uint32_t gid, uint32_t* ino);
+
+// Копирует до size байт цели ссылки ino в buffer без завершающего нуля.
+// Возвращает длину скопированного или -1 (errno = EINVAL, если ino не
+// ссылка)
+extern ssize_t fs_readlink(struct fs* fs, uint32_t ino, char* buffer,
+                           size_t size);
+
+// Удаляет запись файла. Блоки и inode освобождаются с последней ссылкой,
+// а для открытого файла - при последнем fs_close.
+// Возвращает 0 или -1 (errno = ENOENT, EISDIR, ...)
+extern int32_t fs_unlink(struct fs* fs, const char* path);
+
+// Открывает inode для чтения и записи. Номер, найденный fs_lookup, к
+// моменту вызова может принадлежать уже другому файлу; открытие по пути -
+// fs_open_path. Возвращает NULL при ошибке
+extern struct fs_file* fs_open(struct fs* fs, uint32_t ino);
+
+// Находит файл по пути и открывает его под той же блокировкой имен, что
+// и поиск: параллельные удаление и создание не подменяют файл.
+// Возвращает NULL при ошибке (errno = ENOENT, ENOTDIR, ...)
+extern struct fs_file* fs_open_path(struct fs* fs, const char* path);
+
+// Закрывает файл; удаленный файл освобождается с последним открытием
+extern int32_t fs_close(struct fs_file* file);
+
+// Номер inode открытого файла
+extern uint32_t fs_file_ino(const struct fs_file* file);
+
+// Счетчики кэша отображения открытого файла
+struct fs_file_stats {
+  uint64_t map_hits;          // Блок найден в кэше отображения
+  uint64_t map_misses;        // Блок разрешен через указатели или экстенты
+};
+
+// Копирует счетчики открытого файла
+extern void fs_file_get_stats(struct fs_file* file,
+                              struct fs_file_stats* stats);
+
+// Читает до size байт со смещения offset; дыры читаются нулями.
+// Непрерывные участки образа читаются одним вызовом прямо в buffer.
+// Возвращает число байт (0 за концом файла) или -1
+extern ssize_t fs_read(struct fs_file* file, void* buffer, size_t size,
+                       uint64_t offset);
+
+// Передает до size байт файла со смещения offset в дескриптор out_fd
+// (файл, канал, сокет) без копирования в пользовательский буфер; дыры
+// передаются нулями. Возвращает число байт (0 за концом файла) или -1
+extern ssize_t fs_sendfile(struct fs_file* file, int32_t out_fd, size_t size,
+                           uint64_t offset);
+
+// Записывает size байт со смещения offset, выделяя блоки под дыры и
+// расширяя файл. Возвращает число записанных байт (меньше size, если
+// место кончилось) или -1
+extern ssize_t fs_write(struct fs_file* file, const void* buffer, size_t size,
+                        uint64_t offset);
+
+// Устанавливает размер файла: лишние блоки освобождаются, расширение
+// оставляет дыру. Возвращает 0 или -1
+extern int32_t fs_truncate(struct fs_file* file, uint64_t size);
@@ -1,31 +1,415 @@
+#define _GNU_SOURCE
 #include "image.h"
+#include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include "../debug/debug.h"
 
-static int32_t image_fd = -1;
+struct image {
+  int32_t fd;         // Дескриптор файла образа
+  int32_t flags;      // Флаги открытия IMAGE_*
+  off_t size;         // Размер образа (для режима IMAGE_MMAP)
+  uint8_t* map;       // Отображение образа или NULL
+};
 
-int32_t image_open(const char* filename, int32_t truncate) {
-  int32_t flags = O_RDWR | O_CREAT;
-  if (truncate) flags |= O_TRUNC;
+// Отображает файл образа целиком
+static int32_t image_map(struct image* img) {
+  struct stat st;
+  if (fstat(img->fd, &st) < 0) return -1;
 
-  image_fd = open(filename, flags, 0666);
-  return image_fd;
+  img->size = st.st_size;
+  img->map = NULL;
+  if (img->size == 0) return 0;  // Пустой файл отображать нечего
+
+  void* map = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   img->fd, 0);
+  if (map == MAP_FAILED) return -1;
+
+  img->map = map;
+  return 0;
 }
 
-int32_t image_close(void) {
-  if (image_fd != -1) {
-    close(image_fd);
-    image_fd = -1;
+struct image* image_open(const char* filename, int32_t flags) {
+  int32_t open_flags = O_RDWR | O_CREAT;
+  if (flags & IMAGE_TRUNCATE) open_flags |= O_TRUNC;
+
+  struct image* img = calloc(1, sizeof(*img));
+  if (!img) return NULL;
+  img->flags = flags;
+
+  img->fd = open(filename, open_flags, 0666);
+  if (img->fd < 0) {
+    int saved = errno;
+    sifs_error("Не удалось открыть образ %s: %s\n", filename, strerror(saved));
+    free(img);
+    errno = saved;
+    return NULL;
+  }
+
+  if ((flags & IMAGE_MMAP) && image_map(img) < 0) {
+    int saved = errno;
+    sifs_error("Не удалось отобразить образ %s: %s\n", filename,
+               strerror(saved));
+    close(img->fd);
+    free(img);
+    errno = saved;
+    return NULL;
+  }
+
+  return img;
+}
+
+int32_t image_close(struct image* img) {
+  if (!img) return 0;
+
+  int32_t result = 0;
+  if (img->map) {
+    // Грязные страницы отображения сбрасываются перед закрытием
+    if (msync(img->map, img->size, MS_SYNC) < 0) result = -1;
+    munmap(img->map, img->size);
+  }
+
+  if (close(img->fd) < 0) result = -1;
+  if (result < 0) {
+    sifs_error("Ошибка закрытия образа: %s\n", strerror(errno));
+  }
+  free(img);
+  return result;
+}
+
+ssize_t image_read(struct image* img, void* buffer, size_t size,
+                   off_t offset) {
+  if (img->flags & IMAGE_MMAP) {
+    if (offset >= img->size) return 0;
+    if ((off_t)size > img->size - offset) size = img->size - offset;
+    memcpy(buffer, img->map + offset, size);
+    return size;
+  }
+
+  size_t done = 0;
+
+  // pread может вернуть меньше запрошенного - дочитываем остаток
+  while (done < size) {
+    ssize_t n = pread(img->fd, (uint8_t*)buffer + done, size - done,
+                      offset + (off_t)done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      sifs_error("Ошибка чтения образа (смещение %lld, %zu байт): %s\n",
+                 (long long)offset + (long long)done, size - done,
+                 strerror(errno));
+      return -1;
+    }
+    if (n == 0) break;  // Конец файла
+    done += n;
+  }
+
+  return done;
+}
+
+ssize_t image_write(struct image* img, const void* buffer, size_t size,
+                    off_t offset) {
+  if (img->flags & IMAGE_MMAP) {
+    // Рост перестроил бы отображение под другими потоками
+    if (offset < 0 || offset + (off_t)size > img->size) {
+      sifs_error("Запись за концом отображенного образа (смещение %lld)\n",
+                 (long long)offset);
+      errno = ENOSPC;
+      return -1;
+    }
+    memcpy(img->map + offset, buffer, size);
+    return size;
+  }
+
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = pwrite(img->fd, (const uint8_t*)buffer + done, size - done,
+                       offset + (off_t)done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      sifs_error("Ошибка записи образа (смещение %lld, %zu байт): %s\n",
+                 (long long)offset + (long long)done, size - done,
+                 strerror(errno));
+      return -1;
+    }
+    if (n == 0) {
+      // Нулевая запись ненулевого буфера - считаем ошибкой устройства
+      sifs_error("Образ не принимает запись (смещение %lld)\n",
+                 (long long)offset + (long long)done);
+      errno = EIO;
+      return -1;
+    }
+    done += n;
+  }
+
+  return done;
+}
+
+// Пропускает в векторе done записанных байт. Возвращает число
+// оставшихся элементов, *iov указывает на первый из них
+static int iov_advance(struct iovec** iov, int iovcnt, size_t done) {
+  while (iovcnt > 0 && done >= (*iov)->iov_len) {
+    done -= (*iov)->iov_len;
+    (*iov)++;
+    iovcnt--;
+  }
+  if (iovcnt > 0) {
+    (*iov)->iov_base = (uint8_t*)(*iov)->iov_base + done;
+    (*iov)->iov_len -= done;
+  }
+  return iovcnt;
+}
+
+ssize_t image_writev(struct image* img, const struct iovec* iov, int iovcnt,
+                     off_t offset) {
+  if (iovcnt < 0 || iovcnt > IMAGE_IOV_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  size_t total = 0;
+  for (int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+
+  if (img->flags & IMAGE_MMAP) {
+    for (int i = 0; i < iovcnt; i++) {
+      if (image_write(img, iov[i].iov_base, iov[i].iov_len, offset) < 0) {
+        return -1;
+      }
+      offset += iov[i].iov_len;
+    }
+    return total;
+  }
+
+  // Вектор копируется: при частичной записи его элементы сдвигаются
+  struct iovec local[IMAGE_IOV_MAX];
+  memcpy(local, iov, iovcnt * sizeof(*iov));
+  struct iovec* cur = local;
+  size_t done = 0;
+
+  while (iovcnt > 0) {
+    ssize_t n = pwritev(img->fd, cur, iovcnt, offset + (off_t)done);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      sifs_error("Ошибка записи образа (смещение %lld, %zu байт): %s\n",
+                 (long long)offset + (long long)done, total - done,
+                 strerror(errno));
+      return -1;
+    }
+    if (n == 0) {
+      sifs_error("Образ не принимает запись (смещение %lld)\n",
+                 (long long)offset + (long long)done);
+      errno = EIO;
+      return -1;
+    }
+    done += n;
+    iovcnt = iov_advance(&cur, iovcnt, n);
+  }
+
+  return done;
+}
+
+ssize_t image_sendfile(struct image* img, int32_t out_fd, off_t offset,
+                       size_t size) {
+  if (img->flags & IMAGE_MMAP) {
+    if (offset >= img->size) return 0;
+    if ((off_t)size > img->size - offset) size = img->size - offset;
+  }
+
+  size_t done = 0;
+
+  // Передача может оборваться на части - досылаем остаток. Отображение
+  // пишется прямо из памяти образа, иначе данные идут через sendfile
+  // из страничного кэша образа
+  while (done < size) {
+    ssize_t n;
+    if (img->flags & IMAGE_MMAP) {
+      n = write(out_fd, img->map + offset + done, size - done);
+    } else {
+      off_t pos = offset + (off_t)done;
+      n = sendfile(out_fd, img->fd, &pos, size - done);
+    }
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return done ? (ssize_t)done : -1;
+    }
+    if (n == 0) break;  // Конец файла
+    done += n;
+  }
+
+  return done;
+}
+
+// Порция записи нулей, когда обнуление средствами ФС недоступно
+#define IMAGE_ZERO_CHUNK (64 * 1024)
+
+int32_t image_zero(struct image* img, off_t offset, uint64_t size) {
+  if (img->map) {
+    if (offset >= img->size) return 0;
+    if ((off_t)size > img->size - offset) size = img->size - offset;
+    memset(img->map + offset, 0, size);
+    return 0;
+  }
+
+  if (fallocate(img->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                offset, size) == 0) {
+    return 0;
+  }
+  if (errno != EOPNOTSUPP && errno != ENOSYS) {
+    sifs_error("Ошибка обнуления образа (смещение %lld, %llu байт): %s\n",
+               (long long)offset, (unsigned long long)size, strerror(errno));
+    return -1;
+  }
+
+  static const uint8_t zeros[IMAGE_ZERO_CHUNK];
+  while (size > 0) {
+    size_t n = size < IMAGE_ZERO_CHUNK ? size : IMAGE_ZERO_CHUNK;
+    if (image_write(img, zeros, n, offset) < 0) return -1;
+    offset += n;
+    size -= n;
+  }
+  return 0;
+}
+
+int32_t image_sync(struct image* img) {
+  if (img->map && msync(img->map, img->size, MS_SYNC) < 0) {
+    sifs_error("Ошибка синхронизации отображения: %s\n", strerror(errno));
+    return -1;
+  }
+  if (fsync(img->fd) < 0) {
+    sifs_error("Ошибка синхронизации образа: %s\n", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+int32_t image_fd(const struct image* img) {
+  return img->fd;
+}
+
+off_t image_size(const struct image* img) {
+  if (img->flags & IMAGE_MMAP) return img->size;
+
+  struct stat st;
+  if (fstat(img->fd, &st) < 0) return -1;
+  return st.st_size;
+}
+
+int32_t image_resize(struct image* img, off_t size) {
+  if (ftruncate(img->fd, size) < 0) {
+    sifs_error("Не удалось изменить размер образа до %lld: %s\n",
+               (long long)size, strerror(errno));
+    return -1;
+  }
+  if (!(img->flags & IMAGE_MMAP)) return 0;
+
+  // Отображение перестраивается под новый размер
+  void* map;
+  if (!img->map) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, img->fd, 0);
+  } else if (size == 0) {
+    munmap(img->map, img->size);
+    map = NULL;
+  } else {
+    map = mremap(img->map, img->size, size, MREMAP_MAYMOVE);
+  }
+
+  if (map == MAP_FAILED) {
+    sifs_error("Не удалось переотобразить образ: %s\n", strerror(errno));
+    return -1;
+  }
+
+  img->map = map;
+  img->size = size;
+  return 0;
+}
+
+// Выравнивает область вниз до границы страницы, как требуют msync/madvise
+static void page_align(off_t* offset, size_t* size) {
+  off_t page = sysconf(_SC_PAGESIZE);
+  off_t aligned = *offset & ~(page - 1);
+  *size += *offset - aligned;
+  *offset = aligned;
+}
+
+void* image_data(struct image* img, off_t offset, size_t size) {
+  if (!img->map || offset < 0 || offset + (off_t)size > img->size) {
+    return NULL;
+  }
+  return img->map + offset;
+}
+
+int32_t image_flush(struct image* img, off_t offset, size_t size) {
+  if (!img->map) {
+    if (fdatasync(img->fd) < 0) {
+      sifs_error("Ошибка сброса образа: %s\n", strerror(errno));
+      return -1;
+    }
+    return 0;
+  }
+
+  if (offset >= img->size) return 0;
+  if (offset + (off_t)size > img->size) size = img->size - offset;
+  page_align(&offset, &size);
+
+  if (msync(img->map + offset, size, MS_SYNC) < 0) {
+    sifs_error("Ошибка msync (смещение %lld, %zu байт): %s\n",
+               (long long)offset, size, strerror(errno));
+    return -1;
   }
   return 0;
 }
 
-ssize_t image_read(void* buffer, size_t size, off_t offset) {
-  if (lseek(image_fd, offset, SEEK_SET) == (off_t)-1) return -1;
-  return read(image_fd, buffer, size);
+int32_t image_advise(struct image* img, off_t offset, size_t size,
+                     enum image_advice advice) {
+  static const int madvice[] = {
+    [IMAGE_ADVICE_NORMAL] = MADV_NORMAL,
+    [IMAGE_ADVICE_SEQUENTIAL] = MADV_SEQUENTIAL,
+    [IMAGE_ADVICE_RANDOM] = MADV_RANDOM,
+    [IMAGE_ADVICE_WILLNEED] = MADV_WILLNEED
+  };
+  static const int fadvice[] = {
+    [IMAGE_ADVICE_NORMAL] = POSIX_FADV_NORMAL,
+    [IMAGE_ADVICE_SEQUENTIAL] = POSIX_FADV_SEQUENTIAL,
+    [IMAGE_ADVICE_RANDOM] = POSIX_FADV_RANDOM,
+    [IMAGE_ADVICE_WILLNEED] = POSIX_FADV_WILLNEED
+  };
+
+  if (!img->map) {
+    // posix_fadvise возвращает код ошибки, а не -1
+    int err = posix_fadvise(img->fd, offset, size, fadvice[advice]);
+    return err ? -1 : 0;
+  }
+
+  if (offset >= img->size) return 0;
+  if (offset + (off_t)size > img->size) size = img->size - offset;
+  page_align(&offset, &size);
+  return madvise(img->map + offset, size, madvice[advice]);
 }
 
-ssize_t image_write(const void* buffer, size_t size, off_t offset) {
-  if (lseek(image_fd, offset, SEEK_SET) == (off_t)-1) return -1;
-  return write(image_fd, buffer, size);
-}
\ No newline at end of file
+void image_advise_layout(struct image* img, const struct superblock* sb) {
+  off_t bs = sb->block_size;
+  uint32_t groups = sb->features & FS_FEATURE_GROUPS ? sb->count_groups : 1;
+
+  for (uint32_t g = 0; g < groups; g++) {
+    struct group_layout layout;
+    superblock_group_layout(sb, g, &layout);
+
+    // Битовые карты и таблица inode идут подряд и нужны сразу после
+    // открытия
+    uint64_t meta = layout.block_bitmap < layout.inode_bitmap
+                        ? layout.block_bitmap : layout.inode_bitmap;
+    off_t meta_start = (off_t)meta * bs;
+    off_t meta_end = (off_t)layout.first_data_block * bs;
+    image_advise(img, meta_start, meta_end - meta_start,
+                 IMAGE_ADVICE_WILLNEED);
+
+    // Данные файлов читаются преимущественно последовательно
+    off_t data_end = (off_t)layout.end_block * bs;
+    image_advise(img, meta_end, data_end - meta_end, IMAGE_ADVICE_SEQUENTIAL);
+  }
+}
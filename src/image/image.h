@@ -2,15 +2,95 @@
 
 #include <stdint.h>
 #include <unistd.h>
+#include <sys/uio.h>
+#include "../superblock/superblock.h"
 
-// Открыть образ SIFS
-extern int32_t image_open(const char* filename, int32_t truncate);
+// Флаги открытия образа
+#define IMAGE_TRUNCATE 0x1  // Обрезать файл до нулевой длины
+#define IMAGE_MMAP     0x2  // Отобразить образ в память целиком
 
-// Закрыть образ SIFS
-extern int32_t image_close(void);
+// Подсказки о характере доступа к области образа
+enum image_advice {
+  IMAGE_ADVICE_NORMAL,      // Без особенностей
+  IMAGE_ADVICE_SEQUENTIAL,  // Последовательное чтение (данные файлов)
+  IMAGE_ADVICE_RANDOM,      // Произвольный доступ
+  IMAGE_ADVICE_WILLNEED     // Область понадобится в ближайшее время
+};
 
-// Чтение образ SIFS
-extern ssize_t image_read(void* buffer, size_t size, off_t offset);
+// Открытый образ SIFS. Каждый дескриптор независим, поэтому одновременно
+// можно работать с несколькими образами, а позиционный ввод-вывод
+// (pread/pwrite) позволяет обращаться к одному образу из нескольких потоков.
+struct image;
 
-// Запись в образ SIFS
-extern ssize_t image_write(const void* buffer, size_t size, off_t offset);
+// Открыть образ SIFS (flags - комбинация IMAGE_*).
+// Возвращает NULL при ошибке (errno сохраняется)
+extern struct image* image_open(const char* filename, int32_t flags);
+
+// Закрыть образ SIFS и освободить дескриптор
+extern int32_t image_close(struct image* img);
+
+// Чтение образа SIFS. Читает ровно size байт, меньше - только при
+// достижении конца файла. Возвращает число байт или -1 при ошибке
+extern ssize_t image_read(struct image* img, void* buffer, size_t size,
+                          off_t offset);
+
+// Запись в образ SIFS. Записывает ровно size байт или возвращает -1.
+// В режиме IMAGE_MMAP образ не растет: запись за его концом завершается
+// с ENOSPC, поэтому отображение не перестраивается под читающими потоками
+extern ssize_t image_write(struct image* img, const void* buffer, size_t size,
+                           off_t offset);
+
+// Максимальное число элементов вектора для image_writev
+#define IMAGE_IOV_MAX 64
+
+// Векторная запись: элементы iov пишутся подряд с offset одним вызовом
+// pwritev (недописанный остаток дописывается). Возвращает общий размер
+// или -1 (errno = EINVAL при iovcnt > IMAGE_IOV_MAX)
+extern ssize_t image_writev(struct image* img, const struct iovec* iov,
+                            int iovcnt, off_t offset);
+
+// Передать size байт образа с offset в дескриптор out_fd без копирования
+// через пользовательский буфер (sendfile, для IMAGE_MMAP - запись прямо
+// из отображения). Возвращает число переданных байт (меньше size - при
+// конце образа или ошибке out_fd после части данных) или -1 (errno
+// сохраняется)
+extern ssize_t image_sendfile(struct image* img, int32_t out_fd, off_t offset,
+                              size_t size);
+
+// Обнулить область образа. Файловая система обнуляет ее без записи
+// данных (fallocate с FALLOC_FL_ZERO_RANGE); если это не поддерживается,
+// нули пишутся порциями из небольшого буфера. Размер образа не меняется.
+// Возвращает 0 или -1 при ошибке
+extern int32_t image_zero(struct image* img, off_t offset, uint64_t size);
+
+// Сбросить записанные данные образа на диск
+extern int32_t image_sync(struct image* img);
+
+// Указатель на область отображенного образа или NULL, если образ открыт
+// без IMAGE_MMAP либо область выходит за его пределы. Через него группы
+// блоков и кэш inode работают с картами и таблицей inode без копирования
+extern void* image_data(struct image* img, off_t offset, size_t size);
+
+// Сбросить на диск область образа: страницы отображения (msync) или,
+// без IMAGE_MMAP, данные файла образа целиком (fdatasync)
+extern int32_t image_flush(struct image* img, off_t offset, size_t size);
+
+// Файловый дескриптор образа (для движков асинхронного ввода-вывода)
+extern int32_t image_fd(const struct image* img);
+
+// Текущий размер образа в байтах
+extern off_t image_size(const struct image* img);
+
+// Изменить размер образа. В режиме IMAGE_MMAP отображение перестраивается
+// (и может переехать), поэтому вызывающий должен иметь к образу
+// монопольный доступ: никакие другие потоки не обращаются к нему
+extern int32_t image_resize(struct image* img, off_t size);
+
+// Передать ядру подсказку о доступе к области (madvise/posix_fadvise)
+extern int32_t image_advise(struct image* img, off_t offset, size_t size,
+                            enum image_advice advice);
+
+// Расставить подсказки по областям ФС (по каждой группе блоков):
+// таблица inode и битовые карты - WILLNEED, область данных - SEQUENTIAL
+extern void image_advise_layout(struct image* img,
+                                const struct superblock* sb);
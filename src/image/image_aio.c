@@ -0,0 +1,508 @@
+#define _GNU_SOURCE
+#include "image_aio.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../debug/debug.h"
+
+// Тип запроса
+enum aio_opcode {
+  AIO_READ,
+  AIO_WRITE
+};
+
+// Слот запроса: существует от постановки до сбора завершения
+struct aio_request {
+  enum aio_opcode opcode;
+  uint8_t* buffer;
+  size_t size;
+  off_t offset;
+  size_t done;            // Уже переданные байты (частичные передачи)
+  ssize_t result;         // Результат для пула потоков
+  uint64_t user_data;
+  int32_t next_free;      // Список свободных слотов
+};
+
+// Кольцевая очередь номеров слотов
+struct slot_queue {
+  uint32_t* slots;
+  uint32_t head;
+  uint32_t count;
+};
+
+// Отображенные кольца io_uring
+struct uring {
+  int32_t fd;
+  void* sq_ptr;
+  size_t sq_size;
+  void* cq_ptr;
+  size_t cq_size;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  uint32_t* sq_head;
+  uint32_t* sq_tail;
+  uint32_t* sq_mask;
+  uint32_t* sq_array;
+  uint32_t* cq_head;
+  uint32_t* cq_tail;
+  uint32_t* cq_mask;
+  struct io_uring_cqe* cqes;
+};
+
+// Резервный пул потоков
+struct thread_pool {
+  pthread_t threads[IMAGE_AIO_THREADS];
+  uint32_t count;
+  pthread_mutex_t lock;
+  pthread_cond_t work;      // Появились запросы
+  pthread_cond_t done;      // Появились завершения
+  struct slot_queue pending;
+  struct slot_queue completed;
+  bool stop;
+};
+
+struct image_aio {
+  struct image* img;
+  int32_t fd;
+  uint32_t depth;
+  struct aio_request* requests;
+  int32_t free_head;
+  struct slot_queue prepared;     // Подготовлены, но не отправлены
+  uint32_t inflight;              // Отправлены, но не собраны
+  uint32_t sq_pending;            // SQE в кольце, еще не принятые ядром
+  bool use_uring;
+  struct uring ring;
+  struct thread_pool pool;
+};
+
+static void queue_push(struct slot_queue* q, uint32_t depth, uint32_t slot) {
+  q->slots[(q->head + q->count++) % depth] = slot;
+}
+
+static uint32_t queue_pop(struct slot_queue* q, uint32_t depth) {
+  uint32_t slot = q->slots[q->head];
+  q->head = (q->head + 1) % depth;
+  q->count--;
+  return slot;
+}
+
+// Освобождает слот после сбора завершения
+static void release_slot(struct image_aio* aio, uint32_t slot) {
+  aio->requests[slot].next_free = aio->free_head;
+  aio->free_head = slot;
+}
+
+/* ---------- io_uring ---------- */
+
+static int32_t uring_setup(struct uring* ring, uint32_t entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) return -1;
+
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  ring->cq_size = params.cq_off.cqes +
+      params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // Современные ядра отображают оба кольца одним вызовом
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single && ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+
+  ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ptr == MAP_FAILED) goto fail_fd;
+
+  if (single) {
+    ring->cq_ptr = ring->sq_ptr;
+    ring->cq_size = 0;
+  } else {
+    ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) goto fail_sq;
+  }
+
+  ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) goto fail_cq;
+
+  uint8_t* sq = ring->sq_ptr;
+  uint8_t* cq = ring->cq_ptr;
+  ring->sq_head = (uint32_t*)(sq + params.sq_off.head);
+  ring->sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+  ring->sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (uint32_t*)(sq + params.sq_off.array);
+  ring->cq_head = (uint32_t*)(cq + params.cq_off.head);
+  ring->cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+  ring->cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  return 0;
+
+fail_cq:
+  if (ring->cq_size) munmap(ring->cq_ptr, ring->cq_size);
+fail_sq:
+  munmap(ring->sq_ptr, ring->sq_size);
+fail_fd:
+  close(ring->fd);
+  return -1;
+}
+
+static void uring_teardown(struct uring* ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_size) munmap(ring->cq_ptr, ring->cq_size);
+  munmap(ring->sq_ptr, ring->sq_size);
+  close(ring->fd);
+}
+
+// Помещает в кольцо SQE для оставшейся части запроса
+static void uring_queue(struct image_aio* aio, uint32_t slot) {
+  struct uring* ring = &aio->ring;
+  struct aio_request* req = &aio->requests[slot];
+
+  uint32_t tail = *ring->sq_tail;
+  uint32_t index = tail & *ring->sq_mask;
+  struct io_uring_sqe* sqe = &ring->sqes[index];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = req->opcode == AIO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+  sqe->fd = aio->fd;
+  sqe->addr = (uint64_t)(uintptr_t)(req->buffer + req->done);
+  sqe->len = req->size - req->done;
+  sqe->off = req->offset + req->done;
+  sqe->user_data = slot;
+
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// Передает ядру to_submit SQE, при необходимости ожидая min_complete CQE
+static int32_t uring_enter(struct uring* ring, uint32_t to_submit,
+                           uint32_t min_complete) {
+  uint32_t flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+
+  while (1) {
+    int32_t n = syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                        min_complete, flags, NULL, 0);
+    if (n >= 0 || errno != EINTR) return n;
+  }
+}
+
+// Передает ядру непринятые SQE, при необходимости ожидая min_complete CQE.
+// Не принятые при ошибке SQE остаются в кольце до следующего вызова
+static int32_t uring_flush(struct image_aio* aio, uint32_t min_complete) {
+  int32_t n = uring_enter(&aio->ring, aio->sq_pending, min_complete);
+  if (n < 0) {
+    sifs_error("io_uring_enter: %s\n", strerror(errno));
+    return -1;
+  }
+  aio->sq_pending -= n;
+  return 0;
+}
+
+static int32_t uring_submit(struct image_aio* aio) {
+  uint32_t count = aio->prepared.count;
+  while (aio->prepared.count) {
+    uring_queue(aio, queue_pop(&aio->prepared, aio->depth));
+  }
+  aio->sq_pending += count;
+  aio->inflight += count;
+
+  // Ядро может принять SQE не за один вызов
+  while (aio->sq_pending) {
+    if (uring_flush(aio, 0) < 0) return -1;
+  }
+  return count;
+}
+
+static int32_t uring_reap(struct image_aio* aio,
+                          struct image_aio_completion* out,
+                          uint32_t max, uint32_t min_wait) {
+  struct uring* ring = &aio->ring;
+  uint32_t collected = 0;
+
+  while (collected < max) {
+    uint32_t head = *ring->cq_head;
+    uint32_t tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    // Собранные завершения уже сняты с кольца, поэтому при ошибке
+    // ожидания возвращаются они, а не -1
+    if (head == tail) {
+      if (collected >= min_wait) break;
+      if (uring_flush(aio, 1) < 0) return collected ? (int32_t)collected : -1;
+      continue;
+    }
+
+    struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cq_mask];
+    uint32_t slot = cqe->user_data;
+    int32_t res = cqe->res;
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    struct aio_request* req = &aio->requests[slot];
+    if (res == -EINTR || res == -EAGAIN ||
+        (res > 0 && req->done + res < req->size)) {
+      // Частичная или прерванная передача - дозапрашиваем остаток
+      if (res > 0) req->done += res;
+      uring_queue(aio, slot);
+      aio->sq_pending++;
+      if (uring_flush(aio, 0) < 0) return collected ? (int32_t)collected : -1;
+      continue;
+    }
+
+    ssize_t result = res < 0 ? res : (ssize_t)(req->done + res);
+    out[collected].user_data = req->user_data;
+    out[collected].result = result;
+    collected++;
+
+    aio->inflight--;
+    release_slot(aio, slot);
+  }
+
+  return collected;
+}
+
+/* ---------- пул потоков ---------- */
+
+static void* pool_worker(void* arg) {
+  struct image_aio* aio = arg;
+  struct thread_pool* pool = &aio->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->stop && pool->pending.count == 0) {
+      pthread_cond_wait(&pool->work, &pool->lock);
+    }
+    if (pool->pending.count == 0) break;  // Остановка без работы
+
+    uint32_t slot = queue_pop(&pool->pending, aio->depth);
+    pthread_mutex_unlock(&pool->lock);
+
+    // image_read/image_write сами дочитывают и дописывают остаток
+    struct aio_request* req = &aio->requests[slot];
+    ssize_t n = req->opcode == AIO_READ ?
+        image_read(aio->img, req->buffer, req->size, req->offset) :
+        image_write(aio->img, req->buffer, req->size, req->offset);
+    req->result = n < 0 ? -errno : n;
+
+    pthread_mutex_lock(&pool->lock);
+    queue_push(&pool->completed, aio->depth, slot);
+    pthread_cond_signal(&pool->done);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static int32_t pool_start(struct image_aio* aio) {
+  struct thread_pool* pool = &aio->pool;
+
+  pool->pending.slots = calloc(aio->depth, sizeof(uint32_t));
+  pool->completed.slots = calloc(aio->depth, sizeof(uint32_t));
+  if (!pool->pending.slots || !pool->completed.slots) return -1;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (; pool->count < IMAGE_AIO_THREADS; pool->count++) {
+    if (pthread_create(&pool->threads[pool->count], NULL, pool_worker,
+                       aio) != 0) {
+      break;
+    }
+  }
+  return pool->count ? 0 : -1;
+}
+
+static void pool_stop(struct image_aio* aio) {
+  struct thread_pool* pool = &aio->pool;
+
+  if (pool->count) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->count; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+  }
+
+  free(pool->pending.slots);
+  free(pool->completed.slots);
+}
+
+static int32_t pool_submit(struct image_aio* aio) {
+  struct thread_pool* pool = &aio->pool;
+  uint32_t count = aio->prepared.count;
+
+  pthread_mutex_lock(&pool->lock);
+  while (aio->prepared.count) {
+    queue_push(&pool->pending, aio->depth,
+               queue_pop(&aio->prepared, aio->depth));
+  }
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+
+  aio->inflight += count;
+  return count;
+}
+
+static int32_t pool_reap(struct image_aio* aio,
+                         struct image_aio_completion* out,
+                         uint32_t max, uint32_t min_wait) {
+  struct thread_pool* pool = &aio->pool;
+  uint32_t collected = 0;
+
+  pthread_mutex_lock(&pool->lock);
+  while (collected < max) {
+    if (pool->completed.count == 0) {
+      if (collected >= min_wait) break;
+      pthread_cond_wait(&pool->done, &pool->lock);
+      continue;
+    }
+
+    uint32_t slot = queue_pop(&pool->completed, aio->depth);
+    out[collected].user_data = aio->requests[slot].user_data;
+    out[collected].result = aio->requests[slot].result;
+    collected++;
+
+    aio->inflight--;
+    release_slot(aio, slot);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return collected;
+}
+
+/* ---------- общий интерфейс ---------- */
+
+struct image_aio* image_aio_create(struct image* img,
+                                   uint32_t queue_depth,
+                                   int32_t flags) {
+  if (queue_depth == 0) return NULL;
+
+  struct image_aio* aio = calloc(1, sizeof(*aio));
+  if (!aio) return NULL;
+
+  aio->img = img;
+  aio->fd = image_fd(img);
+  aio->depth = queue_depth;
+  aio->requests = calloc(queue_depth, sizeof(struct aio_request));
+  aio->prepared.slots = calloc(queue_depth, sizeof(uint32_t));
+  if (!aio->requests || !aio->prepared.slots) goto fail;
+
+  for (uint32_t i = 0; i < queue_depth; i++) {
+    aio->requests[i].next_free = i + 1 < queue_depth ? (int32_t)i + 1 : -1;
+  }
+  aio->free_head = 0;
+
+  if (!(flags & IMAGE_AIO_FORCE_THREADS) &&
+      uring_setup(&aio->ring, queue_depth) == 0) {
+    aio->use_uring = true;
+  } else {
+    if (!(flags & IMAGE_AIO_FORCE_THREADS)) {
+      sifs_info("io_uring недоступен (%s), используется пул потоков\n",
+                strerror(errno));
+    }
+    if (pool_start(aio) < 0) {
+      pool_stop(aio);
+      goto fail;
+    }
+  }
+
+  sifs_debug("Движок ввода-вывода %s, глубина очереди %u\n",
+             image_aio_engine(aio), queue_depth);
+  return aio;
+
+fail:
+  free(aio->prepared.slots);
+  free(aio->requests);
+  free(aio);
+  return NULL;
+}
+
+void image_aio_destroy(struct image_aio* aio) {
+  if (!aio) return;
+
+  // Отправленные запросы дожидаемся, неотправленные просто отбрасываем
+  struct image_aio_completion sink[16];
+  while (aio->inflight) {
+    if (image_aio_reap(aio, sink, 16, 1) < 0) break;
+  }
+
+  if (aio->use_uring) {
+    uring_teardown(&aio->ring);
+  } else {
+    pool_stop(aio);
+  }
+
+  free(aio->prepared.slots);
+  free(aio->requests);
+  free(aio);
+}
+
+const char* image_aio_engine(const struct image_aio* aio) {
+  return aio->use_uring ? "io_uring" : "threads";
+}
+
+// Занимает слот и добавляет запрос в подготовленный пакет
+static int32_t prep(struct image_aio* aio, enum aio_opcode opcode,
+                    void* buffer, size_t size, off_t offset,
+                    uint64_t user_data) {
+  if (aio->free_head < 0) return -1;
+
+  uint32_t slot = aio->free_head;
+  struct aio_request* req = &aio->requests[slot];
+  aio->free_head = req->next_free;
+
+  req->opcode = opcode;
+  req->buffer = buffer;
+  req->size = size;
+  req->offset = offset;
+  req->done = 0;
+  req->result = 0;
+  req->user_data = user_data;
+
+  queue_push(&aio->prepared, aio->depth, slot);
+  return 0;
+}
+
+int32_t image_aio_prep_read(struct image_aio* aio, void* buffer,
+                            size_t size, off_t offset, uint64_t user_data) {
+  return prep(aio, AIO_READ, buffer, size, offset, user_data);
+}
+
+int32_t image_aio_prep_write(struct image_aio* aio, const void* buffer,
+                             size_t size, off_t offset, uint64_t user_data) {
+  return prep(aio, AIO_WRITE, (void*)buffer, size, offset, user_data);
+}
+
+int32_t image_aio_submit(struct image_aio* aio) {
+  if (aio->prepared.count == 0) return 0;
+  return aio->use_uring ? uring_submit(aio) : pool_submit(aio);
+}
+
+int32_t image_aio_reap(struct image_aio* aio,
+                       struct image_aio_completion* out,
+                       uint32_t max,
+                       uint32_t min_wait) {
+  // Ждать больше, чем отправлено, нельзя - иначе ожидание не завершится
+  if (min_wait > aio->inflight) min_wait = aio->inflight;
+  if (max == 0 || aio->inflight == 0) return 0;
+
+  return aio->use_uring ? uring_reap(aio, out, max, min_wait) :
+      pool_reap(aio, out, max, min_wait);
+}
+
+uint32_t image_aio_inflight(const struct image_aio* aio) {
+  return aio->inflight;
+}
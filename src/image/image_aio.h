@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <unistd.h>
+#include "image.h"
+
+// Флаги создания движка асинхронного ввода-вывода
+#define IMAGE_AIO_FORCE_THREADS 0x1   // Не использовать io_uring
+
+// Число рабочих потоков резервного движка
+#define IMAGE_AIO_THREADS 4
+
+// Движок пакетного асинхронного ввода-вывода над образом.
+// Основная реализация - io_uring (системные вызовы напрямую, без liburing);
+// если ядро его не поддерживает, используется пул потоков с pread/pwrite.
+// Движок не потокобезопасен: один движок обслуживает одного владельца.
+struct image_aio;
+
+// Завершенный запрос
+struct image_aio_completion {
+  uint64_t user_data;   // Значение, переданное при постановке запроса
+  ssize_t result;       // Число байт или -errno
+};
+
+// Создает движок с очередью глубиной queue_depth запросов.
+// Возвращает NULL при ошибке
+extern struct image_aio* image_aio_create(struct image* img,
+                                          uint32_t queue_depth,
+                                          int32_t flags);
+
+// Дожидается всех запросов и освобождает движок
+extern void image_aio_destroy(struct image_aio* aio);
+
+// Название используемого движка ("io_uring" или "threads")
+extern const char* image_aio_engine(const struct image_aio* aio);
+
+// Ставит в пакет чтение size байт по смещению offset.
+// Возвращает 0 или -1, если очередь заполнена (нужно собрать завершения)
+extern int32_t image_aio_prep_read(struct image_aio* aio, void* buffer,
+                                   size_t size, off_t offset,
+                                   uint64_t user_data);
+
+// Ставит в пакет запись size байт по смещению offset
+extern int32_t image_aio_prep_write(struct image_aio* aio, const void* buffer,
+                                    size_t size, off_t offset,
+                                    uint64_t user_data);
+
+// Отправляет подготовленный пакет на выполнение одним вызовом.
+// Возвращает число отправленных запросов или -1
+extern int32_t image_aio_submit(struct image_aio* aio);
+
+// Собирает до max завершений, ожидая не менее min_wait.
+// Частичные передачи дозапрашиваются автоматически, поэтому результат -
+// полный размер, меньший размер только при конце файла, либо -errno.
+// Возвращает число собранных завершений (при ошибке ожидания - уже
+// собранные, возможно меньше min_wait) или -1, если не собрано ни одного
+extern int32_t image_aio_reap(struct image_aio* aio,
+                              struct image_aio_completion* out,
+                              uint32_t max,
+                              uint32_t min_wait);
+
+// Число запросов, отправленных, но еще не собранных
+extern uint32_t image_aio_inflight(const struct image_aio* aio);
@@ -1,5 +1,7 @@
 #include "inode_bitmap.h"
+#include <inttypes.h>
 #include <string.h>
+#include "../bitops/bitops.h"
 #include "../debug/debug.h"
 
 void get_bitmap_offset(uint32_t inode_idx,
@@ -15,30 +17,36 @@ void get_bitmap_offset(uint32_t inode_idx,
              inode_idx, *byte_offset, *bit_offset);
 }
 
+void inode_bitmap_init_range(const struct superblock* sb, uint8_t* chunk,
+                             uint32_t first_byte, size_t size) {
+  memset(chunk, 0, size);
+
+  // Зарезервированы inode 0 (не используется) и корневой
+  uint32_t reserved[] = { 0, sb->root_inode };
+  for (uint32_t i = 0; i < 2; i++) {
+    uint32_t byte_offset;
+    uint8_t bit_offset;
+    get_bitmap_offset(reserved[i], &byte_offset, &bit_offset);
+    if (byte_offset >= first_byte && byte_offset - first_byte < size) {
+      chunk[byte_offset - first_byte] |= 1 << bit_offset;
+    }
+  }
+}
+
 void inode_bitmap_init(struct superblock* sb, uint8_t* bitmap) {
   sifs_debug("Инициализация битовой карты inode\n");
 
   // Расчет размера битовой карты в блоках и байтах
-  uint32_t bitmap_blocks = get_bitmap_blocks(sb->count_inodes, sb->block_size);
-  uint32_t bitmap_size = bitmap_blocks * sb->block_size;
+  uint64_t bitmap_blocks = get_bitmap_blocks(sb->count_inodes, sb->block_size);
+  uint64_t bitmap_size = bitmap_blocks * sb->block_size;
 
-  sifs_debug("Размер битмапа: %u байт (%u блоков)\n", bitmap_size,
-             bitmap_blocks);
-
-  memset(bitmap, 0, bitmap_size);
-  sifs_debug("Битовая карта обнулена\n");
-
-  // Резервирование inode 0 (не используется)
-  uint32_t byte_offset;
-  uint8_t bit_offset;
-  get_bitmap_offset(0, &byte_offset, &bit_offset);
-  bitmap[byte_offset] |= 1 << bit_offset;
-  sifs_debug("Inode 0 помечен как занятый\n");
+  sifs_debug("Размер битмапа: %" PRIu64 " байт (%" PRIu64 " блоков)\n",
+             bitmap_size, bitmap_blocks);
 
-  // Резервирование корневого inode (обычно индекс 1)
-  get_bitmap_offset(sb->root_inode, &byte_offset, &bit_offset);
-  bitmap[byte_offset] |= 1 << bit_offset;
-  sifs_debug("Корневой inode %u помечен как занятый\n", sb->root_inode);
+  // Обнуление и резервирование inode 0 и корневого inode
+  inode_bitmap_init_range(sb, bitmap, 0, bitmap_size);
+  sifs_debug("Inode 0 и корневой inode %u помечены как занятые\n",
+             sb->root_inode);
 
   // Обновление счетчика свободных inode в суперблоке
   sb->count_free_inodes = sb->count_inodes - 2; // -2 (inode 0 и корневой)
@@ -126,58 +134,16 @@ void free_inode(struct superblock* sb, uint8_t* bitmap, uint32_t inode_idx) {
 uint32_t count_free_inodes(const struct superblock* sb, const uint8_t* bitmap) {
   sifs_debug("Подсчет свободных inodes\n");
 
+  // Inode 0 зарезервирован и в подсчет не входит
   uint32_t count = 0;
-  const uint32_t total_bytes = (sb->count_inodes + 7) / 8; // Округление вверх
-
-  // Обработка первого байта (особый случай - пропуск inode 0)
-  if (total_bytes > 0) {
-    uint8_t byte = bitmap[0];
-    // Проверка только битов 1-7 (inode 1-7)
-    for (uint8_t bit = 1; bit < 8 && bit < sb->count_inodes; ++bit) {
-      if (!(byte & 1 << bit)) count++; // Подсчет нулевых битов
-    }
-  }
-
-  // Обработка полных средних байтов
-  for (uint32_t byte_idx = 1; byte_idx < total_bytes - 1; ++byte_idx) {
-    // Использование lookup-таблицы для быстрого подсчета нулевых битов
-    static const uint8_t lookup_table[256] = {
-      8, 7, 7, 6, 7, 6, 6, 5, 7, 6, 6, 5, 6, 5, 5, 4, 7, 6, 6, 5, 6, 5, 5, 4,
-      6, 5, 5, 4, 5, 4, 4, 3,
-      7, 6, 6, 5, 6, 5, 5, 4, 6, 5, 5, 4, 5, 4, 4, 3, 6, 5, 5, 4, 5, 4, 4, 3,
-      5, 4, 4, 3, 4, 3, 3, 2,
-      7, 6, 6, 5, 6, 5, 5, 4, 6, 5, 5, 4, 5, 4, 4, 3, 6, 5, 5, 4, 5, 4, 4, 3,
-      5, 4, 4, 3, 4, 3, 3, 2,
-      6, 5, 5, 4, 5, 4, 4, 3, 5, 4, 4, 3, 4, 3, 3, 2, 5, 4, 4, 3, 4, 3, 3, 2,
-      4, 3, 3, 2, 3, 2, 2, 1,
-      7, 6, 6, 5, 6, 5, 5, 4, 6, 5, 5, 4, 5, 4, 4, 3, 6, 5, 5, 4, 5, 4, 4, 3,
-      5, 4, 4, 3, 4, 3, 3, 2,
-      6, 5, 5, 4, 5, 4, 4, 3, 5, 4, 4, 3, 4, 3, 3, 2, 5, 4, 4, 3, 4, 3, 3, 2,
-      4, 3, 3, 2, 3, 2, 2, 1,
-      6, 5, 5, 4, 5, 4, 4, 3, 5, 4, 4, 3, 4, 3, 3, 2, 5, 4, 4, 3, 4, 3, 3, 2,
-      4, 3, 3, 2, 3, 2, 2, 1,
-      5, 4, 4, 3, 4, 3, 3, 2, 4, 3, 3, 2, 3, 2, 2, 1, 4, 3, 3, 2, 3, 2, 2, 1,
-      3, 2, 2, 1, 2, 1, 1, 0
-  };
-    count += lookup_table[bitmap[byte_idx]];
-  }
-
-  // Обработка последнего байта (если требуется частичная проверка)
-  if (total_bytes > 1) {
-    uint32_t last_byte = total_bytes - 1;
-    uint8_t byte = bitmap[last_byte];
-    uint8_t valid_bits = sb->count_inodes % 8;
-    if (valid_bits == 0) valid_bits = 8; // Корректировка для полных байтов
-
-    // Проверка только значимых битов
-    for (uint8_t bit = 0; bit < valid_bits; ++bit) {
-      if (!(byte & 1 << bit)) count++;
-    }
+  if (sb->count_inodes > 1) {
+    count = sb->count_inodes - 1 -
+        bitmap_count_ones(bitmap, 1, sb->count_inodes - 1);
   }
 
   // Проверка согласованности с суперблоком
   if (count != sb->count_free_inodes) {
-    sifs_debug(
+    sifs_warn(
         "Обнаружено несоответствие! Подсчитано: %u, в суперблоке: %u\n",
         count, sb->count_free_inodes);
   } else {
@@ -2,12 +2,20 @@
 
 #include "../superblock/superblock.h"
 #include <stdbool.h>
+#include <stddef.h>
 
 // Рассчитывает смещение в битовой карте для указанного inode
 extern void get_bitmap_offset(uint32_t inode_idx,
                                             uint32_t* byte_offset,
                                             uint8_t* bit_offset);
 
+// Заполняет chunk начальным содержимым байтов [first_byte, first_byte + size)
+// битовой карты inode (для записи карты порциями)
+extern void inode_bitmap_init_range(const struct superblock* sb,
+                                    uint8_t* chunk,
+                                    uint32_t first_byte,
+                                    size_t size);
+
 // Инициализирует битовую карту inode (помечает зарезервированные inode)
 extern void inode_bitmap_init(struct superblock* sb, uint8_t* bitmap);
 
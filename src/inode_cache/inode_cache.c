@@ -0,0 +1,399 @@
+#include "inode_cache.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../debug/debug.h"
+#include "../image/image.h"
+#include "../inode_table/inode_table.h"
+
+static uint32_t hash_ino(const struct inode_cache* cache, uint32_t ino) {
+  return (ino * 0x9E3779B1u) & cache->hash_mask;
+}
+
+// Ищет inode. Возвращает индекс или -1
+static int32_t lookup(const struct inode_cache* cache, uint32_t ino) {
+  int32_t i = cache->hash[hash_ino(cache, ino)];
+  while (i >= 0 && cache->inodes[i].ino != ino) {
+    i = cache->inodes[i].hash_next;
+  }
+  return i;
+}
+
+static void hash_insert(struct inode_cache* cache, int32_t i) {
+  uint32_t bucket = hash_ino(cache, cache->inodes[i].ino);
+  cache->inodes[i].hash_next = cache->hash[bucket];
+  cache->hash[bucket] = i;
+}
+
+static void hash_remove(struct inode_cache* cache, int32_t i) {
+  int32_t* link = &cache->hash[hash_ino(cache, cache->inodes[i].ino)];
+  while (*link != i) link = &cache->inodes[*link].hash_next;
+  *link = cache->inodes[i].hash_next;
+}
+
+static void dirty_add(struct inode_cache* cache, int32_t i) {
+  struct cached_inode* ci = &cache->inodes[i];
+  if (ci->dirty) return;
+
+  ci->dirty = true;
+  ci->dirty_prev = -1;
+  ci->dirty_next = cache->dirty_head;
+  if (cache->dirty_head >= 0) cache->inodes[cache->dirty_head].dirty_prev = i;
+  cache->dirty_head = i;
+}
+
+static void dirty_remove(struct inode_cache* cache, int32_t i) {
+  struct cached_inode* ci = &cache->inodes[i];
+  if (!ci->dirty) return;
+
+  if (ci->dirty_prev >= 0) {
+    cache->inodes[ci->dirty_prev].dirty_next = ci->dirty_next;
+  } else {
+    cache->dirty_head = ci->dirty_next;
+  }
+  if (ci->dirty_next >= 0) {
+    cache->inodes[ci->dirty_next].dirty_prev = ci->dirty_prev;
+  }
+  ci->dirty = false;
+}
+
+// Блок образа с inode и смещение inode в нем
+static uint64_t inode_block(const struct superblock* sb, uint32_t ino,
+                            uint32_t* byte) {
+  uint64_t block;
+  get_inode_position(sb, ino, &block, byte);
+  return inode_table_disk_block(sb, block);
+}
+
+// Номер первого inode в блоке таблицы с inode ino
+static uint32_t block_first(const struct inode_cache* cache, uint32_t ino) {
+  uint32_t per_block = cache->sb->block_size >> INODE_SIZE_SHIFT;
+  return ino & ~(per_block - 1);
+}
+
+// Блок таблицы в отображенном образе или NULL
+static uint8_t* mapped_block(const struct inode_cache* cache, uint64_t block) {
+  uint32_t bs = cache->sb->block_size;
+  return image_data(cache->bcache->img, (off_t)block * bs, bs);
+}
+
+// Копирует в блок таблицы data (буфер кэша блоков или блок в отображении),
+// начинающийся с inode first, все грязные inode этого блока
+static void flush_into(struct inode_cache* cache, uint32_t first,
+                       uint8_t* data) {
+  const struct superblock* sb = cache->sb;
+  uint32_t per_block = sb->block_size >> INODE_SIZE_SHIFT;
+  uint32_t byte;
+  inode_block(sb, first, &byte);
+
+  for (uint32_t n = first; n < first + per_block && n < sb->count_inodes;
+       n++) {
+    int32_t j = lookup(cache, n);
+    if (j < 0 || !cache->inodes[j].dirty) continue;
+
+    memcpy(data + byte + ((n - first) << INODE_SIZE_SHIFT),
+           &cache->inodes[j].disk, INODE_SIZE);
+    dirty_remove(cache, j);
+    cache->stats.inode_writes++;
+  }
+  cache->stats.block_writes++;
+}
+
+// Переносит грязные inode блока таблицы с inode first прямо в отображение.
+// Возвращает 0 или -1 с EIO, если блок вне образа
+static int32_t flush_mapped(struct inode_cache* cache, uint32_t first,
+                            uint64_t block) {
+  uint8_t* data = mapped_block(cache, block);
+  if (!data) {
+    errno = EIO;
+    return -1;
+  }
+  flush_into(cache, first, data);
+  return 0;
+}
+
+// Переносит в буфер кэша блоков (или в отображение) блок таблицы с inode
+// записи i вместе со всеми грязными inode этого блока. Номер блока
+// образа возвращается в block
+static int32_t flush_block(struct inode_cache* cache, int32_t i,
+                           uint64_t* block) {
+  uint32_t first = block_first(cache, cache->inodes[i].ino);
+  uint32_t byte;
+  *block = inode_block(cache->sb, first, &byte);
+  if (cache->mapped) return flush_mapped(cache, first, *block);
+
+  struct cache_buffer* buf = block_cache_get(cache->bcache, *block, true);
+  if (!buf) return -1;
+  flush_into(cache, first, buf->data);
+  block_cache_mark_dirty(cache->bcache, buf);
+  block_cache_release(cache->bcache, buf);
+  return 0;
+}
+
+// Выбирает запись для нового inode по алгоритму CLOCK. Грязная запись
+// возвращается как есть: ее сбрасывает вызывающий.
+// Возвращает индекс или -1, если на все inode есть ссылки
+static int32_t evict(struct inode_cache* cache) {
+  for (uint32_t step = 0; step < 2 * cache->capacity; step++) {
+    int32_t i = cache->clock_hand;
+    struct cached_inode* ci = &cache->inodes[i];
+    cache->clock_hand = (cache->clock_hand + 1) % cache->capacity;
+
+    if (ci->refs) continue;
+    if (!ci->valid) return i;
+    if (ci->referenced) {
+      ci->referenced = false;
+      continue;
+    }
+    return i;
+  }
+
+  return -1;
+}
+
+// Сбрасывает грязную запись i, выбранную для вытеснения. Блок таблицы
+// закрепляется в кэше блоков (возможно, с чтением образа) при снятой
+// блокировке кэша inode; в отображение inode копируются сразу.
+// Возвращает 0 или -1
+static int32_t evict_flush(struct inode_cache* cache, int32_t i) {
+  uint32_t first = block_first(cache, cache->inodes[i].ino);
+  uint32_t byte;
+  uint64_t block = inode_block(cache->sb, first, &byte);
+  if (cache->mapped) return flush_mapped(cache, first, block);
+
+  pthread_mutex_unlock(&cache->lock);
+  struct cache_buffer* buf = block_cache_get(cache->bcache, block, true);
+  pthread_mutex_lock(&cache->lock);
+  if (!buf) return -1;
+
+  // За это время inode блока могли сбросить или снова изменить:
+  // копируются те, что грязные сейчас
+  flush_into(cache, first, buf->data);
+  block_cache_mark_dirty(cache->bcache, buf);
+  block_cache_release(cache->bcache, buf);
+  return 0;
+}
+
+struct inode_cache* inode_cache_create(struct block_cache* bcache,
+                                       const struct superblock* sb,
+                                       uint32_t capacity) {
+  if (capacity == 0) capacity = INODE_CACHE_DEFAULT_CAPACITY;
+
+  struct inode_cache* cache = calloc(1, sizeof(*cache));
+  if (!cache) return NULL;
+
+  uint32_t buckets = 1;
+  while (buckets < 2 * capacity) buckets <<= 1;
+
+  cache->bcache = bcache;
+  cache->sb = sb;
+  cache->mapped = image_data(bcache->img, 0, sb->block_size) != NULL;
+  cache->capacity = capacity;
+  cache->hash_mask = buckets - 1;
+  cache->dirty_head = -1;
+  cache->hash = malloc(buckets * sizeof(int32_t));
+  cache->inodes = calloc(capacity, sizeof(struct cached_inode));
+  if (!cache->hash || !cache->inodes) {
+    free(cache->hash);
+    free(cache->inodes);
+    free(cache);
+    return NULL;
+  }
+
+  memset(cache->hash, 0xFF, buckets * sizeof(int32_t));  // Все цепочки -1
+  pthread_mutex_init(&cache->lock, NULL);
+  pthread_cond_init(&cache->loaded, NULL);
+
+  sifs_debug("Кэш inode: %u записей\n", capacity);
+  return cache;
+}
+
+int32_t inode_cache_destroy(struct inode_cache* cache) {
+  if (!cache) return 0;
+
+  int32_t result = inode_cache_sync(cache);
+
+  pthread_mutex_destroy(&cache->lock);
+  pthread_cond_destroy(&cache->loaded);
+  free(cache->hash);
+  free(cache->inodes);
+  free(cache);
+  return result;
+}
+
+struct cached_inode* inode_cache_get(struct inode_cache* cache,
+                                     uint32_t ino,
+                                     bool read) {
+  if (ino == 0 || ino >= cache->sb->count_inodes) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  struct cached_inode* ci;
+  while (1) {
+    int32_t i = lookup(cache, ino);
+    if (i >= 0) {
+      ci = &cache->inodes[i];
+      if (ci->loading) {
+        pthread_cond_wait(&cache->loaded, &cache->lock);
+        continue;
+      }
+      ci->refs++;
+      ci->referenced = true;
+      cache->stats.hits++;
+      pthread_mutex_unlock(&cache->lock);
+      return ci;
+    }
+
+    i = evict(cache);
+    if (i < 0) {
+      sifs_warn("Кэш inode: на все %u записей есть ссылки\n",
+                cache->capacity);
+      pthread_mutex_unlock(&cache->lock);
+      errno = EBUSY;
+      return NULL;
+    }
+    ci = &cache->inodes[i];
+    if (!ci->dirty) break;
+
+    // Пока блокировка снята, inode могли загрузить другие потоки, поэтому
+    // поиск повторяется
+    if (evict_flush(cache, i) < 0) {
+      int saved = errno;
+      sifs_error("Не удалось записать inode %u\n", ci->ino);
+      pthread_mutex_unlock(&cache->lock);
+      errno = saved;
+      return NULL;
+    }
+  }
+
+  cache->stats.misses++;
+  if (ci->valid) {
+    hash_remove(cache, ci - cache->inodes);
+    cache->stats.evictions++;
+  }
+  ci->ino = ino;
+  ci->refs = 1;
+  ci->valid = true;
+  ci->dirty = false;
+  ci->referenced = true;
+  hash_insert(cache, ci - cache->inodes);
+  if (!read) {
+    memset(&ci->node, 0, sizeof(ci->node));
+    pthread_mutex_unlock(&cache->lock);
+    return ci;
+  }
+
+  // Inode читается без блокировки кэша; обращения к нему ждут loaded
+  ci->loading = true;
+  pthread_mutex_unlock(&cache->lock);
+
+  uint32_t byte;
+  uint64_t block = inode_block(cache->sb, ino, &byte);
+  bool ok;
+  if (cache->mapped) {
+    const uint8_t* data = mapped_block(cache, block);
+    ok = data != NULL;
+    if (ok) memcpy(&ci->node, data + byte, sizeof(ci->node));
+  } else {
+    ok = block_cache_read(cache->bcache, block, byte, &ci->node,
+                          sizeof(ci->node)) == 0;
+  }
+  ok = ok && ci->node.magic == INODE_MAGIC;
+
+  pthread_mutex_lock(&cache->lock);
+  ci->loading = false;
+  pthread_cond_broadcast(&cache->loaded);
+  if (!ok) {
+    sifs_debug("Inode %u не прочитан или поврежден\n", ino);
+    hash_remove(cache, ci - cache->inodes);
+    ci->valid = false;
+    ci->refs = 0;
+    ci = NULL;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if (!ci) errno = EIO;
+  return ci;
+}
+
+void inode_cache_put(struct inode_cache* cache, struct cached_inode* ci) {
+  pthread_mutex_lock(&cache->lock);
+  sifs_assert(ci->refs > 0);
+  ci->refs--;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void inode_cache_mark_dirty(struct inode_cache* cache,
+                            struct cached_inode* ci) {
+  pthread_mutex_lock(&cache->lock);
+  ci->node.ctime = inode_now();
+  ci->disk = ci->node;
+  dirty_add(cache, ci - cache->inodes);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+// Блоки таблицы inode одной группы [lo, hi), перенесенные в отображение
+struct table_range {
+  uint64_t lo;
+  uint64_t hi;
+};
+
+int32_t inode_cache_sync(struct inode_cache* cache) {
+  const struct superblock* sb = cache->sb;
+  uint32_t groups = sb->features & FS_FEATURE_GROUPS ? sb->count_groups : 1;
+  struct table_range* ranges = NULL;
+  if (cache->mapped && !(ranges = calloc(groups, sizeof(*ranges)))) {
+    return -1;
+  }
+
+  int32_t result = 0;
+  pthread_mutex_lock(&cache->lock);
+
+  // Каждый блок снимает с головы списка хотя бы один inode. При ошибке
+  // inode остаются в списке и записываются следующим сбросом
+  while (cache->dirty_head >= 0) {
+    int32_t i = cache->dirty_head;
+    uint32_t g = superblock_inode_group(sb, cache->inodes[i].ino);
+    uint64_t block;
+    if (flush_block(cache, i, &block) < 0) {
+      sifs_error("Не удалось записать inode %u\n", cache->inodes[i].ino);
+      result = -1;
+      break;
+    }
+    if (!ranges) continue;
+
+    struct table_range* range = &ranges[g];
+    if (range->lo == range->hi) {
+      range->lo = block;
+      range->hi = block + 1;
+    } else {
+      if (block < range->lo) range->lo = block;
+      if (block + 1 > range->hi) range->hi = block + 1;
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+
+  // Таблица каждой группы идет подряд, поэтому ее измененные страницы
+  // сбрасываются одним вызовом, уже без блокировки кэша
+  for (uint32_t g = 0; ranges && g < groups; g++) {
+    if (ranges[g].lo == ranges[g].hi) continue;
+    if (image_flush(cache->bcache->img, (off_t)ranges[g].lo * sb->block_size,
+                    (size_t)(ranges[g].hi - ranges[g].lo) *
+                        sb->block_size) < 0) {
+      result = -1;
+    }
+  }
+  free(ranges);
+  return result;
+}
+
+void inode_cache_get_stats(struct inode_cache* cache,
+                           struct inode_cache_stats* stats) {
+  pthread_mutex_lock(&cache->lock);
+  *stats = cache->stats;
+  pthread_mutex_unlock(&cache->lock);
+}
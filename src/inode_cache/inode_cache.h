@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../block_cache/block_cache.h"
+#include "../inode_table/inode.h"
+#include "../superblock/superblock.h"
+
+// Число inode в кэше по умолчанию
+#define INODE_CACHE_DEFAULT_CAPACITY 1024
+
+// Inode в памяти
+struct cached_inode {
+  uint32_t ino;           // Номер inode
+  uint32_t refs;          // Число пользователей (не вытесняется)
+  bool valid;             // Запись занята
+  bool dirty;             // Изменен и не записан в таблицу
+  bool referenced;        // Бит обращения для алгоритма CLOCK
+  bool loading;           // Читается из таблицы вне блокировки кэша
+  int32_t hash_next;      // Следующая запись в цепочке хэш-таблицы
+  int32_t dirty_prev;     // Соседи в списке грязных inode
+  int32_t dirty_next;
+  struct inode node;      // Содержимое inode
+  struct inode disk;      // Снимок node для записи (при пометке грязным)
+};
+
+// Счетчики кэша
+struct inode_cache_stats {
+  uint64_t hits;          // Inode найден в кэше
+  uint64_t misses;        // Inode прочитан из таблицы
+  uint64_t evictions;     // Записи, вытесненные CLOCK
+  uint64_t inode_writes;  // Записанные грязные inode
+  uint64_t block_writes;  // Блоки таблицы inode, переданные в кэш блоков
+                          // (или в отображение)
+};
+
+// Кэш inode поверх таблицы inode, блоки которой идут через кэш блоков.
+// Inode читаются из него при промахе и остаются в памяти, пока на них
+// есть ссылки или до вытеснения. Изменения копятся в памяти; при сбросе
+// все грязные inode одного блока таблицы переносятся в его буфер разом.
+// Все операции защищены одной блокировкой, но чтение inode при промахе и
+// сброс вытесняемой грязной записи в кэш блоков идут без нее: читаемая
+// запись помечена loading, и ждут ее только обращения к тому же inode.
+// Содержимое inode со ссылкой меняется вне блокировки кэша, под
+// блокировкой inode вызывающего. Поэтому в таблицу
+// пишется не node, а снимок, который inode_cache_mark_dirty делает под
+// той же блокировкой inode: сброс из другого потока не видит
+// полузаписанный inode.
+// Если образ отображен в память (IMAGE_MMAP), таблица inode не идет через
+// кэш блоков: inode читаются из отображения и переносятся прямо в него, а
+// inode_cache_sync сбрасывает измененные страницы таблицы на диск.
+struct inode_cache {
+  struct block_cache* bcache;
+  const struct superblock* sb;
+  bool mapped;                    // Таблица - в отображении образа
+  uint32_t capacity;
+  uint32_t hash_mask;
+  int32_t* hash;                  // Головы цепочек по номеру inode
+  struct cached_inode* inodes;
+  uint32_t clock_hand;
+  int32_t dirty_head;             // Список грязных inode (-1 - пуст)
+  struct inode_cache_stats stats;
+  pthread_mutex_t lock;
+  pthread_cond_t loaded;          // Снята пометка loading одной из записей
+};
+
+// Создает кэш на capacity inode (0 - INODE_CACHE_DEFAULT_CAPACITY).
+// Возвращает NULL при ошибке
+extern struct inode_cache* inode_cache_create(struct block_cache* bcache,
+                                              const struct superblock* sb,
+                                              uint32_t capacity);
+
+// Переносит грязные inode в кэш блоков и освобождает кэш
+extern int32_t inode_cache_destroy(struct inode_cache* cache);
+
+// Возвращает inode со ссылкой. Если read == false, inode только что
+// выделен и будет заполнен вызывающим (из таблицы не читается).
+// Возвращает NULL при ошибке (errno = EINVAL, EIO, EBUSY - все записи
+// заняты)
+extern struct cached_inode* inode_cache_get(struct inode_cache* cache,
+                                            uint32_t ino,
+                                            bool read);
+
+// Снимает ссылку
+extern void inode_cache_put(struct inode_cache* cache,
+                            struct cached_inode* ci);
+
+// Помечает inode измененным, обновляет ctime и снимает копию для записи.
+// Вызывается после изменений под блокировкой, защищающей inode
+extern void inode_cache_mark_dirty(struct inode_cache* cache,
+                                   struct cached_inode* ci);
+
+// Переносит все грязные inode в кэш блоков, по одному блоку таблицы за раз.
+// В образ их записывает block_cache_sync. В отображенном образе inode
+// копируются в таблицу, а ее измененные страницы затем сбрасываются на
+// диск (image_flush). При ошибке (EBUSY - все буферы заняты, EIO)
+// останавливается; не перенесенные inode остаются грязными
+extern int32_t inode_cache_sync(struct inode_cache* cache);
+
+// Копирует текущие счетчики кэша
+extern void inode_cache_get_stats(struct inode_cache* cache,
+                                  struct inode_cache_stats* stats);
@@ -1,9 +1,16 @@
 #include "inode.h"
 #include "../debug/debug.h"
+#include <inttypes.h>
 #include <string.h>
 #include <time.h>
 #include <stdbool.h>
 
+int64_t inode_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 void init_inode(struct inode* node, uint32_t mode, uint32_t uid, uint32_t gid) {
     memset(node, 0, sizeof(struct inode));
 
@@ -12,12 +19,16 @@ void init_inode(struct inode* node, uint32_t mode, uint32_t uid, uint32_t gid) {
     node->mode = mode;             // Тип файла + права доступа
     // Для директорий начальное количество ссылок = 2 ('.' и '..')
     // Для остальных типов файлов - 1
-    node->links = mode & S_IFDIR ? 2 : 1;
+    node->links = S_ISDIR(mode) ? 2 : 1;
     node->uid = uid;               // Идентификатор владельца
     node->gid = gid;               // Идентификатор группы
 
+    // Файлы и ссылки начинаются со встроенных данных и переходят на блоки
+    // при росте; каталоги всегда адресуют блоки
+    if (S_ISREG(mode) || S_ISLNK(mode)) node->flags = INODE_INLINE;
+
     // Установка временных меток
-    time_t now = time(NULL);       // Текущее системное время
+    int64_t now = inode_now();     // Текущее системное время
     node->atime = now;             // Время последнего доступа
     node->mtime = now;             // Время последнего изменения
     node->ctime = now;             // Время создания/изменения статуса
@@ -34,7 +45,7 @@ bool inode_valid(const struct inode* node) {
     }
 
     // Проверка типа файла (должен быть REG, DIR или LNK)
-    uint32_t file_type = node->mode & 0x0F;
+    uint32_t file_type = node->mode & S_IFMT;
     if (file_type != S_IFREG && file_type != S_IFDIR && file_type != S_IFLNK) {
         sifs_debug("Недопустимый тип файла: 0x%X\n", file_type);
         return false;
@@ -50,7 +61,7 @@ bool inode_valid(const struct inode* node) {
 }
 
 const char* inode_type_str(const struct inode* node) {
-    switch (node->mode & 0x0F) {
+    switch (node->mode & S_IFMT) {
         case S_IFREG: return "файл";        // Обычный файл
         case S_IFDIR: return "директория";  // Каталог
         case S_IFLNK: return "ссылка";      // Символическая ссылка
@@ -58,45 +69,43 @@ const char* inode_type_str(const struct inode* node) {
     }
 }
 
-uint32_t inode_block_count(const struct inode* node, uint32_t block_size) {
+uint64_t inode_block_count(const struct inode* node, uint32_t block_size) {
     // Расчет количества блоков данных (с округлением вверх)
-    uint32_t data_blocks = (node->size + block_size - 1) / block_size;
-    uint32_t total_blocks = data_blocks;
-
-    // Если файл использует косвенную адресацию, добавляем 1 блок для указателей
-    if (data_blocks > DIRECT_BLOCKS) {
-        total_blocks++;
+    uint64_t data_blocks = (node->size + block_size - 1) / block_size;
+    uint64_t total_blocks = data_blocks;
+    if (node->flags & INODE_INLINE) return 0;  // Данные внутри inode
+    if (node->flags & INODE_EXTENTS) return total_blocks;
+
+    // Блоки указателей для плотного файла: на каждом уровне косвенной
+    // адресации нужен блок на каждые ptrs^k блоков данных (k = 1..уровень)
+    uint64_t ptrs = block_size / sizeof(uint64_t);
+    uint64_t rest = data_blocks > DIRECT_BLOCKS ? data_blocks - DIRECT_BLOCKS : 0;
+    uint64_t span = ptrs;
+    for (uint32_t level = 1; level <= INDIRECT_LEVELS && rest; level++) {
+        uint64_t covered = rest < span ? rest : span;
+        uint64_t per_block = 1;
+        for (uint32_t k = 0; k < level; k++) {
+            per_block *= ptrs;
+            total_blocks += (covered + per_block - 1) / per_block;
+        }
+        rest -= covered;
+        span *= ptrs;
     }
 
-    sifs_debug("Расчет блоков: %u блоков данных + %u косвенный = %u всего\n",
-               data_blocks, (data_blocks > DIRECT_BLOCKS) ? 1 : 0, total_blocks);
+    sifs_debug("Расчет блоков: %" PRIu64 " блоков данных + %" PRIu64
+               " блоков указателей = %" PRIu64 " всего\n",
+               data_blocks, total_blocks - data_blocks, total_blocks);
 
     return total_blocks;
 }
 
-uint32_t inode_get_block(const struct inode* node, uint32_t block_index) {
-    // Обработка прямых блоков (индексы 0-11)
-    if (block_index < DIRECT_BLOCKS) {
-        return node->direct[block_index];
-    }
-
-    // Проверка наличия косвенного блока
-    if (node->indirect == 0) {
-        sifs_debug("Для блока %u не выделен косвенный блок\n", block_index);
-        return 0;  // Косвенный блок не выделен
-    }
-
-    // Возвращаем номер косвенного блока (фактический поиск указателя будет в вызывающем коде)
-    return node->indirect;
-}
-
 void inode_update_atime(struct inode* node) {
-    node->atime = time(NULL);  // Установка текущего времени
+    node->atime = inode_now();  // Установка текущего времени
     sifs_debug("Обновлено время доступа для inode\n");
 }
 
 void inode_update_mtime(struct inode* node) {
-    node->mtime = time(NULL);  // Установка текущего времени
+    node->mtime = inode_now();  // Установка текущего времени
     sifs_debug("Обновлено время изменения для inode\n");
 }
 
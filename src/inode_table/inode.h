@@ -1,12 +1,23 @@
 #pragma once
 
 #include <stdbool.h>
-#include <time.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_FILENAME 255          // Максимальная длина имени файла
 #define DIRECT_BLOCKS 12          // Количество прямых указателей на блоки в inode
+#define INDIRECT_LEVELS 3         // Уровни косвенной адресации (одинарный, двойной, тройной)
 #define INODE_MAGIC 0x494E4F44    // Магическое число "INOD"
+#define INODE_MAP_SIZE ((DIRECT_BLOCKS + INDIRECT_LEVELS) * 8) // Область адресации блоков в inode
+#define INODE_SIZE 256            // Размер inode на диске (степень двойки)
+#define INODE_SIZE_SHIFT 8        // log2(INODE_SIZE)
+#define INODE_HEADER_SIZE 64      // Поля inode до области адресации
+#define INODE_SPARE_SIZE (INODE_SIZE - INODE_HEADER_SIZE - INODE_MAP_SIZE) // Резерв в конце inode
+#define INODE_INLINE_SIZE (INODE_SIZE - INODE_HEADER_SIZE) // Вместимость встроенных данных
+
+// Флаги inode
+#define INODE_EXTENTS 0x1         // Область адресации хранит дерево экстентов
+#define INODE_INLINE 0x2          // Данные файла хранятся в самом inode
 
 // Маска типа файла (старшие 4 бита)
 #define S_IFMT  0xF000  // Маска типа файла
@@ -39,27 +50,64 @@
 #define S_ISDIR(m) (((m) & S_IFMT) == S_IFDIR)
 #define S_ISLNK(m) (((m) & S_IFMT) == S_IFLNK)
 
-// Структура inode
+// Структура inode на диске. Все поля фиксированной ширины и выровнены
+// естественным образом, поэтому неявных выравнивающих байтов нет, а размер
+// одинаков на любой платформе; порядок байтов - little-endian.
+// Inode занимает INODE_SIZE байт: блок (не меньше 512 байт) вмещает целое
+// число inode, и ни один inode не пересекает границу блока.
 struct inode {
   uint32_t magic;                 // Магическое число (должно совпадать с INODE_MAGIC)
-  uint32_t size;                  // Размер файла в байтах
-  uint32_t mode;                  // Тип файла (младшие 4 бита) + права доступа (старшие 9 бит)
+  uint32_t mode;                  // Тип файла (S_IFMT) + права доступа (младшие 9 бит)
   uint32_t links;                 // Количество жестких ссылок на inode
-
-  // Временные метки в формате Unix time
-  time_t atime;                   // Время последнего доступа (access)
-  time_t mtime;                   // Время последней модификации (modify)
-  time_t ctime;                   // Время создания/изменения статуса (change)
-
-  // Система адресации блоков данных
-  uint32_t direct[DIRECT_BLOCKS]; // Прямые указатели на блоки данных (для первых 12 блоков)
-  uint32_t indirect;              // Косвенный блок (хранит указатели на следующие блоки)
+  uint32_t flags;                 // Флаги inode (INODE_*)
 
   // Владелец файла
   uint32_t uid;                   // Идентификатор пользователя-владельца
   uint32_t gid;                   // Идентификатор группы-владельца
+
+  uint64_t size;                  // Размер файла в байтах
+
+  // Временные метки: наносекунды с начала эпохи Unix
+  int64_t atime;                  // Время последнего доступа (access)
+  int64_t mtime;                  // Время последней модификации (modify)
+  int64_t ctime;                  // Время создания/изменения статуса (change)
+
+  uint64_t reserved;              // Зарезервировано (нули)
+
+  union {
+    struct {
+      // Система адресации блоков данных: указатели на блоки либо, при флаге
+      // INODE_EXTENTS, корень дерева экстентов (см. block_map/extent_tree.h)
+      union {
+        struct {
+          uint64_t direct[DIRECT_BLOCKS];     // Прямые указатели на блоки данных (для первых 12 блоков)
+          uint64_t indirect[INDIRECT_LEVELS]; // Корни косвенной адресации: [0] - блок указателей на данные,
+                                              // [1] - двойной косвенный, [2] - тройной косвенный
+        };
+        uint64_t extent_root[INODE_MAP_SIZE / 8]; // Корень дерева экстентов
+      };
+
+      uint8_t spare[INODE_SPARE_SIZE];        // Резерв (нули)
+    };
+
+    // При флаге INODE_INLINE - содержимое файла или цель ссылки
+    // (см. block_map/inline_data.h)
+    uint8_t inline_data[INODE_INLINE_SIZE];
+  };
 };
 
+_Static_assert(sizeof(struct inode) == INODE_SIZE, "inode must be INODE_SIZE bytes");
+_Static_assert(offsetof(struct inode, direct) == INODE_HEADER_SIZE,
+               "block map must follow the inode header without padding");
+_Static_assert(offsetof(struct inode, inline_data) == INODE_HEADER_SIZE,
+               "inline data must follow the inode header without padding");
+_Static_assert((1 << INODE_SIZE_SHIFT) == INODE_SIZE, "INODE_SIZE_SHIFT mismatch");
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+               "on-disk structures are stored in host order and must be little-endian");
+
+// Текущее время в наносекундах с начала эпохи Unix
+extern int64_t inode_now(void);
+
 // Инициализирует новый inode
 extern void init_inode(struct inode* node, uint32_t mode, uint32_t uid, uint32_t gid);
 
@@ -69,11 +117,9 @@ extern bool inode_valid(const struct inode* node);
 // Возвращает строковое представление типа файла
 extern const char* inode_type_str(const struct inode* node);
 
-// Рассчитывает количество блоков, занимаемых файлом
-extern uint32_t inode_block_count(const struct inode* node, uint32_t block_size);
-
-// Возвращает физический номер блока по логическому индексу
-extern uint32_t inode_get_block(const struct inode* node, uint32_t block_index);
+// Рассчитывает количество блоков, занимаемых файлом (данные и блоки указателей).
+// Для дерева экстентов учитываются только блоки данных
+extern uint64_t inode_block_count(const struct inode* node, uint32_t block_size);
 
 // Обновляет время последнего доступа (atime) до текущего времени
 extern void inode_update_atime(struct inode* node);
@@ -1,4 +1,5 @@
 #include "inode_table.h"
+#include <inttypes.h>
 #include <string.h>
 #include "../debug/debug.h"
 
@@ -6,11 +7,11 @@ void init_inode_table(struct superblock* sb, void* table) {
     sifs_debug("Инициализация таблицы inode\n");
 
     // Рассчет общего размера таблицы
-    uint32_t table_size = sb->count_inode_table_blocks * sb->block_size;
+    uint64_t table_size = sb->count_inode_table_blocks * sb->block_size;
 
     // Обнуление всей таблицы
     memset(table, 0, table_size);
-    sifs_debug("Таблица inode обнулена (%u байт)\n", table_size);
+    sifs_debug("Таблица inode обнулена (%" PRIu64 " байт)\n", table_size);
 
     // Инициализация корневого inode (индекс 1)
     struct inode root;
@@ -19,7 +20,7 @@ void init_inode_table(struct superblock* sb, void* table) {
 
     // Сохранение корневого inode в таблице
     if (!write_inode(sb, table, sb->root_inode, &root)) {
-        sifs_debug("Ошибка инициализации корневого inode\n");
+        sifs_error("Ошибка инициализации корневого inode\n");
         return;
     }
 
@@ -37,7 +38,8 @@ bool read_inode(struct superblock* sb,
     }
 
     // Рассчет позиции inode
-    uint32_t block_offset, byte_offset;
+    uint64_t block_offset;
+    uint32_t byte_offset;
     get_inode_position(sb, inode_idx, &block_offset, &byte_offset);
 
     // Указатель на блок с inode
@@ -67,45 +69,61 @@ bool write_inode(struct superblock* sb,
         return false;
     }
 
-    // Обновление времени изменения
-    time_t current_time = time(NULL);
-    ((struct inode*)node)->ctime = current_time;
+    // Время изменения ставится в копии: переданный inode не меняется
+    struct inode stamped = *node;
+    stamped.ctime = inode_now();
 
     // Рассчет позиции inode
-    uint32_t block_offset, byte_offset;
+    uint64_t block_offset;
+    uint32_t byte_offset;
     get_inode_position(sb, inode_idx, &block_offset, &byte_offset);
 
     // Указатель на блок с inode
     uint8_t* block_ptr = (uint8_t*)table + block_offset * sb->block_size;
 
     // Копирование данных inode
-    memcpy(block_ptr + byte_offset, node, sizeof(struct inode));
+    memcpy(block_ptr + byte_offset, &stamped, sizeof(struct inode));
 
-    sifs_debug("Inode %u записан успешно (изменен: %ld)\n",
-              inode_idx, current_time);
+    sifs_debug("Inode %u записан успешно (изменен: %" PRId64 " нс)\n",
+              inode_idx, stamped.ctime);
     return true;
 }
 
-void get_inode_position(struct superblock* sb,
+void get_inode_position(const struct superblock* sb,
                                       uint32_t inode_idx,
-                                      uint32_t* block_offset,
+                                      uint64_t* block_offset,
                                       uint32_t* byte_offset) {
-    // Общее смещение в байтах
-    uint32_t total_offset = inode_idx * sb->inode_size;
+    // Размеры inode и блока - степени двойки, поэтому деление и остаток
+    // заменяются сдвигом и маской (64 бита: таблица может превышать 4 ГБ)
+    uint64_t total_offset = (uint64_t)inode_idx << INODE_SIZE_SHIFT;
+    uint32_t block_shift = __builtin_ctz(sb->block_size);
 
     // Смещение блока относительно начала таблицы
-    *block_offset = total_offset / sb->block_size;
+    *block_offset = total_offset >> block_shift;
 
     // Смещение внутри блока
-    *byte_offset = total_offset % sb->block_size;
+    *byte_offset = total_offset & (sb->block_size - 1);
 
     // Проверка переполнения
     if (*block_offset >= sb->count_inode_table_blocks) {
-        sifs_debug("Ошибка: inode %u выходит за пределы таблицы\n", inode_idx);
+        sifs_error("Inode %u выходит за пределы таблицы\n", inode_idx);
         *block_offset = 0;
         *byte_offset = 0;
     }
 
-    sifs_debug("Позиция inode %u: блок=%u, смещение=%u\n",
+    sifs_debug("Позиция inode %u: блок=%" PRIu64 ", смещение=%u\n",
               inode_idx, *block_offset, *byte_offset);
-}
\ No newline at end of file
+}
+
+uint64_t inode_table_disk_block(const struct superblock* sb,
+                                uint64_t table_block) {
+    if (!(sb->features & FS_FEATURE_GROUPS)) {
+        return sb->first_inode_table_block + table_block;
+    }
+
+    // Срезы всех групп одинаковой длины
+    uint64_t per_group = sb->count_inode_table_blocks / sb->count_groups;
+    struct group_layout layout;
+    superblock_group_layout(sb, table_block / per_group, &layout);
+    return layout.inode_table + table_block % per_group;
+}
@@ -20,7 +20,12 @@ extern bool write_inode(struct superblock* sb,
                         const struct inode* node);
 
 // Рассчитывает позицию inode в таблице
-extern void get_inode_position(struct superblock* sb,
+extern void get_inode_position(const struct superblock* sb,
                                              uint32_t inode_idx,
-                                             uint32_t* block_offset,
+                                             uint64_t* block_offset,
                                              uint32_t* byte_offset);
+
+// Номер блока образа, в котором лежит блок table_block таблицы inode
+// (таблица в памяти сплошная, на диске при группах - срезы по группам)
+extern uint64_t inode_table_disk_block(const struct superblock* sb,
+                                       uint64_t table_block);
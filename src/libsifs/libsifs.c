@@ -0,0 +1,297 @@
+#include "libsifs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../fs/fs.h"
+
+// Начальный размер таблицы дескрипторов (растет вдвое)
+#define SIFS_INITIAL_FDS 16
+
+// Открытый дескриптор
+struct sifs_fd {
+  struct fs_file* file;   // NULL - дескриптор свободен
+  int flags;              // Режим доступа (O_ACCMODE)
+};
+
+struct sifs {
+  struct fs* fs;
+  struct sifs_fd* fds;
+  int count;              // Размер таблицы дескрипторов
+  pthread_mutex_t lock;   // Таблица дескрипторов
+};
+
+struct sifs* sifs_mount(const char* image) {
+  struct sifs* s = calloc(1, sizeof(*s));
+  if (!s) return NULL;
+
+  s->fds = calloc(SIFS_INITIAL_FDS, sizeof(*s->fds));
+  s->count = SIFS_INITIAL_FDS;
+  if (s->fds) s->fs = fs_mount(image, NULL);
+  if (!s->fs) {
+    int saved = errno;
+    free(s->fds);
+    free(s);
+    errno = saved;
+    return NULL;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  return s;
+}
+
+int sifs_unmount(struct sifs* s) {
+  if (!s) return 0;
+
+  for (int fd = 0; fd < s->count; fd++) {
+    if (s->fds[fd].file) fs_close(s->fds[fd].file);
+  }
+
+  int result = fs_unmount(s->fs);
+  pthread_mutex_destroy(&s->lock);
+  free(s->fds);
+  free(s);
+  return result;
+}
+
+int sifs_sync(struct sifs* s) {
+  return fs_sync(s->fs);
+}
+
+// Занимает свободный дескриптор, расширяя таблицу. Возвращает его или -1
+static int fd_alloc(struct sifs* s, struct fs_file* file, int flags) {
+  pthread_mutex_lock(&s->lock);
+
+  int fd = 0;
+  while (fd < s->count && s->fds[fd].file) fd++;
+  if (fd == s->count) {
+    struct sifs_fd* fds = realloc(s->fds, 2 * s->count * sizeof(*fds));
+    if (!fds) {
+      pthread_mutex_unlock(&s->lock);
+      return -1;
+    }
+    memset(fds + s->count, 0, s->count * sizeof(*fds));
+    s->fds = fds;
+    s->count *= 2;
+  }
+
+  s->fds[fd].file = file;
+  s->fds[fd].flags = flags & O_ACCMODE;
+  pthread_mutex_unlock(&s->lock);
+  return fd;
+}
+
+// Находит файл дескриптора, открытого с доступом access
+// (O_RDONLY - чтение, O_WRONLY - запись). Возвращает NULL с EBADF
+static struct fs_file* fd_get(struct sifs* s, int fd, int access) {
+  struct fs_file* file = NULL;
+  pthread_mutex_lock(&s->lock);
+
+  if (fd >= 0 && fd < s->count && s->fds[fd].file) {
+    int mode = s->fds[fd].flags;
+    bool allowed = access == O_RDONLY ? mode != O_WRONLY : mode != O_RDONLY;
+    if (allowed) file = s->fds[fd].file;
+  }
+
+  pthread_mutex_unlock(&s->lock);
+  if (!file) errno = EBADF;
+  return file;
+}
+
+// Находит файл открытого дескриптора независимо от доступа.
+// Возвращает NULL с EBADF
+static struct fs_file* fd_file(struct sifs* s, int fd) {
+  pthread_mutex_lock(&s->lock);
+  struct fs_file* file = fd >= 0 && fd < s->count ? s->fds[fd].file : NULL;
+  pthread_mutex_unlock(&s->lock);
+  if (!file) errno = EBADF;
+  return file;
+}
+
+int sifs_open(struct sifs* s, const char* path, int flags, mode_t mode) {
+  struct fs_file* file = fs_open_path(s->fs, path);
+
+  if (file && (flags & O_CREAT) && (flags & O_EXCL)) {
+    fs_close(file);
+    errno = EEXIST;
+    return -1;
+  }
+  if (!file && errno == ENOENT && (flags & O_CREAT)) {
+    uint32_t ino;
+    int result = fs_create(s->fs, path, S_IFREG | (mode & 07777), getuid(),
+                           getgid(), &ino);
+    // Файл мог создать другой поток между поиском и созданием
+    if (result == 0 || (errno == EEXIST && !(flags & O_EXCL))) {
+      file = fs_open_path(s->fs, path);
+    }
+  }
+  if (!file) return -1;
+
+  struct fs_stat st;
+  int result = fs_getattr(s->fs, fs_file_ino(file), &st);
+  if (result == 0 && S_ISDIR(st.mode)) {
+    errno = EISDIR;
+    result = -1;
+  }
+  // Ссылки не разрешаются: их цель читает sifs_readlink
+  if (result == 0 && S_ISLNK(st.mode)) {
+    errno = ELOOP;
+    result = -1;
+  }
+  if (result < 0) {
+    int saved = errno;
+    fs_close(file);
+    errno = saved;
+    return -1;
+  }
+
+  if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY &&
+      fs_truncate(file, 0) < 0) {
+    int saved = errno;
+    fs_close(file);
+    errno = saved;
+    return -1;
+  }
+
+  int fd = fd_alloc(s, file, flags);
+  if (fd < 0) fs_close(file);
+  return fd;
+}
+
+int sifs_close(struct sifs* s, int fd) {
+  pthread_mutex_lock(&s->lock);
+  struct fs_file* file = NULL;
+  if (fd >= 0 && fd < s->count) {
+    file = s->fds[fd].file;
+    s->fds[fd].file = NULL;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  if (!file) {
+    errno = EBADF;
+    return -1;
+  }
+  return fs_close(file);
+}
+
+ssize_t sifs_pread(struct sifs* s, int fd, void* buffer, size_t size,
+                   off_t offset) {
+  struct fs_file* file = fd_get(s, fd, O_RDONLY);
+  if (!file) return -1;
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return fs_read(file, buffer, size, offset);
+}
+
+ssize_t sifs_sendfile(struct sifs* s, int out_fd, int fd, off_t offset,
+                      size_t count) {
+  struct fs_file* file = fd_get(s, fd, O_RDONLY);
+  if (!file) return -1;
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return fs_sendfile(file, out_fd, count, offset);
+}
+
+ssize_t sifs_pwrite(struct sifs* s, int fd, const void* buffer, size_t size,
+                    off_t offset) {
+  struct fs_file* file = fd_get(s, fd, O_WRONLY);
+  if (!file) return -1;
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return fs_write(file, buffer, size, offset);
+}
+
+int sifs_ftruncate(struct sifs* s, int fd, off_t length) {
+  struct fs_file* file = fd_get(s, fd, O_WRONLY);
+  if (!file) {
+    // Как ftruncate(2): EINVAL для открытого без записи, иначе EBADF
+    if (fd_file(s, fd)) errno = EINVAL;
+    return -1;
+  }
+  if (length < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return fs_truncate(file, length);
+}
+
+static void fill_stat(const struct fs_stat* attr, struct stat* st) {
+  memset(st, 0, sizeof(*st));
+  st->st_ino = attr->ino;
+  st->st_mode = attr->mode;
+  st->st_nlink = attr->links;
+  st->st_uid = attr->uid;
+  st->st_gid = attr->gid;
+  st->st_size = attr->size;
+  st->st_blksize = attr->block_size;
+  st->st_blocks = attr->blocks * (attr->block_size / 512);
+  st->st_atim.tv_sec = attr->atime / 1000000000;
+  st->st_atim.tv_nsec = attr->atime % 1000000000;
+  st->st_mtim.tv_sec = attr->mtime / 1000000000;
+  st->st_mtim.tv_nsec = attr->mtime % 1000000000;
+  st->st_ctim.tv_sec = attr->ctime / 1000000000;
+  st->st_ctim.tv_nsec = attr->ctime % 1000000000;
+}
+
+int sifs_fstat(struct sifs* s, int fd, struct stat* st) {
+  struct fs_file* file = fd_file(s, fd);
+  if (!file) return -1;
+
+  struct fs_stat attr;
+  if (fs_getattr(s->fs, fs_file_ino(file), &attr) < 0) return -1;
+  fill_stat(&attr, st);
+  return 0;
+}
+
+int sifs_fstats(struct sifs* s, int fd, struct sifs_file_stats* stats) {
+  struct fs_file* file = fd_file(s, fd);
+  if (!file) return -1;
+
+  struct fs_file_stats fstats;
+  fs_file_get_stats(file, &fstats);
+  stats->map_hits = fstats.map_hits;
+  stats->map_misses = fstats.map_misses;
+  return 0;
+}
+
+int sifs_stat(struct sifs* s, const char* path, struct stat* st) {
+  uint32_t ino;
+  struct fs_stat attr;
+  if (fs_lookup(s->fs, path, &ino) < 0 ||
+      fs_getattr(s->fs, ino, &attr) < 0) {
+    return -1;
+  }
+  fill_stat(&attr, st);
+  return 0;
+}
+
+int sifs_mkdir(struct sifs* s, const char* path, mode_t mode) {
+  uint32_t ino;
+  return fs_create(s->fs, path, S_IFDIR | (mode & 07777), getuid(),
+                   getgid(), &ino);
+}
+
+int sifs_symlink(struct sifs* s, const char* target, const char* path) {
+  uint32_t ino;
+  return fs_symlink(s->fs, target, path, getuid(), getgid(), &ino);
+}
+
+ssize_t sifs_readlink(struct sifs* s, const char* path, char* buffer,
+                      size_t size) {
+  uint32_t ino;
+  if (fs_lookup(s->fs, path, &ino) < 0) return -1;
+  return fs_readlink(s->fs, ino, buffer, size);
+}
+
+int sifs_unlink(struct sifs* s, const char* path) {
+  return fs_unlink(s->fs, path);
+}
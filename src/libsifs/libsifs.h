@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Встраиваемый доступ к образу SIFS без FUSE: контекст монтирования и
+// файловые дескрипторы в стиле POSIX. Пути абсолютные от корня образа.
+// Функции возвращают -1 и устанавливают errno при ошибке. Вызовы
+// потокобезопасны; один дескриптор можно использовать из нескольких
+// потоков, но не закрывать во время обращений к нему.
+// Собирается в build/.../lib/libsifs.a и libsifs.so (make lib); объекты
+// библиотеки собираются с -fvisibility=hidden, и libsifs.so экспортирует
+// только объявленные здесь функции sifs_*.
+
+#pragma GCC visibility push(default)
+
+// Смонтированный образ
+struct sifs;
+
+// Монтирует образ. Возвращает NULL при ошибке
+extern struct sifs* sifs_mount(const char* image);
+
+// Закрывает оставшиеся дескрипторы, записывает изменения и размонтирует
+extern int sifs_unmount(struct sifs* fs);
+
+// Записывает все изменения в образ
+extern int sifs_sync(struct sifs* fs);
+
+// Открывает файл. flags: O_RDONLY, O_WRONLY или O_RDWR, а также O_CREAT,
+// O_EXCL и O_TRUNC; mode - права создаваемого файла. Возвращает
+// дескриптор (>= 0) или -1 (errno = ENOENT, EEXIST, EISDIR, ...)
+extern int sifs_open(struct sifs* fs, const char* path, int flags,
+                     mode_t mode);
+
+// Закрывает дескриптор
+extern int sifs_close(struct sifs* fs, int fd);
+
+// Читает до size байт со смещения offset. Возвращает число байт
+// (0 за концом файла) или -1
+extern ssize_t sifs_pread(struct sifs* fs, int fd, void* buffer, size_t size,
+                          off_t offset);
+
+// Передает до count байт со смещения offset в дескриптор ОС out_fd
+// (файл, канал, сокет) без копирования через буфер вызывающего, как
+// sendfile(2). Возвращает число байт (0 за концом файла) или -1
+extern ssize_t sifs_sendfile(struct sifs* fs, int out_fd, int fd,
+                             off_t offset, size_t count);
+
+// Записывает size байт со смещения offset. Возвращает число байт или -1
+extern ssize_t sifs_pwrite(struct sifs* fs, int fd, const void* buffer,
+                           size_t size, off_t offset);
+
+// Устанавливает размер файла
+extern int sifs_ftruncate(struct sifs* fs, int fd, off_t length);
+
+// Атрибуты открытого файла
+extern int sifs_fstat(struct sifs* fs, int fd, struct stat* st);
+
+// Счетчики открытого файла
+struct sifs_file_stats {
+  uint64_t map_hits;      // Блок найден в кэше отображения файла
+  uint64_t map_misses;    // Блок разрешен через указатели или экстенты
+};
+
+// Счетчики кэша отображения открытого файла
+extern int sifs_fstats(struct sifs* fs, int fd, struct sifs_file_stats* stats);
+
+// Атрибуты файла или каталога по пути
+extern int sifs_stat(struct sifs* fs, const char* path, struct stat* st);
+
+// Создает каталог
+extern int sifs_mkdir(struct sifs* fs, const char* path, mode_t mode);
+
+// Создает символическую ссылку path на target (не длиннее 192 байт).
+// Ссылки не разрешаются при поиске пути, а sifs_open на ссылке
+// возвращает ELOOP
+extern int sifs_symlink(struct sifs* fs, const char* target,
+                        const char* path);
+
+// Копирует до size байт цели ссылки без завершающего нуля, как
+// readlink(2). Возвращает длину или -1 (errno = EINVAL, если не ссылка)
+extern ssize_t sifs_readlink(struct sifs* fs, const char* path, char* buffer,
+                             size_t size);
+
+// Удаляет файл (открытые дескрипторы остаются действительными)
+extern int sifs_unlink(struct sifs* fs, const char* path);
+
+#pragma GCC visibility pop
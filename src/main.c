@@ -1,17 +1,88 @@
 #include "mkfs/mkfs.h"
+#include "debug/debug.h"
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+// Разбирает размер с необязательным суффиксом K, M, G или T (степени 1024).
+// Возвращает 0 при ошибке
+static uint64_t parse_size(const char* text) {
+  char* end;
+  errno = 0;
+  uint64_t value = strtoull(text, &end, 10);
+  if (errno || end == text) return 0;
+
+  uint32_t shift = 0;
+  switch (toupper((unsigned char)*end)) {
+    case '\0': break;
+    case 'K': shift = 10; break;
+    case 'M': shift = 20; break;
+    case 'G': shift = 30; break;
+    case 'T': shift = 40; break;
+    default: return 0;
+  }
+  if (*end && end[1]) return 0;
+
+  // Переполнение 64 бит
+  if (shift && value > (UINT64_MAX >> shift)) return 0;
+  return value << shift;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr,
+      "Запустите: %s [-b размер_блока] [-i байт_на_inode] [-N число_inode] "
+      "[-g блоков_в_группе] [--lazy-itable] <imagefile> <size>[K|M|G|T]\n"
+      "  -b  размер блока в байтах: 512-65536, степень двойки (по умолчанию %u)\n"
+      "  -i  байт пространства на один inode (по умолчанию %u)\n"
+      "  -N  точное число inode (переопределяет -i)\n"
+      "  -g  разметка по группам блоков указанного размера (кратно 64)\n"
+      "  --lazy-itable  не обнулять таблицу inode (остается разреженной)\n",
+      prog, DEFAULT_BLOCK_SIZE, DEFAULT_BYTES_PER_INODE);
+}
 
 int main(int argc, char* argv[]) {
-  if (argc != 3) {
-    fprintf(stderr, "Запустите: %s <imagefile> <size>\n", argv[0]);
+  sifs_log_level_from_env();
+
+  struct fs_geometry geo;
+  init_fs_geometry(&geo);
+
+  static const struct option long_options[] = {
+    { "lazy-itable", no_argument, NULL, 'L' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  int32_t flags = 0;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "b:i:N:g:", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'b': geo.block_size = strtoul(optarg, NULL, 0); break;
+      case 'i': geo.bytes_per_inode = strtoul(optarg, NULL, 0); break;
+      case 'N': geo.inode_count = strtoul(optarg, NULL, 0); break;
+      case 'g': geo.blocks_per_group = strtoul(optarg, NULL, 0); break;
+      case 'L': flags |= MKFS_LAZY_ITABLE; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (argc - optind != 2) {
+    usage(argv[0]);
     return 1;
   }
 
-  const char* filename = argv[1];
-  uint32_t size = atoi(argv[2]);
+  const char* filename = argv[optind];
+  uint64_t size = parse_size(argv[optind + 1]);
+  if (size == 0) {
+    fprintf(stderr, "Неверный размер: %s\n", argv[optind + 1]);
+    return 1;
+  }
 
-  if (mkfs(filename, size)) {
+  if (mkfs(filename, size, &geo, flags)) {
     fprintf(stderr, "Не удалось создать файловую систему\n");
     return 1;
   }
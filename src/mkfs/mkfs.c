@@ -2,67 +2,305 @@
 #include "../superblock/superblock.h"
 #include "../inode_bitmap/inode_bitmap.h"
 #include "../blocks_bitmap/blocks_bitmap.h"
-#include "../inode_table/inode.h"
+#include "../inode_table/inode_table.h"
 #include "../image/image.h"
+#include "../block_cache/block_cache.h"
+#include "../directory/directory.h"
+#include "../debug/debug.h"
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <unistd.h>
 
-int32_t mkfs(const char* filename, uint32_t size) {
-    // Создаем файл-образ
-    if (image_open(filename, 1) < 0) return -1;
+// Область метаданных: начало копируется из head, остаток - нули
+struct mkfs_region {
+    off_t offset;               // Смещение области в образе
+    uint64_t size;              // Размер области в байтах
+    const uint8_t* head;        // Ненулевое начало области
+    uint64_t head_size;         // Размер head
+    bool zero_tail;             // Обнулять остаток (иначе он остается дырой)
+    uint64_t first_chunk;       // Номер первой порции области в задании
+};
+
+// Задание для потоков инициализации: области делятся на порции
+// MKFS_CHUNK_SIZE, которые потоки разбирают по общему счетчику
+struct mkfs_work {
+    struct image* img;
+    struct mkfs_region* regions;
+    uint32_t count;
+    uint64_t chunks;            // Всего порций
+    atomic_uint_fast64_t next;  // Следующая свободная порция
+    atomic_bool failed;
+};
+
+// Число порций в области
+static uint64_t region_chunks(const struct mkfs_region* region) {
+    return (region->size + MKFS_CHUNK_SIZE - 1) / MKFS_CHUNK_SIZE;
+}
+
+// Записывает одну порцию области: часть из head и обнуляемый остаток
+static int32_t write_chunk(struct image* img, const struct mkfs_region* region,
+                           uint64_t chunk) {
+    uint64_t start = chunk * MKFS_CHUNK_SIZE;
+    uint64_t end = start + MKFS_CHUNK_SIZE;
+    if (end > region->size) end = region->size;
+
+    if (start < region->head_size) {
+        uint64_t n = (end < region->head_size ? end : region->head_size) - start;
+        if (image_write(img, region->head + start, n,
+                        region->offset + (off_t)start) < 0) {
+            return -1;
+        }
+        start += n;
+    }
+
+    if (start < end && region->zero_tail &&
+        image_zero(img, region->offset + (off_t)start, end - start) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Находит область, которой принадлежит порция (двоичный поиск)
+static uint32_t find_region(const struct mkfs_work* work, uint64_t chunk) {
+    uint32_t lo = 0, hi = work->count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (work->regions[mid].first_chunk <= chunk) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void* mkfs_worker(void* arg) {
+    struct mkfs_work* work = arg;
+
+    while (!atomic_load(&work->failed)) {
+        uint64_t chunk = atomic_fetch_add(&work->next, 1);
+        if (chunk >= work->chunks) break;
+
+        const struct mkfs_region* region = &work->regions[find_region(work, chunk)];
+        if (write_chunk(work->img, region, chunk - region->first_chunk) < 0) {
+            atomic_store(&work->failed, true);
+        }
+    }
+
+    return NULL;
+}
+
+// Инициализирует области метаданных на нескольких потоках.
+// Возвращает 0 или -1 при ошибке
+static int32_t write_regions(struct mkfs_work* work) {
+    uint64_t chunks = 0;
+    for (uint32_t i = 0; i < work->count; i++) {
+        work->regions[i].first_chunk = chunks;
+        chunks += region_chunks(&work->regions[i]);
+    }
+    work->chunks = chunks;
+    atomic_init(&work->next, 0);
+    atomic_init(&work->failed, false);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t threads = cpus > 0 ? (uint64_t)cpus : 1;
+    if (threads > MKFS_MAX_THREADS) threads = MKFS_MAX_THREADS;
+    if (threads > chunks) threads = chunks ? chunks : 1;
 
-    // Инициализируем суперблок
+    sifs_debug("Инициализация метаданных: %" PRIu64 " порций, %" PRIu64
+               " потоков\n", chunks, threads);
+
+    // Текущий поток работает наравне с дополнительными
+    pthread_t tids[MKFS_MAX_THREADS];
+    uint32_t started = 0;
+    for (uint64_t t = 1; t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, mkfs_worker, work) != 0) break;
+        started++;
+    }
+    mkfs_worker(work);
+    for (uint32_t t = 0; t < started; t++) pthread_join(tids[t], NULL);
+
+    return atomic_load(&work->failed) ? -1 : 0;
+}
+
+// Заполняет дескрипторы групп новой ФС. Корневой каталог уже выделил
+// блоки в группе 0 (head - суперблок, через который они выделялись)
+static void fill_descriptors(const struct superblock* sb,
+                             const struct superblock* head,
+                             struct group_desc* descs) {
+    uint64_t root_blocks = sb->count_free_blocks - head->count_free_blocks;
+    for (uint32_t g = 0; g < sb->count_groups; g++) {
+        struct group_layout layout;
+        superblock_group_layout(sb, g, &layout);
+        descs[g].block_bitmap = layout.block_bitmap;
+        descs[g].inode_bitmap = layout.inode_bitmap;
+        descs[g].inode_table = layout.inode_table;
+        descs[g].free_blocks = layout.end_block - layout.first_data_block;
+        descs[g].free_inodes = layout.count_inodes;
+    }
+    descs[0].free_blocks -= root_blocks;
+    descs[0].free_inodes -= 2;  // inode 0 и корневой
+}
+
+// Составляет список областей метаданных. Без групп это три сплошные
+// области; с группами - таблица дескрипторов и по три области на группу.
+// Ненулевое начало есть только у структур группы 0 и у битовых карт
+// блоков остальных групп (их системный префикс одинаков: group_bitmap)
+static uint32_t build_regions(const struct superblock* sb,
+                              struct mkfs_region* regions,
+                              const uint8_t* block_bitmap,
+                              uint64_t block_bitmap_size,
+                              const uint8_t* group_bitmap,
+                              const uint8_t* inode_bitmap,
+                              const uint8_t* inode_table,
+                              const struct group_desc* descs,
+                              int32_t flags) {
+    const uint64_t bs = sb->block_size;
+    const bool lazy = flags & MKFS_LAZY_ITABLE;
+    uint32_t count = 0;
+
+    if (!(sb->features & FS_FEATURE_GROUPS)) {
+        regions[count++] = (struct mkfs_region){
+            (off_t)sb->first_inode_bitmap_block * bs,
+            sb->count_inode_bitmap_blocks * bs, inode_bitmap, bs, true, 0 };
+        regions[count++] = (struct mkfs_region){
+            (off_t)sb->first_block_bitmap_block * bs,
+            sb->count_block_bitmap_blocks * bs,
+            block_bitmap, block_bitmap_size, true, 0 };
+        regions[count++] = (struct mkfs_region){
+            (off_t)sb->first_inode_table_block * bs,
+            sb->count_inode_table_blocks * bs, inode_table, bs, !lazy, 0 };
+        return count;
+    }
+
+    regions[count++] = (struct mkfs_region){
+        (off_t)sb->first_group_desc_block * bs,
+        sb->count_group_desc_blocks * bs, (const uint8_t*)descs,
+        (uint64_t)sb->count_groups * sizeof(struct group_desc), true, 0 };
+
+    const uint64_t group_bitmap_size = sb->blocks_per_group / 8;
+    for (uint32_t g = 0; g < sb->count_groups; g++) {
+        struct group_layout layout;
+        superblock_group_layout(sb, g, &layout);
+        bool first = g == 0;
+
+        regions[count++] = (struct mkfs_region){
+            (off_t)layout.block_bitmap * bs, bs,
+            first ? block_bitmap : group_bitmap,
+            first && block_bitmap_size < group_bitmap_size ?
+                block_bitmap_size : group_bitmap_size,
+            true, 0 };
+        regions[count++] = (struct mkfs_region){
+            (off_t)layout.inode_bitmap * bs, bs,
+            first ? inode_bitmap : NULL, first ? bs : 0, true, 0 };
+        regions[count++] = (struct mkfs_region){
+            (off_t)layout.inode_table * bs, layout.inode_table_blocks * bs,
+            first ? inode_table : NULL, first ? bs : 0, !lazy, 0 };
+    }
+    return count;
+}
+
+int32_t mkfs(const char* filename, uint64_t size,
+             const struct fs_geometry* geo, int32_t flags) {
+    // Инициализируем суперблок до создания файла, чтобы не оставить
+    // пустой образ при неверной геометрии
     struct superblock sb;
-    init_superblock(&sb, size);
+    if (init_superblock(&sb, size, geo) < 0) return -1;
+
+    // Создаем файл-образ
+    struct image* img = image_open(filename, IMAGE_TRUNCATE);
+    if (!img) return -1;
 
-    // Записываем суперблок
-    image_write(&sb, sizeof(sb), 0);
+    // Задаем полный размер образа: новый файл целиком разрежен и читается
+    // как нули, поэтому записывать нужно только ненулевые части метаданных
+    int32_t result = 0;
+    if (image_resize(img, (off_t)sb.count_blocks * sb.block_size) < 0) {
+        result = -1;
+    }
 
-    // Вычисляем размеры областей
-    size_t inode_bitmap_size = sb.count_inode_bitmap_blocks * sb.block_size;
-    size_t block_bitmap_size = sb.count_block_bitmap_blocks * sb.block_size;
-    size_t inode_table_size = sb.count_inode_table_blocks * sb.block_size;
+    // Корневой каталог выделяет блоки сразу за метаданными (в группе 0).
+    // Ему передается суперблок, ограниченный первыми MKFS_ROOT_BLOCKS
+    // блоками данных, и начало битовой карты блоков, покрывающее только их
+    struct group_layout group0;
+    superblock_group_layout(&sb, 0, &group0);
+    struct superblock head = sb;
+    head.count_blocks = group0.end_block;
+    if (head.count_blocks > sb.first_block_data + MKFS_ROOT_BLOCKS) {
+        head.count_blocks = sb.first_block_data + MKFS_ROOT_BLOCKS;
+    }
+    // Округление до слова: поиск свободного бита читает карту словами
+    size_t head_bitmap_size = ((head.count_blocks + 63) / 64) * 8;
 
-    // Выделяем память под метаданные
-    uint8_t* inode_bitmap = malloc(inode_bitmap_size);
-    uint8_t* block_bitmap = malloc(block_bitmap_size);
-    uint8_t* inode_table = malloc(inode_table_size);
+    bool groups = sb.features & FS_FEATURE_GROUPS;
+    uint32_t region_count = groups ? 1 + 3 * sb.count_groups : 3;
 
-    // Инициализируем битовые карты
-    memset(inode_bitmap, 0, inode_bitmap_size);
-    memset(block_bitmap, 0, block_bitmap_size);
-    inode_bitmap_init(&sb, inode_bitmap);
-    block_bitmap_init(&sb, block_bitmap);
+    uint8_t* block_bitmap = malloc(head_bitmap_size);
+    uint8_t* group_bitmap = calloc(1, sb.block_size);
+    uint8_t* inode_bitmap = malloc(sb.block_size);
+    uint8_t* inode_table = calloc(1, sb.block_size);
+    struct group_desc* descs = calloc(sb.count_groups, sizeof(struct group_desc));
+    struct mkfs_region* regions = calloc(region_count, sizeof(struct mkfs_region));
+    if (!block_bitmap || !group_bitmap || !inode_bitmap || !inode_table ||
+        !descs || !regions) {
+        result = -1;
+        goto out;
+    }
 
-    // Инициализируем таблицу inode
-    memset(inode_table, 0, inode_table_size);
-    struct inode* root_inode = (struct inode*)(inode_table + sb.root_inode * sb.inode_size);
-    root_inode->mode = S_IFDIR;
-    root_inode->links = 2;
-    root_inode->size = 0;
-    time_t now = time(NULL);
-    root_inode->atime = now;
-    root_inode->mtime = now;
-    root_inode->ctime = now;
+    block_bitmap_init_range(&sb, block_bitmap, 0, head_bitmap_size);
+    inode_bitmap_init_range(&sb, inode_bitmap, 0, sb.block_size);
+    sb.count_free_inodes = sb.count_inodes - 2;  // inode 0 и корневой
 
-    // Записываем метаданные в образ
-    off_t offset = sb.block_size; // После суперблока
+    // Системный префикс битовой карты у всех групп, кроме нулевой, одинаков
+    if (groups && sb.count_groups > 1) {
+        block_bitmap_init_range(&sb, group_bitmap, sb.blocks_per_group / 8,
+                                sb.blocks_per_group / 8);
+    }
 
-    image_write(inode_bitmap, inode_bitmap_size, offset);
-    offset += (off_t)inode_bitmap_size;
+    // Корневой inode лежит в первом блоке таблицы; "." и ".." корня
+    // указывают на него самого. Блоки каталога идут через кэш на все
+    // блоки корня и записываются при его закрытии
+    struct inode root;
+    struct bitmap_allocator alloc;
+    init_inode(&root, S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR, 0, 0);
+    bitmap_allocator_init(&alloc, &head, block_bitmap);
+    struct block_cache* bcache = block_cache_create(img, sb.block_size,
+                                                    MKFS_ROOT_BLOCKS);
+    if (!bcache ||
+        dir_init(bcache, &head, &alloc.base, &root, sb.root_inode,
+                 sb.root_inode) < 0 ||
+        !write_inode(&sb, inode_table, sb.root_inode, &root)) {
+        result = -1;
+    }
+    if (block_cache_destroy(bcache) < 0) result = -1;
+    if (groups) fill_descriptors(&sb, &head, descs);
+    sb.count_free_blocks = head.count_free_blocks;
+    sb.next_free_block = head.next_free_block;
 
-    image_write(block_bitmap, block_bitmap_size, offset);
-    offset += (off_t)block_bitmap_size;
+    // Битовые карты и таблица inode инициализируются параллельно
+    struct mkfs_work work = { .img = img, .regions = regions };
+    work.count = build_regions(&sb, regions, block_bitmap, head_bitmap_size,
+                               group_bitmap, inode_bitmap, inode_table, descs,
+                               flags);
+    if (result == 0 && write_regions(&work) < 0) result = -1;
 
-    image_write(inode_table, inode_table_size, offset);
+    // Суперблок записывается последним: прерванное создание не оставляет
+    // образа, который выглядит корректным
+    if (result == 0 && image_write(img, &sb, sizeof(sb), 0) < 0) result = -1;
 
+out:
     // Освобождаем ресурсы
-    free(inode_bitmap);
     free(block_bitmap);
+    free(group_bitmap);
+    free(inode_bitmap);
     free(inode_table);
-    image_close();
+    free(descs);
+    free(regions);
+    if (image_close(img) < 0) result = -1;
 
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
@@ -1,6 +1,21 @@
 #pragma once
 
 #include <stdint.h>
+#include "../superblock/superblock.h"
 
-// Создание образа SIFS (запись в файл)
-extern int32_t mkfs(const char* filename, uint32_t size);
+// Флаги создания ФС
+#define MKFS_LAZY_ITABLE 0x1    // Не обнулять таблицу inode при создании
+
+#define MKFS_CHUNK_SIZE (4 << 20)   // Порция записи и обнуления метаданных
+#define MKFS_MAX_THREADS 8          // Наибольшее число потоков инициализации
+#define MKFS_ROOT_BLOCKS 64         // Блоков данных, доступных корневому каталогу
+
+// Создание образа SIFS (запись в файл).
+// geo == NULL - геометрия по умолчанию, flags - комбинация MKFS_*.
+// Метаданные пишутся порциями по MKFS_CHUNK_SIZE из нескольких потоков,
+// поэтому память не зависит от размера образа. Таблица inode обнуляется
+// средствами ФС хоста (fallocate), а с MKFS_LAZY_ITABLE остается дырой
+// разреженного образа: она читается как нули, а место под нее выделяется
+// при первой записи inode
+extern int32_t mkfs(const char* filename, uint64_t size,
+                    const struct fs_geometry* geo, int32_t flags);
@@ -0,0 +1,104 @@
+#include "namei.h"
+#include <errno.h>
+#include <string.h>
+#include "../directory/directory.h"
+
+// Находит имя в каталоге dir_ino через кэш или блоки каталога
+static int32_t lookup_component(struct block_cache* bcache,
+                                struct superblock* sb,
+                                struct inode_cache* icache,
+                                struct dcache* dcache,
+                                uint32_t dir_ino, const char* name,
+                                size_t len, uint32_t* ino) {
+  if (dcache && dcache_lookup(dcache, dir_ino, name, len, ino)) {
+    if (*ino == 0) {
+      errno = ENOENT;
+      return -1;
+    }
+    return 0;
+  }
+
+  struct cached_inode* dir = inode_cache_get(icache, dir_ino, true);
+  if (!dir) return -1;
+  if (!S_ISDIR(dir->node.mode)) {
+    inode_cache_put(icache, dir);
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  int32_t result = dir_lookup(bcache, sb, &dir->node, name, len, ino);
+  int saved = errno;
+  inode_cache_put(icache, dir);
+  if (result < 0) {
+    if (saved == ENOENT && dcache) {
+      dcache_insert(dcache, dir_ino, name, len, 0);
+    }
+    errno = saved;
+    return -1;
+  }
+
+  if (dcache) dcache_insert(dcache, dir_ino, name, len, *ino);
+  return 0;
+}
+
+// Проходит первые size байт пути
+static int32_t walk(struct block_cache* bcache, struct superblock* sb,
+                    struct inode_cache* icache, struct dcache* dcache,
+                    const char* path, size_t size, uint32_t* ino) {
+  uint32_t cur = sb->root_inode;
+  const char* end = path + size;
+
+  for (const char* p = path; p < end;) {
+    if (*p == '/') {
+      p++;
+      continue;
+    }
+
+    const char* slash = memchr(p, '/', end - p);
+    size_t len = (slash ? slash : end) - p;
+    if (len != 1 || p[0] != '.') {
+      if (lookup_component(bcache, sb, icache, dcache, cur, p, len, &cur) < 0) {
+        return -1;
+      }
+    }
+    p += len;
+  }
+
+  *ino = cur;
+  return 0;
+}
+
+int32_t path_lookup(struct block_cache* bcache,
+                    struct superblock* sb,
+                    struct inode_cache* icache,
+                    struct dcache* dcache,
+                    const char* path,
+                    uint32_t* ino) {
+  return walk(bcache, sb, icache, dcache, path, strlen(path), ino);
+}
+
+int32_t path_lookup_parent(struct block_cache* bcache,
+                           struct superblock* sb,
+                           struct inode_cache* icache,
+                           struct dcache* dcache,
+                           const char* path,
+                           uint32_t* parent,
+                           const char** name,
+                           size_t* len) {
+  // Последний компонент - после последнего '/', не считая завершающих
+  size_t size = strlen(path);
+  while (size > 0 && path[size - 1] == '/') size--;
+
+  size_t start = size;
+  while (start > 0 && path[start - 1] != '/') start--;
+
+  *name = path + start;
+  *len = size - start;
+  if (*len == 0 || (*len == 1 && path[start] == '.') ||
+      (*len == 2 && path[start] == '.' && path[start + 1] == '.')) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return walk(bcache, sb, icache, dcache, path, start, parent);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../dcache/dcache.h"
+#include "../block_cache/block_cache.h"
+#include "../inode_cache/inode_cache.h"
+#include "../superblock/superblock.h"
+
+// Разрешение путей от корневого каталога (sb->root_inode).
+// Компоненты разделяются '/', пустые компоненты и "." пропускаются,
+// ".." берется из записи каталога (у корня указывает на него самого).
+// Каждый компонент сначала ищется в dcache, при промахе - в блоках
+// каталога; результат, в том числе отсутствие имени, запоминается.
+// Inode каталогов читаются через кэш inode. dcache может быть NULL.
+
+// Находит inode по пути. Возвращает 0 или -1 (errno = ENOENT, ENOTDIR,
+// ENAMETOOLONG, EIO)
+extern int32_t path_lookup(struct block_cache* bcache,
+                           struct superblock* sb,
+                           struct inode_cache* icache,
+                           struct dcache* dcache,
+                           const char* path,
+                           uint32_t* ino);
+
+// Находит каталог, содержащий последний компонент пути, и возвращает
+// сам компонент (указатель внутрь path и длину) - для создания и
+// удаления записей. Возвращает 0 или -1 (errno = EINVAL для пути без
+// последнего компонента, "." или "..")
+extern int32_t path_lookup_parent(struct block_cache* bcache,
+                                  struct superblock* sb,
+                                  struct inode_cache* icache,
+                                  struct dcache* dcache,
+                                  const char* path,
+                                  uint32_t* parent,
+                                  const char** name,
+                                  size_t* len);
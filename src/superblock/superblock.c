@@ -1,48 +1,240 @@
 #include "superblock.h"
+#include <inttypes.h>
 #include <string.h>
 #include "../debug/debug.h"
 
 extern uint8_t superblock_valid(const struct superblock* sb) {
-  uint8_t valid = sb->magic == FS_MAGIC;
+  uint8_t valid = sb->magic == FS_MAGIC && sb->revision == FS_REVISION &&
+                  sb->inode_size == INODE_SIZE;
   sifs_debug("Проверка суперблока: %s\n", valid ? "валиден" : "невалиден");
   return valid;
 }
 
-extern uint32_t get_bitmap_blocks(const uint32_t bits,
-                                         const uint32_t block_size) {
-  uint32_t blocks = (bits + block_size * 8 - 1) / (block_size * 8);
-  sifs_debug("Расчет блоков битмапа: биты=%u, размер_блока=%u, результат=%u\n",
-      bits, block_size, blocks);
+extern uint64_t get_bitmap_blocks(const uint64_t bits,
+                                  const uint32_t block_size) {
+  const uint64_t bits_per_block = (uint64_t)block_size * 8;
+  uint64_t blocks = (bits + bits_per_block - 1) / bits_per_block;
+  sifs_debug("Расчет блоков битмапа: биты=%" PRIu64 ", размер_блока=%u, "
+      "результат=%" PRIu64 "\n", bits, block_size, blocks);
   return blocks;
 }
 
-extern void init_superblock(struct superblock* sb,
-                                   const uint32_t space_size) {
-    const uint32_t block_size = DEFAULT_BLOCK_SIZE;
+extern void init_fs_geometry(struct fs_geometry* geo) {
+    geo->block_size = DEFAULT_BLOCK_SIZE;
+    geo->bytes_per_inode = DEFAULT_BYTES_PER_INODE;
+    geo->inode_count = 0;
+    geo->blocks_per_group = 0;
+}
+
+extern bool fs_geometry_valid(const struct fs_geometry* geo) {
+    uint32_t bs = geo->block_size;
+    if (bs < MIN_BLOCK_SIZE || bs > MAX_BLOCK_SIZE || (bs & (bs - 1))) {
+        sifs_error("Недопустимый размер блока %u (степень двойки %u-%u)\n",
+                   bs, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+        return false;
+    }
+    if (!geo->inode_count && geo->bytes_per_inode < DEFAULT_INODE_SIZE) {
+        sifs_error("Недопустимое число байт на inode: %u (минимум %u)\n",
+                   geo->bytes_per_inode, DEFAULT_INODE_SIZE);
+        return false;
+    }
+    uint32_t bpg = geo->blocks_per_group;
+    if (bpg && (bpg % 64 || bpg < MIN_BLOCKS_PER_GROUP || bpg > bs * 8)) {
+        sifs_error("Недопустимый размер группы %u блоков (кратно 64, %u-%u)\n",
+                   bpg, MIN_BLOCKS_PER_GROUP, bs * 8);
+        return false;
+    }
+    return true;
+}
+
+// Разметка по группам блоков. Размер группы ограничен одним блоком битовой
+// карты блоков, число inode в группе - одним блоком битовой карты inode
+static int32_t init_superblock_groups(struct superblock* sb,
+                                      uint64_t total_blocks,
+                                      uint64_t inode_count,
+                                      const struct fs_geometry* geo) {
+    const uint32_t block_size = geo->block_size;
+    const uint32_t bpg = geo->blocks_per_group;
+    const uint32_t per_block = INODES_PER_BLOCK(block_size, DEFAULT_INODE_SIZE);
+
+    // Срез таблицы занимает целые блоки, а срез битовой карты inode -
+    // целые 64-битные слова (группы не делят слов карты)
+    const uint32_t align = per_block > 64 ? per_block : 64;
+
+    uint64_t groups = (total_blocks + bpg - 1) / bpg;
+    uint64_t desc_blocks, table_blocks, ipg;
+
+    // Неполная последняя группа без места под данные отбрасывается
+    do {
+        desc_blocks = (groups * GROUP_DESC_SIZE + block_size - 1) / block_size;
+
+        // Группа 0 вмещает суперблок, дескрипторы, две битовые карты,
+        // срез таблицы и хотя бы один блок данных
+        if (bpg < desc_blocks + 4 + 1) {
+            sifs_error("Группа из %u блоков не вмещает метаданные\n", bpg);
+            return -1;
+        }
+        uint64_t max_ipg = (bpg - desc_blocks - 4) * per_block;
+        if (max_ipg > (uint64_t)block_size * 8) max_ipg = (uint64_t)block_size * 8;
+        if (max_ipg > UINT32_MAX / groups) max_ipg = UINT32_MAX / groups;
+
+        ipg = (inode_count + groups - 1) / groups;
+        ipg = (ipg + align - 1) / align * align;
+        if (ipg > max_ipg) ipg = max_ipg / align * align;
+        table_blocks = ipg / per_block;
+
+        uint64_t last = total_blocks - (groups - 1) * bpg;
+        uint64_t last_meta = groups == 1 ? desc_blocks + 3 + table_blocks
+                                         : 2 + table_blocks;
+        if (last > last_meta) break;
+        if (groups == 1) {
+            sifs_error("Недостаточно места под метаданные\n");
+            return -1;
+        }
+        groups--;
+        total_blocks = groups * bpg;
+    } while (1);
+
+    if (ipg == 0) {
+        sifs_error("Группа из %u блоков не вмещает таблицу inode\n", bpg);
+        return -1;
+    }
+
+    uint64_t total_meta_blocks = 1 + desc_blocks + groups * (2 + table_blocks);
+
+    memset(sb, 0, sizeof(struct superblock));
+    sb->magic = FS_MAGIC;
+    sb->revision = FS_REVISION;
+    strncpy(sb->fs_name, FS_NAME, MAX_FS_NAME);
+    sb->block_size = block_size;
+    sb->inode_size = DEFAULT_INODE_SIZE;
+    sb->features = FS_FEATURE_GROUPS;
+
+    // Учет ресурсов
+    sb->count_groups = groups;
+    sb->blocks_per_group = bpg;
+    sb->inodes_per_group = ipg;
+    sb->count_inodes = groups * ipg;
+    sb->count_free_inodes = sb->count_inodes - 1;  // inode 0 зарезервирован
+    sb->count_blocks = total_blocks;
+    sb->count_free_blocks = total_blocks - total_meta_blocks;
+    sb->count_blocks_data = total_blocks - total_meta_blocks;
+
+    // Суммарные размеры областей всех групп
+    sb->count_inode_bitmap_blocks = groups;
+    sb->count_block_bitmap_blocks = groups;
+    sb->count_inode_table_blocks = groups * table_blocks;
+
+    // Структуры группы 0
+    sb->first_group_desc_block = 1;
+    sb->count_group_desc_blocks = desc_blocks;
+    sb->first_block_bitmap_block = 1 + desc_blocks;
+    sb->first_inode_bitmap_block = sb->first_block_bitmap_block + 1;
+    sb->first_inode_table_block = sb->first_inode_bitmap_block + 1;
+    sb->first_block_data = sb->first_inode_table_block + table_blocks;
+
+    sb->root_inode = 1;
+    sb->next_free_block = sb->first_block_data;
+    sb->clean_shutdown = 1;
+
+    sifs_info("Суперблок инициализирован успешно\n");
+    sifs_info("Всего блоков: %" PRIu64 "\n", total_blocks);
+    sifs_info("Групп: %" PRIu64 " по %u блоков и %" PRIu64 " inode\n",
+              groups, bpg, ipg);
+    sifs_info("Метаблоков: %" PRIu64 "\n", total_meta_blocks);
+    sifs_info("Inode: %u (%u свободно)\n", sb->count_inodes,
+              sb->count_free_inodes);
+    sifs_info("Блоков данных: %" PRIu64 "\n", sb->count_blocks_data);
+    return 0;
+}
+
+void superblock_group_layout(const struct superblock* sb, uint32_t group,
+                             struct group_layout* layout) {
+    if (!(sb->features & FS_FEATURE_GROUPS)) {
+        layout->first_block = 0;
+        layout->end_block = sb->count_blocks;
+        layout->first_data_block = sb->first_block_data;
+        layout->block_bitmap = sb->first_block_bitmap_block;
+        layout->inode_bitmap = sb->first_inode_bitmap_block;
+        layout->inode_table = sb->first_inode_table_block;
+        layout->inode_table_blocks = sb->count_inode_table_blocks;
+        layout->first_inode = 0;
+        layout->count_inodes = sb->count_inodes;
+        return;
+    }
+
+    // Перед структурами группы 0 лежат суперблок и дескрипторы
+    uint64_t table_blocks = sb->count_inode_table_blocks / sb->count_groups;
+    uint64_t first = (uint64_t)group * sb->blocks_per_group;
+    uint64_t meta = group ? 0 : 1 + sb->count_group_desc_blocks;
+
+    layout->first_block = first;
+    layout->end_block = first + sb->blocks_per_group;
+    if (layout->end_block > sb->count_blocks) layout->end_block = sb->count_blocks;
+    layout->block_bitmap = first + meta;
+    layout->inode_bitmap = layout->block_bitmap + 1;
+    layout->inode_table = layout->inode_bitmap + 1;
+    layout->inode_table_blocks = table_blocks;
+    layout->first_data_block = layout->inode_table + table_blocks;
+    layout->first_inode = group * sb->inodes_per_group;
+    layout->count_inodes = sb->inodes_per_group;
+}
+
+uint32_t superblock_block_group(const struct superblock* sb, uint64_t block) {
+    if (!(sb->features & FS_FEATURE_GROUPS)) return 0;
+    return block / sb->blocks_per_group;
+}
+
+uint32_t superblock_inode_group(const struct superblock* sb,
+                                uint32_t inode_idx) {
+    if (!(sb->features & FS_FEATURE_GROUPS)) return 0;
+    return inode_idx / sb->inodes_per_group;
+}
+
+extern int32_t init_superblock(struct superblock* sb,
+                               const uint64_t space_size,
+                               const struct fs_geometry* geo) {
+    struct fs_geometry defaults;
+    if (!geo) {
+        init_fs_geometry(&defaults);
+        geo = &defaults;
+    }
+    if (!fs_geometry_valid(geo)) return -1;
+
+    const uint32_t block_size = geo->block_size;
     const uint32_t inode_size = DEFAULT_INODE_SIZE;
 
     // Расчет общего количества блоков в разделе
-    uint32_t total_blocks = (space_size + block_size - 1) / block_size;
+    uint64_t total_blocks = (space_size + block_size - 1) / block_size;
 
     // Минимальные требования к размеру ФС
     if (total_blocks < 10) {
-        sifs_debug("Ошибка: ФС слишком мала. Требуется минимум 10 блоков.\n");
-        return;
+        sifs_error("ФС слишком мала. Требуется минимум 10 блоков.\n");
+        return -1;
     }
 
-    // 1 inode на 4 блока данных
-    uint32_t inode_count = total_blocks / 4;
+    // Явно заданное число inode либо 1 inode на bytes_per_inode байт
+    // (номера inode остаются 32-битными)
+    uint64_t derived = total_blocks * block_size / geo->bytes_per_inode;
+    if (derived > UINT32_MAX) derived = UINT32_MAX;
+    uint32_t inode_count = geo->inode_count ? geo->inode_count :
+        (uint32_t)derived;
     if (inode_count < 2) inode_count = 2;  // Минимум 2 inode
 
+    if (geo->blocks_per_group) {
+        return init_superblock_groups(sb, total_blocks, inode_count, geo);
+    }
+
     // Расчет метаданных с итеративным подбором
-    uint32_t inode_bitmap_blocks, block_bitmap_blocks, inode_table_blocks;
-    uint32_t total_meta_blocks;
+    uint64_t inode_bitmap_blocks, block_bitmap_blocks, inode_table_blocks;
+    uint64_t total_meta_blocks;
 
     do {
         // Расчет блоков для структур метаданных
         inode_bitmap_blocks = get_bitmap_blocks(inode_count, block_size);
         block_bitmap_blocks = get_bitmap_blocks(total_blocks, block_size);
-        inode_table_blocks = (inode_count * inode_size + block_size - 1) / block_size;
+        inode_table_blocks =
+            ((uint64_t)inode_count * inode_size + block_size - 1) / block_size;
 
         // Суммарный размер метаданных
         total_meta_blocks = 1 +  // superblock
@@ -50,8 +242,9 @@ extern void init_superblock(struct superblock* sb,
             block_bitmap_blocks +
             inode_table_blocks;
 
-        // Корректировка количества inode при переполнении
-        if (total_meta_blocks >= total_blocks && inode_count > 2) {
+        // Корректировка вычисленного количества inode при переполнении
+        if (total_meta_blocks >= total_blocks && inode_count > 2 &&
+            !geo->inode_count) {
             inode_count--;
         } else {
             break;
@@ -60,13 +253,14 @@ extern void init_superblock(struct superblock* sb,
 
     // Проверка вместимости метаданных
     if (total_meta_blocks >= total_blocks) {
-        sifs_debug("Ошибка: Недостаточно места под метаданные\n");
-        return;
+        sifs_error("Недостаточно места под метаданные\n");
+        return -1;
     }
 
     // Заполнение структуры суперблока
     memset(sb, 0, sizeof(struct superblock));
     sb->magic = FS_MAGIC;
+    sb->revision = FS_REVISION;
     strncpy(sb->fs_name, FS_NAME, MAX_FS_NAME);
     sb->block_size = block_size;
     sb->inode_size = inode_size;
@@ -91,19 +285,23 @@ extern void init_superblock(struct superblock* sb,
 
     // Системные параметры
     sb->root_inode = 1;         // Корневой каталог в inode 1
+    sb->count_groups = 1;       // Вся ФС - одна группа
+    sb->next_free_block = sb->first_block_data;  // Поиск начинается с данных
     sb->clean_shutdown = 1;     // Флаг "чистого" выключения
 
-    // Отладочный вывод
-    sifs_debug("Суперблок инициализирован успешно\n");
-    sifs_debug("Всего блоков: %u\n", total_blocks);
-    sifs_debug("Метаблоков: %u\n", total_meta_blocks);
-    sifs_debug("Inode: %u (%u свободно)\n", inode_count, inode_count - 1);
-    sifs_debug("Блоков данных: %u\n", total_blocks - total_meta_blocks);
-    sifs_debug("Расположение: [0] Суперблок, [%u] Битмап inode (%u блоков), "
-              "[%u] Битмап блоков (%u блоков), [%u] Таблица inode (%u блоков), "
-              "[%u] Данные\n",
+    // Сводка по разметке
+    sifs_info("Суперблок инициализирован успешно\n");
+    sifs_info("Всего блоков: %" PRIu64 "\n", total_blocks);
+    sifs_info("Метаблоков: %" PRIu64 "\n", total_meta_blocks);
+    sifs_info("Inode: %u (%u свободно)\n", inode_count, inode_count - 1);
+    sifs_info("Блоков данных: %" PRIu64 "\n", total_blocks - total_meta_blocks);
+    sifs_info("Расположение: [0] Суперблок, [%" PRIu64 "] Битмап inode "
+              "(%" PRIu64 " блоков), [%" PRIu64 "] Битмап блоков "
+              "(%" PRIu64 " блоков), [%" PRIu64 "] Таблица inode "
+              "(%" PRIu64 " блоков), [%" PRIu64 "] Данные\n",
               sb->first_inode_bitmap_block, inode_bitmap_blocks,
               sb->first_block_bitmap_block, block_bitmap_blocks,
               sb->first_inode_table_block, inode_table_blocks,
               sb->first_block_data);
+    return 0;
 }
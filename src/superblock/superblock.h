@@ -1,21 +1,40 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <time.h>
 #include "../inode_table/inode.h"
 
 #define FS_MAGIC 0x53494653                         // Магическое число ФС (SIFS)
-#define FS_NAME "SIFS v1.0"                         // Название файловой системы
+#define FS_NAME "SIFS v1.1"                         // Название файловой системы
+#define FS_REVISION 7                               // Ревизия формата: группы блоков
 #define MAX_FS_NAME 32                              // Максимальная длина имени ФС
-#define DEFAULT_BLOCK_SIZE 512                      // Стандартный размер блока (2 КБ)
-#define DEFAULT_INODE_SIZE sizeof(struct inode)     // Размер inode по умолчанию
+#define DEFAULT_BLOCK_SIZE 512                      // Стандартный размер блока (512 байт)
+#define MIN_BLOCK_SIZE 512                          // Минимальный размер блока
+#define MAX_BLOCK_SIZE 65536                        // Максимальный размер блока (64 КБ)
+#define DEFAULT_INODE_SIZE ((uint32_t)INODE_SIZE)   // Размер inode на диске
+#define DEFAULT_BYTES_PER_INODE (4 * DEFAULT_BLOCK_SIZE) // 1 inode на 4 блока по умолчанию
 #define INODES_PER_BLOCK(block_size, inode_size) \
     ((block_size) / (inode_size))                   // Расчет максимального количества inode в блоке
+#define MIN_BLOCKS_PER_GROUP 256                    // Минимальный размер группы блоков
+#define GROUP_DESC_SIZE 32                          // Размер дескриптора группы на диске
+
+// Возможности формата (поле features)
+#define FS_FEATURE_GROUPS 0x1                       // Разметка по группам блоков
+
+// Параметры геометрии, задаваемые при создании ФС
+struct fs_geometry {
+    uint32_t block_size;                            // Размер блока (степень двойки)
+    uint32_t bytes_per_inode;                       // Байт пространства на один inode
+    uint32_t inode_count;                           // Число inode (0 - по bytes_per_inode)
+    uint32_t blocks_per_group;                      // Блоков в группе (0 - без групп)
+};
 
 // Структура суперблока
 struct superblock {
     // Идентификация
     uint32_t magic;                                 // Магическое число
+    uint32_t revision;                              // Ревизия формата (FS_REVISION)
     char fs_name[MAX_FS_NAME];                      // Имя ФС
 
     // Геометрия
@@ -23,36 +42,100 @@ struct superblock {
     uint32_t inode_size;                            // Размер inode в байтах
 
     // Расположение структур
-    uint32_t first_inode_bitmap_block;              // Стартовый блок битмапа inode
-    uint32_t first_block_bitmap_block;              // Стартовый блок битмапа блоков
-    uint32_t first_inode_table_block;               // Стартовый блок таблицы inode
-    uint32_t first_block_data;                      // Стартовый блок области данных
+    uint64_t first_inode_bitmap_block;              // Стартовый блок битмапа inode
+    uint64_t first_block_bitmap_block;              // Стартовый блок битмапа блоков
+    uint64_t first_inode_table_block;               // Стартовый блок таблицы inode
+    uint64_t first_block_data;                      // Стартовый блок области данных
 
     // Ресурсы
     uint32_t count_inodes;                          // Общее количество inode
     uint32_t count_free_inodes;                     // Количество свободных inode
-    uint32_t count_blocks;                          // Общее количество блоков
-    uint32_t count_free_blocks;                     // Количество свободных блоков
+    uint64_t count_blocks;                          // Общее количество блоков
+    uint64_t count_free_blocks;                     // Количество свободных блоков
 
     // Размеры областей
-    uint32_t count_inode_bitmap_blocks;             // Блоков под битмап inode
-    uint32_t count_block_bitmap_blocks;             // Блоков под битмап блоков
-    uint32_t count_inode_table_blocks;              // Блоков под таблицу inode
-    uint32_t count_blocks_data;                     // Блоков данных
+    uint64_t count_inode_bitmap_blocks;             // Блоков под битмап inode
+    uint64_t count_block_bitmap_blocks;             // Блоков под битмап блоков
+    uint64_t count_inode_table_blocks;              // Блоков под таблицу inode
+    uint64_t count_blocks_data;                     // Блоков данных
 
     // Корневой каталог
     uint32_t root_inode;                            // Inode корневого каталога
 
+    // Аллокатор
+    uint64_t next_free_block;                       // Курсор поиска свободного блока
+
     // Состояние
-    time_t last_mount;                              // Время последнего монтирования
+    int64_t last_mount;                             // Время последнего монтирования (нс)
     uint8_t clean_shutdown;                         // Флаг корректного завершения (1 = да)
+
+    // Группы блоков. Без FS_FEATURE_GROUPS вся ФС - одна группа с общими
+    // битовыми картами и таблицей inode (поля first_* выше). С группами
+    // каждая группа начинается со своей битовой карты блоков (1 блок),
+    // битовой карты inode (1 блок) и среза таблицы inode, за которыми идут
+    // ее данные; группа 0 перед ними содержит суперблок и таблицу
+    // дескрипторов групп. Поля first_* указывают на структуры группы 0,
+    // а count_* суммируют все группы, поэтому битовые карты и таблица inode
+    // в памяти по-прежнему сплошные и индексируются глобальными номерами.
+    uint32_t features;                              // Возможности формата (FS_FEATURE_*)
+    uint32_t count_groups;                          // Число групп (1 без групп)
+    uint32_t blocks_per_group;                      // Блоков в группе (кратно 64)
+    uint32_t inodes_per_group;                      // Inode в группе
+    uint64_t first_group_desc_block;                // Стартовый блок таблицы дескрипторов
+    uint64_t count_group_desc_blocks;               // Блоков под таблицу дескрипторов
+};
+
+// Дескриптор группы блоков на диске
+struct group_desc {
+    uint64_t block_bitmap;                          // Блок битовой карты блоков группы
+    uint64_t inode_bitmap;                          // Блок битовой карты inode группы
+    uint64_t inode_table;                           // Первый блок среза таблицы inode
+    uint32_t free_blocks;                           // Свободных блоков в группе
+    uint32_t free_inodes;                           // Свободных inode в группе
 };
 
-// Проверка валидности суперблока по магическому числу
+_Static_assert(sizeof(struct group_desc) == GROUP_DESC_SIZE,
+               "group descriptor must be GROUP_DESC_SIZE bytes");
+
+// Расположение группы блоков
+struct group_layout {
+    uint64_t first_block;                           // Первый блок группы
+    uint64_t end_block;                             // Блок за концом группы
+    uint64_t first_data_block;                      // Первый блок данных группы
+    uint64_t block_bitmap;                          // Битовая карта блоков группы
+    uint64_t inode_bitmap;                          // Битовая карта inode группы
+    uint64_t inode_table;                           // Срез таблицы inode группы
+    uint64_t inode_table_blocks;                    // Блоков в срезе таблицы
+    uint32_t first_inode;                           // Первый inode группы
+    uint32_t count_inodes;                          // Inode в группе
+};
+
+// Проверка валидности суперблока по магическому числу и ревизии формата
 extern uint8_t superblock_valid(const struct superblock* sb);
 
 // Расчет блоков для хранения битовой карты
-extern uint32_t get_bitmap_blocks(uint32_t bits, uint32_t block_size);
+extern uint64_t get_bitmap_blocks(uint64_t bits, uint32_t block_size);
+
+// Заполняет геометрию значениями по умолчанию
+extern void init_fs_geometry(struct fs_geometry* geo);
+
+// Проверяет допустимость геометрии (размер блока 512-64К, степень двойки)
+extern bool fs_geometry_valid(const struct fs_geometry* geo);
+
+// Рассчитывает расположение группы блоков (без групп - всей ФС)
+extern void superblock_group_layout(const struct superblock* sb,
+                                    uint32_t group,
+                                    struct group_layout* layout);
+
+// Номер группы, которой принадлежит блок
+extern uint32_t superblock_block_group(const struct superblock* sb,
+                                       uint64_t block);
+
+// Номер группы, которой принадлежит inode
+extern uint32_t superblock_inode_group(const struct superblock* sb,
+                                       uint32_t inode_idx);
 
-// Инициализация суперблока для нового раздела
-extern void init_superblock(struct superblock* sb, uint32_t space_size);
+// Инициализация суперблока для нового раздела.
+// geo == NULL - геометрия по умолчанию. Возвращает 0 или -1 при ошибке
+extern int32_t init_superblock(struct superblock* sb, uint64_t space_size,
+                               const struct fs_geometry* geo);